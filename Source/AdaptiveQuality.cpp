@@ -0,0 +1,104 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the adaptive
+    quality governor, which watches the processor's render time against the
+    block deadline and trades polyphony and voice quality for headroom.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "AdaptiveQuality.h"
+
+// Sets up the tiers for a voice count and returns to full quality.
+//
+// @param newSampleRate: The sample rate blocks will be rendered at.
+// @param numVoices: The synth's full polyphony.
+void AdaptiveQuality::prepare (double newSampleRate, int numVoices)
+{
+    sampleRate = newSampleRate;
+
+    tiers[0] = { numVoices, false };
+    tiers[1] = { numVoices, true };
+    tiers[2] = { juce::jmax (1, numVoices * 2 / 3), true };
+    tiers[3] = { juce::jmax (1, numVoices / 3), true };
+
+    tierIndex = 0;
+    averageLoad = 0.0f;
+    secondsSinceChange = 0.0;
+    quietSeconds = 0.0;
+}
+
+// Turns adaptation on or off. Off holds full quality, e.g. for offline
+// rendering, where there is no deadline to meet.
+//
+// @param shouldBeEnabled: True to adapt to the render load.
+void AdaptiveQuality::setEnabled (bool shouldBeEnabled) noexcept
+{
+    enabled = shouldBeEnabled;
+
+    if (! enabled)
+    {
+        tierIndex = 0;
+    }
+}
+
+// Audio thread: records how long a block took and moves between tiers.
+//
+// @param renderSeconds: The time taken to render the block.
+// @param numSamples: The number of samples in the block.
+// @return True if the tier changed.
+bool AdaptiveQuality::update (double renderSeconds, int numSamples) noexcept
+{
+    if (! enabled || numSamples <= 0)
+    {
+        return false;
+    }
+
+    const double blockSeconds = numSamples / sampleRate;
+    const float blockLoad = (float) (renderSeconds / blockSeconds);
+
+    // Exponential average with a time constant of about 100 ms
+    const float smoothing = (float) (1.0 - std::exp (-blockSeconds / 0.1));
+    const float load = averageLoad.load() + smoothing * (blockLoad - averageLoad.load());
+    averageLoad = load;
+
+    secondsSinceChange += blockSeconds;
+    const int current = tierIndex.load();
+
+    // A tier change needs a moment to show in the average before the next
+    if ((blockLoad > blockOverload || load > averageOverload) && current < numTiers - 1 && secondsSinceChange >= holdSeconds)
+    {
+        tierIndex = current + 1;
+        secondsSinceChange = 0.0;
+        quietSeconds = 0.0;
+        return true;
+    }
+
+    quietSeconds = load < averageHeadroom ? quietSeconds + blockSeconds : 0.0;
+
+    if (quietSeconds >= recoverySeconds && current > 0)
+    {
+        tierIndex = current - 1;
+        secondsSinceChange = 0.0;
+        quietSeconds = 0.0;
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,74 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the adaptive quality
+    governor, which watches the processor's render time against the block
+    deadline and trades polyphony and voice quality for headroom.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// Steps through quality tiers as the render load rises and falls:
+//   0  full quality, every voice
+//   1  reduced quality voices (coarser control rate, linear ladder filter)
+//   2  reduced quality, two thirds of the voices
+//   3  reduced quality, one third of the voices
+// A tier is dropped as soon as a block comes close to its deadline or the
+// average load is high, and regained only after a sustained quiet period.
+class AdaptiveQuality
+{
+public:
+    struct Tier
+    {
+        int maxVoices;
+        bool reducedQuality;
+    };
+
+    static constexpr int numTiers = 4;
+
+    // Load is render time as a proportion of the block's duration
+    static constexpr float blockOverload = 0.9f;
+    static constexpr float averageOverload = 0.7f;
+    static constexpr float averageHeadroom = 0.35f;
+
+    static constexpr double holdSeconds = 0.25;
+    static constexpr double recoverySeconds = 2.0;
+
+    void prepare (double, int);
+    void setEnabled (bool) noexcept;
+    bool update (double, int) noexcept;
+
+    int getTierIndex() const noexcept { return tierIndex.load(); }
+    const Tier& getTier() const noexcept { return tiers[tierIndex.load()]; }
+    float getLoad() const noexcept { return averageLoad.load(); }
+
+private:
+    Tier tiers[numTiers] {};
+    double sampleRate = 44100.0;
+    bool enabled = true;
+
+    // Audio thread state; the atomics are also read by the message thread
+    std::atomic<int> tierIndex { 0 };
+    std::atomic<float> averageLoad { 0.0f };
+    double secondsSinceChange = 0.0;
+    double quietSeconds = 0.0;
+};
@@ -0,0 +1,154 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the attack cache,
+    which memoises the opening samples of notes while the patch is unchanged.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "AttackCache.h"
+#include "LowLatencyMode.h"
+
+// Allocates room for every entry and forgets them all. Call before playback.
+//
+// @param sampleRate: The rate the voices render at.
+void AttackCache::prepare (double sampleRate)
+{
+    length = juce::jmax (1, juce::roundToInt (sampleRate * lengthMs / 1000.0));
+    samples.setSize (1, numEntries * length);
+    LowLatencyMode::prefaultBuffer (samples);
+
+    for (auto& entry : entries)
+    {
+        entry.numUsers = 0;
+        entry.lastUsed = 0;
+    }
+
+    clear();
+}
+
+// Forgets every entry, so the next note of each key records again.
+void AttackCache::clear() noexcept
+{
+    for (auto& entry : entries)
+    {
+        entry.key = -1;
+        entry.complete = false;
+    }
+}
+
+// Forgets every entry if the patch has changed since the last call.
+//
+// @param version: The processor's count of changes to the voices' settings.
+void AttackCache::setPatchVersion (juce::uint32 version) noexcept
+{
+    if (version != patchVersion)
+    {
+        patchVersion = version;
+        clear();
+    }
+}
+
+// Finds a finished recording of a note, and holds it until release.
+//
+// @param note: The MIDI note number.
+// @param velocity: The MIDI velocity, 0 to 127.
+// @return The entry to stream, or -1 if the note has not been recorded.
+int AttackCache::acquire (int note, int velocity) noexcept
+{
+    const int key = note * 128 + velocity;
+
+    for (int i = 0; i < numEntries; ++i)
+    {
+        if (entries[i].key == key && entries[i].complete)
+        {
+            ++entries[i].numUsers;
+            entries[i].lastUsed = ++useCount;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Claims the least recently used entry no voice is using, to record a note
+// into, and holds it until release.
+//
+// @param note: The MIDI note number.
+// @param velocity: The MIDI velocity, 0 to 127.
+// @return The entry to record into, or -1 if the note is already being
+// recorded or every entry is in use.
+int AttackCache::startRecording (int note, int velocity) noexcept
+{
+    const int key = note * 128 + velocity;
+    int oldest = -1;
+
+    for (int i = 0; i < numEntries; ++i)
+    {
+        if (entries[i].key == key)
+        {
+            return -1;
+        }
+
+        if (entries[i].numUsers == 0 && (oldest < 0 || entries[i].lastUsed < entries[oldest].lastUsed))
+        {
+            oldest = i;
+        }
+    }
+
+    if (oldest >= 0)
+    {
+        auto& entry = entries[oldest];
+        entry.key = key;
+        entry.complete = false;
+        entry.numUsers = 1;
+        entry.lastUsed = ++useCount;
+    }
+
+    return oldest;
+}
+
+// Completes a recording once all getLength() samples have been written,
+// unless the entry was forgotten while it was being recorded.
+//
+// @param entry: The entry startRecording returned.
+// @param snapshot: The voice's state after the last recorded sample.
+void AttackCache::finishRecording (int entry, const Snapshot& snapshot) noexcept
+{
+    if (entries[entry].key >= 0)
+    {
+        entries[entry].snapshot = snapshot;
+        entries[entry].complete = true;
+    }
+}
+
+// Lets go of an entry from acquire or startRecording. A recording that was
+// not finished, e.g. because its note was shorter than the cache, is dropped.
+//
+// @param entry: The entry to let go of.
+void AttackCache::release (int entry) noexcept
+{
+    jassert (entries[entry].numUsers > 0);
+    --entries[entry].numUsers;
+
+    if (! entries[entry].complete)
+    {
+        entries[entry].key = -1;
+    }
+}
@@ -0,0 +1,93 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the attack cache, which
+    memoises the opening samples of notes while the patch is unchanged.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "BasicOscillator.h"
+#include "FMOscillator.h"
+#include "LadderFilter.h"
+#include "StateVariableFilter.h"
+#include "SubOscillator.h"
+#include <JuceHeader.h>
+
+// While the patch is not changing, a note of a given key and velocity that
+// starts from silence always opens with the same samples. The first such
+// note records the first getLength() samples of its filtered oscillators,
+// before the envelope and gain, and the state of its oscillators and filters
+// at the end of them. Later notes of the same key and velocity copy those
+// samples instead of rendering them, restore the state, and carry on live
+// from exactly where the recording stopped, so there is no seam.
+//
+// The voice is mono until the envelope, so one channel is kept. Every entry
+// is forgotten when the patch version changes; an entry being streamed stays
+// readable until its voice lets go of it. Used only from the audio thread,
+// apart from prepare, which allocates.
+class AttackCache
+{
+public:
+    static constexpr int numEntries = 64;
+    static constexpr double lengthMs = 10.0;
+
+    struct Snapshot
+    {
+        BasicOscillator::State oscillator;
+        FMOscillator::State fm;
+        SubOscillator::State sub;
+        StateVariableFilter::State stateVariable;
+        LadderFilter::State ladder;
+    };
+
+    void prepare (double);
+    void clear() noexcept;
+    void setPatchVersion (juce::uint32) noexcept;
+
+    int getLength() const noexcept { return length; }
+
+    int acquire (int, int) noexcept;
+    int startRecording (int, int) noexcept;
+    void finishRecording (int, const Snapshot&) noexcept;
+    void release (int) noexcept;
+
+    float* getSamples (int entry) noexcept { return samples.getWritePointer (0, entry * length); }
+    const Snapshot& getSnapshot (int entry) const noexcept { return entries[entry].snapshot; }
+
+private:
+    struct Entry
+    {
+        int key = -1; // note * 128 + velocity, or -1 when empty or forgotten
+        bool complete = false;
+        int numUsers = 0;
+        juce::uint32 lastUsed = 0;
+        Snapshot snapshot;
+    };
+
+    Entry entries[numEntries];
+
+    // Entry n's samples start at n * length
+    juce::AudioBuffer<float> samples;
+    int length = 0;
+
+    juce::uint32 useCount = 0;
+    juce::uint32 patchVersion = 0;
+};
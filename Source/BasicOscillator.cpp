@@ -0,0 +1,60 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the oscillator
+    that plays the sine, square, saw and triangle waveforms from a shape
+    function of the phase.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "BasicOscillator.h"
+
+// Prepares the oscillator for playback.
+//
+// @param spec: The prep info of the owning voice.
+void BasicOscillator::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    sampleRate = spec.sampleRate;
+    frequency.reset (sampleRate, 0.05);
+    reset();
+}
+
+// Restarts the waveform at the start of its cycle with no pitch
+// modulation. The frequency is left where it is.
+void BasicOscillator::reset() noexcept
+{
+    phase = 0.0f;
+    pitchRatio.setCurrentAndTargetValue (1.0f);
+}
+
+// Sets the frequency, gliding to it unless forced.
+//
+// @param newFrequency: The frequency in Hz.
+// @param force: True to jump to the new frequency at once.
+void BasicOscillator::setFrequency (float newFrequency, bool force) noexcept
+{
+    if (force)
+    {
+        frequency.setCurrentAndTargetValue (newFrequency);
+    }
+    else
+    {
+        frequency.setTargetValue (newFrequency);
+    }
+}
@@ -0,0 +1,152 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the oscillator that
+    plays the sine, square, saw and triangle waveforms from a shape
+    function of the phase.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "FastMath.h"
+#include "RampedValue.h"
+#include <JuceHeader.h>
+
+// Plays a waveform given as a function of the phase, from -pi to pi, the
+// way juce::dsp::Oscillator does, with the frequency gliding to each new
+// value over 50 ms, and pitch modulation ramped on top of that, over
+// whatever length the voice asks. Unlike juce::dsp::Oscillator, its phase can be read and
+// set, so a voice can capture and restore where the oscillator is.
+//
+// The waveform is a template argument of process rather than a function
+// held by the oscillator, so it is inlined into the sample loop.
+class BasicOscillator
+{
+public:
+    // The classic waveforms. Each is branch free, so a loop calling it vectorises.
+    struct Sine
+    {
+        float operator() (float x) const noexcept { return FastMath::sin (x); }
+    };
+
+    struct Square
+    {
+        float operator() (float x) const noexcept { return x < 0.0f ? -1.0f : 1.0f; }
+    };
+
+    struct Saw
+    {
+        float operator() (float x) const noexcept { return x * (0.5f / juce::MathConstants<float>::pi); }
+    };
+
+    // 0 at -pi, -1 at -pi / 2, 1 at pi / 2 and 0 again at pi
+    struct Triangle
+    {
+        float operator() (float x) const noexcept
+        {
+            return std::copysign (1.0f - std::abs (std::abs (x) * (2.0f / juce::MathConstants<float>::pi) - 1.0f), x);
+        }
+    };
+
+    struct State
+    {
+        float phase = 0.0f;
+    };
+
+    void prepare (const juce::dsp::ProcessSpec&);
+    void reset() noexcept;
+    void setFrequency (float, bool force = false) noexcept;
+    void setPitchRatio (float ratio, int numSamples) noexcept { pitchRatio.rampTo (ratio, numSamples); }
+
+    template <typename Shape>
+    void process (const juce::dsp::ProcessContextReplacing<float>&) noexcept;
+
+    State getState() const noexcept { return { phase }; }
+    void setState (const State& state) noexcept { phase = state.phase; }
+
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        visit (phase);
+        frequency.visitState (visit);
+        pitchRatio.visitState (visit);
+    }
+
+private:
+    double sampleRate = 44100.0;
+    RampedValue frequency { 440.0f };
+    RampedValue pitchRatio { 1.0f };
+
+    float phase = 0.0f; // 0 to 2 pi
+};
+
+// Replaces every channel of a block with the waveform. While the frequency
+// is steady, each sample's phase is worked out from the phase at the start
+// of the block, so the loop carries nothing from one sample to the next and
+// vectorises. While it glides or its pitch modulation ramps, the phase is
+// accumulated sample by sample.
+//
+// @param context: The block to fill.
+template <typename Shape>
+void BasicOscillator::process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept
+{
+    auto& block = context.getOutputBlock();
+    const int numSamples = (int) block.getNumSamples();
+    auto* output = block.getChannelPointer (0);
+    const Shape shape;
+
+    const auto twoPi = juce::MathConstants<float>::twoPi;
+    const auto pi = juce::MathConstants<float>::pi;
+    const float radiansPerHz = (float) (twoPi / sampleRate);
+
+    if (frequency.isSmoothing() || pitchRatio.isSmoothing())
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            output[i] = shape (phase - pi);
+            phase += frequency.getNextValue() * pitchRatio.getNextValue() * radiansPerHz;
+
+            while (phase >= twoPi)
+            {
+                phase -= twoPi;
+            }
+        }
+    }
+    else
+    {
+        const float start = phase;
+        const float increment = frequency.getTargetValue() * pitchRatio.getTargetValue() * radiansPerHz;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float x = start + increment * (float) i;
+            x -= twoPi * (float) (int) (x * (1.0f / twoPi));
+            output[i] = shape (x - pi);
+        }
+
+        phase = start + increment * (float) numSamples;
+        phase -= twoPi * (float) (int) (phase * (1.0f / twoPi));
+    }
+
+    for (size_t channel = 1; channel < block.getNumChannels(); ++channel)
+    {
+        juce::FloatVectorOperations::copy (block.getChannelPointer (channel), output, numSamples);
+    }
+}
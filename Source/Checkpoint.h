@@ -0,0 +1,107 @@
+/*
+  ==============================================================================
+
+    This file contains the header and implementation information for the
+    writer and reader of checkpoints: snapshots of the engine's DSP state
+    that a render can be restored to and continued from exactly.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstring>
+#include <type_traits>
+
+// Every class with DSP state lists its members once, in a template
+//
+//     template <typename Visitor>
+//     void visitState (Visitor& visit) { visit (phase, frequency); }
+//
+// and the same list is used with a CheckpointWriter to append them to a
+// checkpoint and with a CheckpointReader to read them back, so the two can
+// never disagree about the layout. Visitor::isReading lets a class act on
+// a value once it has been read, such as re-pointing at shared data.
+//
+// Only scalars, enums, pointers and arrays of them are visited. None has
+// padding, so two checkpoints of the same state are the same bytes, and
+// checkpoints are compared with ==.
+class CheckpointWriter
+{
+public:
+    static constexpr bool isReading = false;
+
+    explicit CheckpointWriter (juce::MemoryBlock& destination) : block (destination) {}
+
+    template <typename... Values>
+    void operator() (Values&... values)
+    {
+        const int expand[] { 0, (write (values), 0)... };
+        juce::ignoreUnused (expand);
+    }
+
+private:
+    template <typename Value>
+    void write (const Value& value)
+    {
+        static_assert (std::is_trivially_copyable<Value>::value, "Checkpoints hold plain values only");
+        block.append (&value, sizeof (Value));
+    }
+
+    juce::MemoryBlock& block;
+};
+
+class CheckpointReader
+{
+public:
+    static constexpr bool isReading = true;
+
+    explicit CheckpointReader (const juce::MemoryBlock& source) : block (source) {}
+
+    template <typename... Values>
+    void operator() (Values&... values)
+    {
+        const int expand[] { 0, (read (values), 0)... };
+        juce::ignoreUnused (expand);
+    }
+
+    // Whether every byte was read, and no more: a checkpoint taken with a
+    // different number of voices, say, fails here
+    bool isComplete() const noexcept { return ! overrun && position == block.getSize(); }
+
+private:
+    template <typename Value>
+    void read (Value& value)
+    {
+        static_assert (std::is_trivially_copyable<Value>::value, "Checkpoints hold plain values only");
+
+        if (overrun || position + sizeof (Value) > block.getSize())
+        {
+            overrun = true;
+            return;
+        }
+
+        std::memcpy (&value, static_cast<const char*> (block.getData()) + position, sizeof (Value));
+        position += sizeof (Value);
+    }
+
+    const juce::MemoryBlock& block;
+    size_t position = 0;
+    bool overrun = false;
+};
@@ -0,0 +1,552 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for a zero-latency
+    convolution reverb using non-uniform partitioned FFT convolution. The
+    head of the impulse response is convolved on the audio thread; the long
+    tail is convolved in large partitions on a background thread.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "ConvolutionReverb.h"
+
+// Cuts taps [start, end) of an impulse response into partitions and stores
+// the spectrum of each.
+//
+// @param response: The impulse response of one channel.
+// @param length: The number of taps in response.
+// @param start: The first tap of the segment.
+// @param end: One past the last tap of the segment, clipped to length.
+// @param partitionSize: The number of taps per partition, a power of two.
+// @param result: Receives the partitioned segment.
+static void partitionResponse (const float* response, int length, int start, int end, int partitionSize, PartitionedResponse& result)
+{
+    end = juce::jmin (end, length);
+
+    result.partitionSize = partitionSize;
+    result.numPartitions = juce::jmax (0, (end - start + partitionSize - 1) / partitionSize);
+    result.spectra.assign ((size_t) (result.numPartitions * (partitionSize + 1)), {});
+
+    juce::dsp::FFT fft (juce::findHighestSetBit ((juce::uint32) (2 * partitionSize)));
+    std::vector<float> work ((size_t) (4 * partitionSize));
+
+    for (int partition = 0; partition < result.numPartitions; ++partition)
+    {
+        const int first = start + partition * partitionSize;
+        const int count = juce::jmin (partitionSize, end - first);
+
+        std::fill (work.begin(), work.end(), 0.0f);
+        std::copy (response + first, response + first + count, work.begin());
+        fft.performRealOnlyForwardTransform (work.data(), true);
+
+        auto* spectrum = reinterpret_cast<const std::complex<float>*> (work.data());
+        std::copy (spectrum, spectrum + partitionSize + 1, result.spectra.begin() + partition * (partitionSize + 1));
+    }
+}
+
+//==============================================================================
+
+// Allocates the buffers for one partition size.
+//
+// @param partitionSize: The block and partition length, a power of two.
+// @param maxNumPartitions: The most partitions any response will have.
+void UniformConvolver::prepare (int partitionSize, int maxNumPartitions)
+{
+    size = partitionSize;
+    maxPartitions = juce::jmax (1, maxNumPartitions);
+
+    fft = std::make_unique<juce::dsp::FFT> (juce::findHighestSetBit ((juce::uint32) (2 * size)));
+    window.assign ((size_t) (2 * size), 0.0f);
+    work.assign ((size_t) (4 * size), 0.0f);
+    delayLine.assign ((size_t) (maxPartitions * (size + 1)), {});
+
+    reset();
+}
+
+// Forgets all previous input.
+void UniformConvolver::reset() noexcept
+{
+    std::fill (window.begin(), window.end(), 0.0f);
+    std::fill (delayLine.begin(), delayLine.end(), std::complex<float>());
+    newest = 0;
+}
+
+// Convolves the next block of input. One forward FFT, one multiply-add per
+// partition and one inverse FFT, whatever the length of the response.
+//
+// @param input: partitionSize new input samples.
+// @param output: Receives partitionSize samples of the input convolved with
+// the segment, aligned so that output[0] lines up with input[0].
+// @param response: The segment to convolve with, partitioned to this size.
+void UniformConvolver::process (const float* input, float* output, const PartitionedResponse& response) noexcept
+{
+    const int numBins = size + 1;
+
+    std::copy (window.begin() + size, window.end(), window.begin());
+    std::copy (input, input + size, window.begin() + size);
+    std::copy (window.begin(), window.end(), work.begin());
+    std::fill (work.begin() + 2 * size, work.end(), 0.0f);
+    fft->performRealOnlyForwardTransform (work.data(), true);
+
+    // Partition p is paired with the spectrum from p blocks ago
+    newest = (newest + maxPartitions - 1) % maxPartitions;
+
+    auto* spectrum = reinterpret_cast<std::complex<float>*> (work.data());
+    std::copy (spectrum, spectrum + numBins, delayLine.begin() + newest * numBins);
+    std::fill (spectrum, spectrum + numBins, std::complex<float>());
+
+    const int numPartitions = juce::jmin (response.numPartitions, maxPartitions);
+
+    for (int partition = 0; partition < numPartitions; ++partition)
+    {
+        const auto* x = delayLine.data() + ((newest + partition) % maxPartitions) * numBins;
+        const auto* h = response.spectra.data() + partition * numBins;
+
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            spectrum[bin] += x[bin] * h[bin];
+        }
+    }
+
+    fft->performRealOnlyInverseTransform (work.data());
+
+    // Overlap-save: the second half is free of circular wrap-around
+    std::copy (work.begin() + size, work.begin() + 2 * size, output);
+}
+
+//==============================================================================
+
+ConvolutionReverb::~ConvolutionReverb()
+{
+    delete active;
+    delete pending.exchange (nullptr);
+    delete retired.exchange (nullptr);
+}
+
+// Allocates every buffer and clears all state. Any impulse response set
+// before this call is dropped and must be set again.
+//
+// @param spec: The bus format. At most ReverbKernel::maxChannels channels are processed.
+// @param maxSeconds: The longest impulse response that will be used.
+void ConvolutionReverb::prepare (const juce::dsp::ProcessSpec& spec, double maxSeconds)
+{
+    const juce::ScopedLock sl (tailLock);
+
+    numChannels = juce::jmin ((int) spec.numChannels, ReverbKernel::maxChannels);
+    maxImpulseLength = juce::jmax (2 * tailSize, (int) (maxSeconds * spec.sampleRate));
+
+    const int maxTailPartitions = (maxImpulseLength - tailSize) / tailSize;
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        directHistory[channel].assign (2 * headSize, 0.0f);
+        headInput[channel].assign (headSize, 0.0f);
+        headOutput[channel].assign (headSize, 0.0f);
+        headConvolver[channel].prepare (headSize, (2 * tailSize - headSize) / headSize);
+
+        tailInput[channel].assign (ringSize, 0.0f);
+        tailOutput[channel].assign (ringSize, 0.0f);
+        tailConvolver[channel].prepare (tailSize, maxTailPartitions);
+    }
+
+    tailScratch.assign (tailSize, 0.0f);
+    tailSilence.assign (tailSize, 0.0f);
+
+    position = 0;
+    headFill = 0;
+    directIndex = 0;
+    tailGeneration = generation;
+    tailPlayable = false;
+
+    std::fill (std::begin (blockInfo), std::end (blockInfo), BlockInfo());
+
+    for (auto& block : outputBlock)
+    {
+        block = -1;
+    }
+
+    blocksIssued = 0;
+    blocksDone = 0;
+    playPosition = 0;
+    lateBlocks = 0;
+
+    delete active;
+    active = nullptr;
+    delete pending.exchange (nullptr);
+    delete retired.exchange (nullptr);
+}
+
+// Chooses where the tail is rendered. Offline rendering runs faster than
+// real time, so the tail thread could fall behind; there the audio thread
+// renders each tail block itself as soon as it is complete.
+//
+// @param shouldRenderOnAudioThread: True when the host is rendering offline.
+void ConvolutionReverb::setSynchronousTail (bool shouldRenderOnAudioThread)
+{
+    const juce::ScopedLock sl (tailLock);
+    synchronousTail = shouldRenderOnAudioThread;
+}
+
+// Replaces the impulse response. The response is partitioned and transformed
+// on the calling thread, then swapped in by the audio thread at the start of
+// its next block. Must be called after prepare.
+//
+// @param response: The impulse response at the prepared sample rate. Mono
+// responses are used for every channel; longer ones are truncated.
+void ConvolutionReverb::setImpulseResponse (const juce::AudioBuffer<float>& response)
+{
+    setKernel (createKernel (response, numChannels, maxImpulseLength));
+}
+
+// Replaces the impulse response with an already built kernel, which is
+// swapped in by the audio thread at the start of its next block.
+//
+// @param kernel: A kernel from createKernel, for at least the prepared
+// number of channels.
+void ConvolutionReverb::setKernel (std::shared_ptr<const ReverbKernel> kernel)
+{
+    if (kernel == nullptr)
+    {
+        return;
+    }
+
+    jassert (kernel->numChannels >= numChannels);
+
+    delete pending.exchange (new KernelReference (std::move (kernel)));
+    releaseRetiredKernel();
+}
+
+// Builds a kernel: the direct taps and the head and tail partition spectra.
+//
+// @param response: The impulse response. Mono responses are used for every channel.
+// @param numChannels: The number of channels of the reverb that will play it.
+// @param maxLength: The longest response the reverb was prepared for;
+// longer ones are truncated.
+// @return The kernel.
+std::shared_ptr<const ReverbKernel> ConvolutionReverb::createKernel (const juce::AudioBuffer<float>& response, int numChannels, int maxLength)
+{
+    auto kernel = std::make_shared<ReverbKernel>();
+    kernel->numChannels = numChannels;
+
+    const int length = juce::jmin (response.getNumSamples(), maxLength);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        const auto* taps = response.getReadPointer (juce::jmin (channel, response.getNumChannels() - 1));
+
+        kernel->direct[channel].assign (headSize, 0.0f);
+
+        for (int i = 0; i < juce::jmin (headSize, length); ++i)
+        {
+            kernel->direct[channel][(size_t) (headSize - 1 - i)] = taps[i];
+        }
+
+        partitionResponse (taps, length, headSize, 2 * tailSize, headSize, kernel->head[channel]);
+        partitionResponse (taps, length, 2 * tailSize, length, tailSize, kernel->tail[channel]);
+    }
+
+    return kernel;
+}
+
+// Audio thread: swaps in a pending kernel, unless the previous swap's kernel
+// is still waiting to be released.
+void ConvolutionReverb::takePendingKernel() noexcept
+{
+    if (pending.load() == nullptr || retired.load() != nullptr)
+    {
+        return;
+    }
+
+    auto* next = pending.exchange (nullptr);
+
+    if (active != nullptr)
+    {
+        retiredAfter = blocksIssued.load();
+        retired = active;
+    }
+
+    active = next;
+    restart();
+}
+
+// Audio thread: drops the reverb's memory of previous input, so that nothing
+// played before the call is heard in the tail. Used when the reverb resumes
+// after being bypassed and when the impulse response changes. The tail
+// thread may be writing tailOutput, so it is not cleared: the new generation
+// stops the tail blocks issued before the call from being played.
+void ConvolutionReverb::restart() noexcept
+{
+    currentGeneration = ++generation;
+    tailPlayable = false;
+
+    const int partialBlock = (int) (position % tailSize);
+    const int partialStart = (int) ((position - partialBlock) % ringSize);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        std::fill (directHistory[channel].begin(), directHistory[channel].end(), 0.0f);
+        std::fill (headInput[channel].begin(), headInput[channel].end(), 0.0f);
+        std::fill (headOutput[channel].begin(), headOutput[channel].end(), 0.0f);
+        headConvolver[channel].reset();
+
+        std::fill (tailInput[channel].begin() + partialStart, tailInput[channel].begin() + partialStart + partialBlock, 0.0f);
+    }
+}
+
+// Audio thread: adds the reverberated signal to a block.
+//
+// @param block: The bus, processed in place.
+// @param wetLevel: The gain applied to the reverb before it is added.
+void ConvolutionReverb::process (juce::dsp::AudioBlock<float> block, float wetLevel) noexcept
+{
+    takePendingKernel();
+
+    if (active == nullptr)
+    {
+        return;
+    }
+
+    const int channels = juce::jmin (numChannels, (int) block.getNumChannels());
+    const int numSamples = (int) block.getNumSamples();
+
+    // Work in runs that end on head partition boundaries; tail boundaries
+    // fall on head boundaries too, since tailSize is a multiple of headSize
+    for (int done = 0; done < numSamples;)
+    {
+        const int run = juce::jmin (numSamples - done, headSize - headFill);
+        const int ringIndex = (int) (position % ringSize);
+
+        if (position % tailSize == 0)
+        {
+            startTailOutput();
+        }
+
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            auto* data = block.getChannelPointer ((size_t) channel) + done;
+            auto* history = directHistory[channel].data();
+            const auto* taps = (*active)->direct[channel].data();
+            const auto* head = headOutput[channel].data() + headFill;
+            auto* headIn = headInput[channel].data() + headFill;
+            auto* tailIn = tailInput[channel].data() + ringIndex;
+            const auto* tailOut = tailPlayable ? tailOutput[channel].data() + ringIndex : tailSilence.data() + ringIndex % tailSize;
+            int index = directIndex;
+
+            for (int i = 0; i < run; ++i)
+            {
+                const float x = data[i];
+
+                // The history is mirrored, so the last headSize inputs are
+                // always contiguous, oldest first, from index + 1
+                index = (index + 1) % headSize;
+                history[index] = x;
+                history[index + headSize] = x;
+
+                float wet = head[i] + tailOut[i];
+
+                for (int tap = 0; tap < headSize; ++tap)
+                {
+                    wet += taps[tap] * history[index + 1 + tap];
+                }
+
+                tailIn[i] = x;
+                headIn[i] = x;
+                data[i] = x + wetLevel * wet;
+            }
+        }
+
+        directIndex = (directIndex + run) % headSize;
+        headFill += run;
+        position += run;
+        done += run;
+
+        if (headFill == headSize)
+        {
+            headFill = 0;
+
+            for (int channel = 0; channel < channels; ++channel)
+            {
+                headConvolver[channel].process (headInput[channel].data(), headOutput[channel].data(), (*active)->head[channel]);
+            }
+
+            if (position % tailSize == 0)
+            {
+                const auto tailBlock = blocksIssued.load();
+                blockInfo[tailBlock % numBlockSlots] = { active->get(), generation };
+                blocksIssued = tailBlock + 1;
+
+                if (synchronousTail)
+                {
+                    renderTail();
+                }
+            }
+        }
+    }
+
+    playPosition = position;
+}
+
+// Audio thread: as playback reaches a tail block's slot of the output ring,
+// decides whether to play it. It is played if it holds the output of the
+// tail block due now, issued in the current generation; a block of this
+// generation that has not been written in time is counted as late.
+void ConvolutionReverb::startTailOutput() noexcept
+{
+    const auto due = position / tailSize - 2;
+    const bool isCurrent = due >= 0 && blockInfo[due % numBlockSlots].generation == generation;
+
+    tailPlayable = isCurrent && outputBlock[(due + 2) % numBlockSlots].load (std::memory_order_acquire) == due;
+
+    if (isCurrent && ! tailPlayable)
+    {
+        ++lateBlocks;
+    }
+}
+
+// Renders every issued tail block that has not been rendered yet, writing
+// each into the output ring two tail blocks after its input. A slot of the
+// ring is published in outputBlock once it is written, and is only written
+// while the audio thread cannot be playing it.
+void ConvolutionReverb::renderTail() noexcept
+{
+    const auto issued = blocksIssued.load();
+
+    for (auto tailBlock = blocksDone.load(); tailBlock < issued; ++tailBlock)
+    {
+        const auto& info = blockInfo[tailBlock % numBlockSlots];
+
+        if (info.generation != tailGeneration)
+        {
+            for (auto& convolver : tailConvolver)
+            {
+                convolver.reset();
+            }
+
+            tailGeneration = info.generation;
+        }
+
+        const int inputStart = (int) ((tailBlock * tailSize) % ringSize);
+        const auto outputStart = (tailBlock + 2) * tailSize;
+
+        // A block of an old generation, or one whose slot has started
+        // playing, is never played, so only the convolvers are advanced
+        const bool shouldWrite = info.generation == currentGeneration.load() && outputStart >= playPosition.load();
+        const int outputIndex = (int) (outputStart % ringSize);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const bool hasTail = info.kernel != nullptr && channel < info.kernel->numChannels && info.kernel->tail[channel].numPartitions > 0;
+
+            if (hasTail)
+            {
+                tailConvolver[channel].process (tailInput[channel].data() + inputStart, tailScratch.data(), info.kernel->tail[channel]);
+            }
+
+            if (shouldWrite)
+            {
+                auto* output = tailOutput[channel].data() + outputIndex;
+
+                if (hasTail)
+                {
+                    std::copy (tailScratch.begin(), tailScratch.end(), output);
+                }
+                else
+                {
+                    std::fill (output, output + tailSize, 0.0f);
+                }
+            }
+        }
+
+        if (shouldWrite)
+        {
+            outputBlock[(tailBlock + 2) % numBlockSlots].store (tailBlock, std::memory_order_release);
+        }
+
+        blocksDone = tailBlock + 1;
+    }
+}
+
+// Drops the reference to the kernel replaced by the last swap once no
+// unrendered tail block refers to it.
+void ConvolutionReverb::releaseRetiredKernel()
+{
+    if (retired.load() != nullptr && blocksDone.load() >= retiredAfter.load())
+    {
+        delete retired.exchange (nullptr);
+    }
+}
+
+// Tail thread: renders the tail blocks the audio thread has issued.
+//
+// @return The number of milliseconds to wait before the next call.
+int ConvolutionReverb::useTimeSlice()
+{
+    {
+        const juce::ScopedLock sl (tailLock);
+
+        if (! synchronousTail)
+        {
+            renderTail();
+        }
+    }
+
+    releaseRetiredKernel();
+
+    return blocksDone.load() < blocksIssued.load() ? 0 : 1;
+}
+
+// Generates a room-like impulse response: decorrelated noise per channel
+// under an exponential decay, with a short fade in, scaled to unit energy.
+//
+// @param sampleRate: The sample rate to generate at.
+// @param decaySeconds: The time taken to decay by 60 dB, which is also the length.
+// @param numChannels: The number of channels to generate.
+// @return The impulse response.
+juce::AudioBuffer<float> ConvolutionReverb::createRoomResponse (double sampleRate, float decaySeconds, int numChannels)
+{
+    const int length = juce::jmax (1, juce::roundToInt (decaySeconds * sampleRate));
+    const int fadeLength = juce::jmin (length, juce::roundToInt (0.005 * sampleRate));
+    const float decayPerSample = std::exp (-6.9078f / (float) length);
+
+    juce::AudioBuffer<float> response (numChannels, length);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        juce::Random random (channel + 1);
+        auto* taps = response.getWritePointer (channel);
+        float level = 1.0f;
+        double energy = 0.0;
+
+        for (int i = 0; i < length; ++i)
+        {
+            const float fade = i < fadeLength ? (float) i / (float) fadeLength : 1.0f;
+
+            taps[i] = (2.0f * random.nextFloat() - 1.0f) * level * fade;
+            level *= decayPerSample;
+            energy += taps[i] * taps[i];
+        }
+
+        if (energy > 0.0)
+        {
+            juce::FloatVectorOperations::multiply (taps, (float) (1.0 / std::sqrt (energy)), length);
+        }
+    }
+
+    return response;
+}
@@ -0,0 +1,176 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for a zero-latency convolution
+    reverb using non-uniform partitioned FFT convolution. The head of the
+    impulse response is convolved on the audio thread; the long tail is
+    convolved in large partitions on a background thread.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <complex>
+
+// One segment of an impulse response cut into equal partitions, each stored
+// as the spectrum of the partition zero padded to twice its length
+struct PartitionedResponse
+{
+    int partitionSize = 0;
+    int numPartitions = 0;
+    std::vector<std::complex<float>> spectra; // numPartitions * (partitionSize + 1)
+};
+
+// An impulse response prepared for ConvolutionReverb. Immutable once built,
+// so one kernel can be shared by every reverb playing the same response.
+struct ReverbKernel
+{
+    static constexpr int maxChannels = 2;
+
+    int numChannels = 0;
+    std::vector<float> direct[maxChannels]; // first taps, time reversed
+    PartitionedResponse head[maxChannels];
+    PartitionedResponse tail[maxChannels];
+};
+
+// Uniformly partitioned overlap-save convolution of one channel with one
+// PartitionedResponse, using a frequency-domain delay line.
+class UniformConvolver
+{
+public:
+    void prepare (int, int);
+    void reset() noexcept;
+    void process (const float*, float*, const PartitionedResponse&) noexcept;
+
+private:
+    int size = 0;
+    int maxPartitions = 0;
+    int newest = 0;
+
+    std::unique_ptr<juce::dsp::FFT> fft;
+    std::vector<float> window; // the previous and current input blocks
+    std::vector<float> work; // FFT buffer
+    std::vector<std::complex<float>> delayLine; // maxPartitions input spectra
+};
+
+// Convolves the bus with an impulse response without added latency.
+//
+// The response is split three ways:
+//   taps [0, headSize)              direct FIR, every sample
+//   taps [headSize, 2 * tailSize)   partitions of headSize, audio thread
+//   taps [2 * tailSize, end)        partitions of tailSize, background thread
+//
+// A tail block is handed over as soon as its tailSize input samples are
+// complete and is not needed until tailSize samples later, so the background
+// thread always has one tail partition of time to compute it.
+class ConvolutionReverb : public juce::TimeSliceClient
+{
+public:
+    static constexpr int headSize = 64;
+    static constexpr int tailSize = 1024;
+
+    ConvolutionReverb() = default;
+    ~ConvolutionReverb() override;
+
+    void prepare (const juce::dsp::ProcessSpec&, double);
+    void setSynchronousTail (bool);
+    void setImpulseResponse (const juce::AudioBuffer<float>&);
+    void setKernel (std::shared_ptr<const ReverbKernel>);
+    void process (juce::dsp::AudioBlock<float>, float) noexcept;
+    void restart() noexcept;
+
+    int useTimeSlice() override;
+
+    int getNumLateBlocks() const noexcept { return lateBlocks.load(); }
+    int getNumChannels() const noexcept { return numChannels; }
+    int getMaxImpulseLength() const noexcept { return maxImpulseLength; }
+
+    static juce::AudioBuffer<float> createRoomResponse (double, float, int);
+    static std::shared_ptr<const ReverbKernel> createKernel (const juce::AudioBuffer<float>&, int, int);
+
+private:
+    static constexpr int ringSize = 4 * tailSize;
+    static constexpr int numBlockSlots = ringSize / tailSize;
+
+    void takePendingKernel() noexcept;
+    void startTailOutput() noexcept;
+    void renderTail() noexcept;
+    void releaseRetiredKernel();
+
+    int numChannels = 0;
+    int maxImpulseLength = 0;
+    bool synchronousTail = false;
+
+    // This reverb's reference to a kernel, which other reverbs may share
+    using KernelReference = std::shared_ptr<const ReverbKernel>;
+
+    // Audio thread state
+    KernelReference* active = nullptr;
+    juce::int64 position = 0;
+    int headFill = 0;
+    int directIndex = 0;
+    juce::uint32 generation = 0;
+    bool tailPlayable = false; // whether the tail output now playing is this generation's
+    std::vector<float> directHistory[ReverbKernel::maxChannels]; // 2 * headSize, mirrored
+    std::vector<float> headInput[ReverbKernel::maxChannels];
+    std::vector<float> headOutput[ReverbKernel::maxChannels];
+    UniformConvolver headConvolver[ReverbKernel::maxChannels];
+
+    // Shared with the tail thread. The audio thread writes tailInput and
+    // reads tailOutput; the tail thread does the reverse. Each tailSize slot
+    // of tailOutput is handed over by storing the number of the tail block
+    // written into it in outputBlock, and the audio thread plays it only if
+    // that block was issued in the current generation.
+    std::vector<float> tailInput[ReverbKernel::maxChannels];
+    std::vector<float> tailOutput[ReverbKernel::maxChannels];
+    std::vector<float> tailSilence; // tailSize zeros, played in place of a slot that is not playable
+
+    // The kernel and generation each issued tail block was recorded with
+    struct BlockInfo
+    {
+        const ReverbKernel* kernel = nullptr;
+        juce::uint32 generation = 0;
+    };
+
+    BlockInfo blockInfo[numBlockSlots];
+    std::atomic<juce::int64> outputBlock[numBlockSlots] {};
+    std::atomic<juce::int64> blocksIssued { 0 };
+    std::atomic<juce::int64> blocksDone { 0 };
+    std::atomic<juce::int64> playPosition { 0 };
+    std::atomic<juce::uint32> currentGeneration { 0 };
+    std::atomic<int> lateBlocks { 0 };
+
+    // Tail thread state
+    juce::uint32 tailGeneration = 0;
+    std::vector<float> tailScratch;
+    UniformConvolver tailConvolver[ReverbKernel::maxChannels];
+
+    // Held by the tail thread while rendering and by prepare, never by the audio thread
+    juce::CriticalSection tailLock;
+
+    // Kernel hand-over. A new kernel waits in pending until the audio thread
+    // takes it; the kernel it replaces waits in retired until every tail
+    // block issued with it has been rendered.
+    std::atomic<KernelReference*> pending { nullptr };
+    std::atomic<KernelReference*> retired { nullptr };
+    std::atomic<juce::int64> retiredAfter { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (ConvolutionReverb)
+};
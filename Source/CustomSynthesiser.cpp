@@ -0,0 +1,198 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for a JUCE
+    Synthesiser whose note allocation can be checkpointed.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "CustomSynthesiser.h"
+#include <algorithm>
+
+// Notes a sustain pedal moving before passing it on.
+//
+// @param midiChannel: The channel, 1 to 16.
+// @param isDown: Whether the pedal went down or up.
+void CustomSynthesiser::handleSustainPedal (int midiChannel, bool isDown)
+{
+    if (midiChannel >= 1 && midiChannel <= 16)
+    {
+        sustainPedalDown[midiChannel - 1] = isDown;
+    }
+
+    juce::Synthesiser::handleSustainPedal (midiChannel, isDown);
+}
+
+// juce::Synthesiser lets every sustain pedal go with all notes off, on any channel.
+//
+// @param midiChannel: The channel, or 0 for all of them.
+// @param allowTailOff: Whether the voices release or stop at once.
+void CustomSynthesiser::allNotesOff (int midiChannel, bool allowTailOff)
+{
+    std::fill (std::begin (sustainPedalDown), std::end (sustainPedalDown), false);
+    juce::Synthesiser::allNotesOff (midiChannel, allowTailOff);
+}
+
+// Picks the voice for a new note: a free one while fewer voices than the cap
+// are sounding, and a playing one to steal once the cap is reached. Voices
+// fading out for the processor do not count towards the cap.
+//
+// @param sound: The sound to play.
+// @param midiChannel: The note's channel.
+// @param midiNoteNumber: The note.
+// @param stealIfNoneAvailable: Whether a playing voice may be taken.
+// @return The voice, or nullptr to drop the note.
+juce::SynthesiserVoice* CustomSynthesiser::findFreeVoice (juce::SynthesiserSound* sound, int midiChannel, int midiNoteNumber, bool stealIfNoneAvailable) const
+{
+    int numSounding = 0;
+
+    for (auto* voice : voices)
+    {
+        if (voice->isVoiceActive() && ! dynamic_cast<CustomVoice*> (voice)->isBeingStolen())
+        {
+            ++numSounding;
+        }
+    }
+
+    if (numSounding < maxSounding)
+    {
+        return juce::Synthesiser::findFreeVoice (sound, midiChannel, midiNoteNumber, stealIfNoneAvailable);
+    }
+
+    return stealIfNoneAvailable ? findVoiceToSteal (sound, midiChannel, midiNoteNumber) : nullptr;
+}
+
+// Picks a playing voice for a note to take over. juce::Synthesiser's choice
+// assumes every voice is playing, which the cap breaks, so this one looks
+// only at the playing voices: one already fading out for the processor
+// first, then the oldest whose key is up, then the oldest.
+//
+// @param sound: The sound to play.
+// @return The voice, or nullptr if none is playing the sound.
+juce::SynthesiserVoice* CustomSynthesiser::findVoiceToSteal (juce::SynthesiserSound* sound, int, int) const
+{
+    juce::SynthesiserVoice* chosen = nullptr;
+    int chosenRank = 0;
+
+    for (auto* voice : voices)
+    {
+        if (! voice->isVoiceActive() || ! voice->canPlaySound (sound))
+        {
+            continue;
+        }
+
+        const int rank = dynamic_cast<CustomVoice*> (voice)->isBeingStolen() ? 0 : voice->isKeyDown() ? 2 : 1;
+
+        if (chosen == nullptr || rank < chosenRank || (rank == chosenRank && voice->wasStartedBefore (*chosen)))
+        {
+            chosen = voice;
+            chosenRank = rank;
+        }
+    }
+
+    return chosen;
+}
+
+// @param index: The voice.
+// @return What the voice is playing, for a checkpoint.
+CustomSynthesiser::VoiceNote CustomSynthesiser::describeVoice (int index) const
+{
+    VoiceNote description;
+    const auto* voice = voices[index];
+
+    if (! voice->isVoiceActive())
+    {
+        return description;
+    }
+
+    description.note = voice->getCurrentlyPlayingNote();
+    description.keyDown = voice->isKeyDown();
+    description.sustainDown = voice->isSustainPedalDown();
+    description.sostenutoDown = voice->isSostenutoPedalDown();
+
+    for (int channel = 1; channel <= 16; ++channel)
+    {
+        if (voice->isPlayingChannel (channel))
+        {
+            description.channel = channel;
+        }
+    }
+
+    for (const auto* other : voices)
+    {
+        if (other->isVoiceActive() && other->wasStartedBefore (*voice))
+        {
+            ++description.order;
+        }
+    }
+
+    return description;
+}
+
+// Gives every voice the note of a checkpoint, starting them in the order
+// they started in originally, so stealing picks the same voices. The
+// voices' own state is read straight after and replaces whatever starting
+// the notes did to it.
+//
+// @param notes: The allocation read from the checkpoint.
+void CustomSynthesiser::assignVoices (const std::vector<VoiceNote>& notes)
+{
+    const juce::ScopedLock sl (lock);
+
+    for (int channel = 1; channel <= 16; ++channel)
+    {
+        juce::Synthesiser::handleSustainPedal (channel, sustainPedalDown[channel - 1]);
+    }
+
+    for (auto* voice : voices)
+    {
+        if (voice->getCurrentlyPlayingSound() != nullptr)
+        {
+            stopVoice (voice, 0.0f, false);
+        }
+    }
+
+    if (sounds.isEmpty())
+    {
+        return;
+    }
+
+    std::vector<int> playing;
+
+    for (int i = 0; i < (int) notes.size() && i < voices.size(); ++i)
+    {
+        if (notes[(size_t) i].note >= 0)
+        {
+            playing.push_back (i);
+        }
+    }
+
+    std::sort (playing.begin(), playing.end(), [&notes] (int a, int b) { return notes[(size_t) a].order < notes[(size_t) b].order; });
+
+    for (const int i : playing)
+    {
+        const auto& note = notes[(size_t) i];
+        auto* voice = voices[i];
+
+        startVoice (voice, sounds.getUnchecked (0).get(), note.channel, note.note, 1.0f);
+        voice->setKeyDown (note.keyDown);
+        voice->setSustainPedalDown (note.sustainDown);
+        voice->setSostenutoPedalDown (note.sostenutoDown);
+    }
+}
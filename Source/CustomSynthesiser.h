@@ -0,0 +1,101 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for a JUCE Synthesiser
+    whose note allocation can be checkpointed.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "CustomVoice.h"
+#include <JuceHeader.h>
+#include <vector>
+
+// juce::Synthesiser keeps which voice plays which note, and the sustain
+// pedals, to itself. This one follows the pedals as they pass through, and
+// lists the allocation for a checkpoint ahead of the voices' own state: the
+// note, channel and keys of each voice, and the order the voices started
+// in, which decides which is stolen next.
+//
+// It also caps how many voices notes may sound at once, below the number it
+// owns, for the processor's adaptive quality: a note over the cap takes a
+// playing voice instead of a free one.
+class CustomSynthesiser : public juce::Synthesiser
+{
+public:
+    void handleSustainPedal (int, bool) override;
+    void allNotesOff (int, bool) override;
+    void setMaxVoices (int maxVoices) noexcept { maxSounding = maxVoices; }
+
+    template <typename Visitor>
+    void visitState (Visitor&);
+
+protected:
+    juce::SynthesiserVoice* findFreeVoice (juce::SynthesiserSound*, int, int, bool) const override;
+    juce::SynthesiserVoice* findVoiceToSteal (juce::SynthesiserSound*, int, int) const override;
+
+private:
+    struct VoiceNote
+    {
+        int note = -1; // -1 for a free voice
+        int channel = 0;
+        int order = 0; // how many of the playing voices started before this one
+        bool keyDown = false;
+        bool sustainDown = false;
+        bool sostenutoDown = false;
+    };
+
+    VoiceNote describeVoice (int) const;
+    void assignVoices (const std::vector<VoiceNote>&);
+
+    bool sustainPedalDown[16] {};
+    int maxSounding = 128;
+};
+
+// @param visit: A CheckpointWriter or CheckpointReader.
+template <typename Visitor>
+void CustomSynthesiser::visitState (Visitor& visit)
+{
+    visit (lastPitchWheelValues, sustainPedalDown);
+
+    std::vector<VoiceNote> notes ((size_t) voices.size());
+
+    for (int i = 0; i < voices.size(); ++i)
+    {
+        auto& note = notes[(size_t) i];
+
+        if (! Visitor::isReading)
+        {
+            note = describeVoice (i);
+        }
+
+        visit (note.note, note.channel, note.order, note.keyDown, note.sustainDown, note.sostenutoDown);
+    }
+
+    if (Visitor::isReading)
+    {
+        assignVoices (notes);
+    }
+
+    for (auto* voice : voices)
+    {
+        dynamic_cast<CustomVoice*> (voice)->visitState (visit);
+    }
+}
@@ -23,6 +23,7 @@
 */
 
 #include "CustomVoice.h"
+#include "LowLatencyMode.h"
 
 // Indicates if this voice object is capable of playing the given sound.
 //
@@ -39,10 +40,52 @@ bool CustomVoice::canPlaySound (juce::SynthesiserSound* sound)
 // @param velocity: A value indicating how quickly the note was released 0 (slow) to 1 (fast).
 // @param sound: The SynthesiserSound associated with this voice.
 // @param currentPitchWheelPosition: What the pitch wheel position should be for this note.
-void CustomVoice::startNote (int midiNoteNumber, float, juce::SynthesiserSound*, int)
+void CustomVoice::startNote (int midiNoteNumber, float velocity, juce::SynthesiserSound*, int)
 {
-    osc->setFrequency ((float) juce::MidiMessage::getMidiNoteInHertz (midiNoteNumber));
+    if (flightRecorder != nullptr)
+    {
+        flightRecorder->recordVoiceStart (voiceIndex, midiNoteNumber, velocity, envelope.isActive());
+    }
+
+    finishAttack();
+
+    const double frequency = juce::MidiMessage::getMidiNoteInHertz (midiNoteNumber);
+    const bool fromSilence = ! envelope.isActive();
+
+    // A retriggered note glides from the one it cuts off
+    if (fromSilence)
+    {
+        resetSources ((float) frequency);
+    }
+
+    if (wave == sampleWave)
+    {
+        sampleOsc.noteOn (midiNoteNumber, velocity, frequency);
+    }
+    else if (wave == granularWave)
+    {
+        granularOsc.noteOn (midiNoteNumber, velocity, (float) frequency);
+    }
+    else
+    {
+        setOscillatorFrequency ((float) frequency);
+    }
+
+    noteFrequency = frequency;
+    modState.velocity = velocity;
+    modState.keyTrack = (float) (midiNoteNumber - 60) / 60.0f;
+    modState.lfoPhase[0] = modState.lfoPhase[1] = 0.0;
+    modGainFactor = 1.0f;
+    beingStolen = false;
+
+    // Only a note from silence opens the same way every time
+    if (attackCache != nullptr && fromSilence && isDeterministic (modulation != nullptr ? modulation->get() : nullptr))
+    {
+        startAttack (midiNoteNumber, velocity);
+    }
+
     envelope.noteOn();
+    modEnvelope.noteOn();
 }
 
 // Stops a playing note. Typically called automatically during the rendering callback.
@@ -52,6 +95,7 @@ void CustomVoice::startNote (int midiNoteNumber, float, juce::SynthesiserSound*,
 void CustomVoice::stopNote (float, bool allowTailOff)
 {
     envelope.noteOff();
+    modEnvelope.noteOff();
 
     if (! allowTailOff)
     {
@@ -76,40 +120,44 @@ void CustomVoice::prepareToPlay (double sampleRate, int samplesPerBlock, int num
 
     sampleRateHolder = sampleRate;
 
+    // Allocate the render buffer at its largest size and touch every page so
+    // renderNextBlock never allocates or page faults on the audio thread
+    synthBuffer.setSize (numOutputChannels, samplesPerBlock);
+    LowLatencyMode::prefaultBuffer (synthBuffer);
+
+    modBuffer.setSize (CompiledModMatrix::numScratchChannels, samplesPerBlock);
+    LowLatencyMode::prefaultBuffer (modBuffer);
+    modState.sampleRate = sampleRate;
+    modState.envelope = &modEnvelope;
+    stealFadeLength = juce::jmax (1, juce::roundToInt (stealFadeSeconds * sampleRate));
+
+    // The processor's mapping forgets its controller values too
+    std::fill (std::begin (isMapped), std::end (isMapped), false);
+    applyMappedSources();
+
     juce::ADSR::Parameters initADSR {
         0.1f, 0.1f, 0.1f, 0.1f
     };
 
     SVFilter.reset();
     SVFilter.prepare (spec);
+    ladder.prepare (spec);
     setFilter (1, 20000.0, 2.0);
 
     envelope.setSampleRate (sampleRate);
     envelope.setParameters (initADSR);
+    modEnvelope.setSampleRate (sampleRate);
+    modEnvelope.setParameters (initADSR);
 
-    sineOsc.prepare (spec);
-    sqOsc.prepare (spec);
-    sawOsc.prepare (spec);
-    triOsc.prepare (spec);
+    // Only the selected oscillator now; the rest when they are first selected
+    oscillatorSpec = spec;
+    preparedWaves = 0;
+    setWave (wave);
 
-    if (wave == 1)
-    {
-        osc = &sineOsc;
-    }
-    else if (wave == 2)
-    {
-        osc = &sqOsc;
-    }
-    else if (wave == 3)
-    {
-        osc = &sawOsc;
-    }
-    else
-    {
-        osc = &triOsc;
-    }
+    // The processor has just prepared the cache, which forgets its users
+    attackMode = AttackMode::live;
+    attackEntry = -1;
 
-    gain.prepare (spec);
     setGain (-25.0);
 }
 
@@ -124,12 +172,15 @@ void CustomVoice::setADSR (juce::ADSR::Parameters parameters)
 }
 
 // Changes the active oscillator the voice is using between sine, square,
-// saw, and triangle.
+// saw, triangle, sample playback, the custom wavetable, FM, and granular.
 //
-// @param waveformNum: An integer representation for sine, square, saw, and triangle
-// waveforms.
+// @param waveformNum: An integer representation for sine, square, saw, triangle,
+// sample playback, custom wavetable, FM, and granular waveforms.
 void CustomVoice::setWave (int waveformNum)
 {
+    // Ready the new oscillator before the audio thread can switch to it
+    prepareOscillator (waveformNum);
+
     // set wave value
     wave = waveformNum;
     if (wave == 1)
@@ -144,17 +195,255 @@ void CustomVoice::setWave (int waveformNum)
     {
         osc = &sawOsc;
     }
+    else if (wave == sampleWave || wave == customWave || wave == fmWave || wave == granularWave)
+    {
+        // Rendered by sampleOsc, tableOsc, fmOsc or granularOsc, osc is left as it was
+    }
     else
     {
         osc = &triOsc;
     }
 }
 
+// Prepares the oscillator a waveform uses, unless it is already prepared or
+// the voice has not been prepared yet.
+//
+// @param waveformNum: The waveform whose oscillator is needed.
+void CustomVoice::prepareOscillator (int waveformNum)
+{
+    const int bit = 1 << juce::jlimit (0, 30, waveformNum);
+
+    if (oscillatorSpec.sampleRate <= 0.0 || (preparedWaves & bit) != 0)
+    {
+        return;
+    }
+
+    if (waveformNum == 1)
+    {
+        sineOsc.prepare (oscillatorSpec);
+    }
+    else if (waveformNum == 2)
+    {
+        sqOsc.prepare (oscillatorSpec);
+    }
+    else if (waveformNum == 3)
+    {
+        sawOsc.prepare (oscillatorSpec);
+    }
+    else if (waveformNum == sampleWave)
+    {
+        sampleOsc.prepare (oscillatorSpec);
+    }
+    else if (waveformNum == customWave)
+    {
+        tableOsc.prepare (oscillatorSpec);
+    }
+    else if (waveformNum == fmWave)
+    {
+        fmOsc.prepare (oscillatorSpec);
+    }
+    else if (waveformNum == granularWave)
+    {
+        granularOsc.prepare (oscillatorSpec);
+    }
+    else
+    {
+        triOsc.prepare (oscillatorSpec);
+    }
+
+    preparedWaves |= bit;
+}
+
+// Connects the voice's sample playback oscillator to the processor's samples.
+//
+// @param samples: The sample map published by the processor.
+// @param playhead: This voice's slot in the processor's sample streamer.
+void CustomVoice::setSampleSource (RcuPointer<SampleMap>* samples, SampleOscillator::Playhead* playhead)
+{
+    sampleOsc.setSource (samples, playhead);
+    granularOsc.setSampleSource (samples);
+}
+
+// Connects the voice's wavetable oscillator to the processor's custom wavetable.
+//
+// @param wavetable: The wavetable published by the processor.
+void CustomVoice::setWavetableSource (RcuPointer<Wavetable>* wavetable)
+{
+    tableOsc.setSource (wavetable);
+    granularOsc.setWavetableSource (wavetable);
+}
+
+// Connects the voice to the processor's compiled modulation matrix.
+//
+// @param matrix: The modulation routing published by the processor.
+// @param midiControllers: The processor's latest value (0 to 1) of each of the 128 MIDI CCs.
+void CustomVoice::setModulation (RcuPointer<CompiledModMatrix>* matrix, const float* midiControllers)
+{
+    modulation = matrix;
+    modState.midiControllers = midiControllers;
+}
+
+// Sets the attack, decay, sustain, release values of the modulation envelope.
+//
+// @param parameters: The envelope settings.
+void CustomVoice::setModEnvelope (juce::ADSR::Parameters parameters)
+{
+    modEnvelope.setParameters (parameters);
+}
+
+// Sets how often the modulation matrix is evaluated and the filter and
+// oscillator settings are recalculated.
+//
+// @param samplesPerTick: The control interval in samples, e.g. 16, 32 or 64.
+void CustomVoice::setControlInterval (int samplesPerTick)
+{
+    controlInterval = juce::jlimit (1, maxChunkSize, samplesPerTick);
+}
+
+// Trades accuracy for speed when the processor is short of CPU time: the
+// control interval is quadrupled and the ladder filter runs without saturation.
+//
+// @param shouldReduce: True for the cheaper rendering.
+void CustomVoice::setReducedQuality (bool shouldReduce)
+{
+    reducedQuality = shouldReduce;
+    ladder.setSaturation (! shouldReduce);
+}
+
+// Sets the level of the square wave sub-oscillator, which follows the main
+// oscillator one or two octaves down. It counts the main oscillator's zero
+// crossings, which only the basic waveforms make once per cycle, so it is
+// silent for the sample, custom, FM and granular waveforms.
+//
+// @param level: The sub-oscillator's amplitude, 0 (off) to 1.
+// @param octaves: 1 or 2 octaves below the main oscillator.
+void CustomVoice::setSubOscillator (float level, int octaves)
+{
+    subLevel = juce::jlimit (0.0f, 1.0f, level);
+    subOctaves = juce::jlimit (1, 2, octaves);
+}
+
+// Sets the level and colour of the noise source.
+//
+// @param level: The noise amplitude, 0 (off) to 1.
+// @param colour: White or pink noise.
+void CustomVoice::setNoise (float level, NoiseGenerator::Colour colour)
+{
+    noiseLevel = juce::jlimit (0.0f, 1.0f, level);
+    noiseColour = colour;
+}
+
+// Sets the modulator of the FM waveform.
+//
+// @param ratio: The modulator frequency as a multiple of the note's, 0.25 to 16.
+// @param index: The modulation index, the peak phase deviation in radians, 0 to 10.
+// @param mode: Whether the modulator drives the carrier's phase or its frequency.
+void CustomVoice::setFM (float ratio, float index, FMOscillator::Mode mode)
+{
+    fmOsc.setParameters (ratio, index, mode);
+    fmRatio = fmOsc.getRatio();
+    fmIndex = fmOsc.getIndex();
+    fmMode = mode;
+}
+
+// Sets how the granular waveform spawns its grains.
+//
+// @param parameters: The grains' position, pitch, density, size, spray and source.
+void CustomVoice::setGranular (const GranularOscillator::Parameters& parameters)
+{
+    granularOsc.setParameters (parameters);
+    granular = granularOsc.getParameters();
+}
+
+// Connects the voice to the processor's attack cache. Call before playback.
+//
+// @param cache: The cache, or nullptr to render every note live.
+void CustomVoice::setAttackCache (AttackCache* cache)
+{
+    attackCache = cache;
+    attackMode = AttackMode::live;
+    attackEntry = -1;
+}
+
+// Connects the voice to the processor's flight recorder.
+//
+// @param recorder: The recorder, or nullptr to record nothing.
+// @param index: The voice's index, to tell the voices apart in a dump.
+void CustomVoice::setFlightRecorder (FlightRecorder* recorder, int index)
+{
+    flightRecorder = recorder;
+    voiceIndex = index;
+}
+
+// Fades the playing note out over the next few milliseconds and frees the
+// voice, for the processor to shed polyphony without clicks.
+void CustomVoice::steal()
+{
+    if (isVoiceActive() && ! beingStolen)
+    {
+        if (flightRecorder != nullptr)
+        {
+            flightRecorder->recordVoiceSteal (voiceIndex, getCurrentlyPlayingNote());
+        }
+
+        beingStolen = true;
+        stealFadeRemaining = stealFadeLength;
+    }
+}
+
+// Sets a parameter from a hardware controller mapped to it, in place of the
+// patch's setting, until it is cleared. The filter and gain take it at the
+// next block, and the FM and granular oscillators at once.
+//
+// @param parameter: The mapped parameter.
+// @param value: Its value in the units of its setter; decibels for the volume.
+void CustomVoice::setMappedParameter (MidiMapping::Parameter parameter, double value) noexcept
+{
+    const int index = (int) parameter;
+    isMapped[index] = true;
+    mappedValue[index] = parameter == MidiMapping::Parameter::volume ? juce::Decibels::decibelsToGain ((float) value) : (float) value;
+
+    if (parameter >= MidiMapping::Parameter::fmRatio)
+    {
+        applyMappedSources();
+    }
+}
+
+// Puts a parameter back to the patch's setting once no controller is mapped to it.
+//
+// @param parameter: The parameter that was mapped.
+void CustomVoice::clearMappedParameter (MidiMapping::Parameter parameter) noexcept
+{
+    isMapped[(int) parameter] = false;
+
+    if (parameter >= MidiMapping::Parameter::fmRatio)
+    {
+        applyMappedSources();
+    }
+}
+
+// Sets the FM and granular oscillators from the patch's settings, with any
+// mapped controller values in their place. Repeated every block while one
+// is mapped, so the editor changing the patch cannot undo them.
+void CustomVoice::applyMappedSources() noexcept
+{
+    using Parameter = MidiMapping::Parameter;
+
+    fmOsc.setParameters (getSetting (Parameter::fmRatio, fmRatio), getSetting (Parameter::fmIndex, fmIndex), fmMode);
+
+    auto mapped = granular;
+    mapped.position = getSetting (Parameter::grainPosition, granular.position);
+    mapped.pitch = getSetting (Parameter::grainPitch, granular.pitch);
+    mapped.density = getSetting (Parameter::grainDensity, granular.density);
+    mapped.spray = getSetting (Parameter::grainSpray, granular.spray);
+    granularOsc.setParameters (mapped);
+}
+
 // Sets the filter type, cutoff frequency, and resonance setting for the state
-// variable filter data member.
+// variable filter data member, or selects and sets the ladder filter.
 //
 // @param filterNum: An integer representation of the filter type to be set low pass,
-// band pass, high pass.
+// band pass, high pass, ladder.
 // @param cutoff: The cutoff frequency for the state variable filter in Hz.
 // @param resonance: The amount of resonance to be applied by the state variable filter
 void CustomVoice::setFilter (int filterNum, double cutoff, double resonance)
@@ -162,6 +451,15 @@ void CustomVoice::setFilter (int filterNum, double cutoff, double resonance)
     float resonance_converted = static_cast<float> (resonance);
     float cutoff_converted = static_cast<float> (cutoff);
 
+    // Kept unmodulated so the modulation matrix can offset from them
+    filterCutoff = cutoff_converted;
+    filterResonance = resonance_converted;
+
+    if (filterNum >= 1 && filterNum <= ladderFilter)
+    {
+        filterType = filterNum;
+    }
+
     if (filterNum == 1)
     {
         SVFilter.state->type = juce::dsp::StateVariableFilter::Parameters<float>::Type::lowPass;
@@ -182,14 +480,19 @@ void CustomVoice::setFilter (int filterNum, double cutoff, double resonance)
 
         SVFilter.state->setCutOffFrequency (sampleRateHolder, cutoff_converted, resonance_converted);
     }
+
+    else if (filterNum == ladderFilter)
+    {
+        ladder.setParameters (cutoff_converted, resonance_converted);
+    }
 }
 
-// Calls the setGainDecibels method on the gain data member. Self-explanatory.
+// Sets the voice's output gain, which is applied along with the envelope.
 //
 // @param gainVal: the decibel value to be set.
 void CustomVoice::setGain (double gainVal)
 {
-    gain.setGainDecibels ((float) gainVal);
+    gainFactor = juce::Decibels::decibelsToGain ((float) gainVal);
 }
 
 // Produces/processes a block of audio samples into the output stream of the plug-in
@@ -203,32 +506,523 @@ void CustomVoice::renderNextBlock (juce::AudioBuffer<float>& outputBuffer, int s
     // Code structure adapted from tapSynth code by The Audio Programmer
     // https://github.com/TheAudioProgrammer/tapSynth/blob/main/Source/SynthVoice.cpp
 
-    // Initialize subset buffer
+    // A sample note cut off by a change of waveform lets go of its zone, so
+    // the streamer stops reading it before the sample map is replaced
+    if (wave != sampleWave && sampleOsc.isPlaying())
+    {
+        sampleOsc.stop();
+    }
+
+    // A voice with no note and nothing left of its release adds nothing.
+    // Its sources and filters are not run: they start afresh with its next note.
+    if (! isVoiceActive() && ! envelope.isActive())
+    {
+        return;
+    }
+
+    // Mapped FM and grain settings win over any change the editor made since
+    for (int i = (int) MidiMapping::Parameter::fmRatio; i < MidiMapping::numParameters; ++i)
+    {
+        if (isMapped[i])
+        {
+            applyMappedSources();
+            break;
+        }
+    }
+
+    // Initialize subset buffer. It is not cleared: the sources replace
+    // every sample they render
     synthBuffer.setSize (outputBuffer.getNumChannels(), numSamples, false, false, true);
-    synthBuffer.clear();
 
     // Alias to chunk of audio buffer
     juce::dsp::AudioBlock<float> audioBlock { synthBuffer };
 
-    // ProcessContextReplacing will fill audioBlock with processed data
-    osc->process (juce::dsp::ProcessContextReplacing<float> (audioBlock));
-    SVFilter.process (juce::dsp::ProcessContextReplacing<float> (audioBlock));
-    gain.process (juce::dsp::ProcessContextReplacing<float> (audioBlock));
+    auto* matrix = modulation != nullptr ? modulation->get() : nullptr;
+    const int interval = reducedQuality ? juce::jmin (maxChunkSize, 4 * controlInterval) : controlInterval;
+
+    if (matrix != nullptr && matrix->isEmpty())
+    {
+        matrix = nullptr;
+    }
+
+    if (matrix == nullptr)
+    {
+        applyModulation (nullptr, 0, numSamples);
+    }
+    else
+    {
+        // Control rate: modulation is evaluated and the filter and oscillator
+        // settings are recalculated once per tick of controlInterval samples,
+        // while the oscillator and filter themselves still run every sample
+        modBuffer.setSize (CompiledModMatrix::numScratchChannels, numSamples, false, false, true);
+        matrix->process (modState, modBuffer, numSamples, interval);
+    }
+
+    // The block is rendered a chunk at a time, one control tick or, without
+    // modulation, up to maxChunkSize samples, and each chunk is mixed into
+    // the output while it is still in cache
+    const int chunkSize = matrix != nullptr ? interval : maxChunkSize;
+    const float* gainMod = matrix != nullptr && matrix->modulates (ModDestination::gain) ? modBuffer.getReadPointer ((int) ModDestination::gain) : nullptr;
+    const float gain = getSetting (MidiMapping::Parameter::volume, gainFactor);
+    const float fadeStep = beingStolen ? 1.0f / (float) stealFadeLength : 0.0f;
+    float fade = beingStolen ? (float) stealFadeRemaining / (float) stealFadeLength : 1.0f;
+    float peak = 0.0f;
+
+    alignas (16) float gainCurve[maxChunkSize];
+
+    for (int tick = 0, start = 0; start < numSamples; ++tick, start += chunkSize)
+    {
+        const int length = juce::jmin (chunkSize, numSamples - start);
+
+        if (matrix != nullptr)
+        {
+            applyModulation (matrix, tick, length);
+        }
+
+        renderChunk (audioBlock.getSubBlock ((size_t) start, (size_t) length));
 
-    // Apply ADSR to entire subset buffer
-    envelope.applyEnvelopeToBuffer (synthBuffer, 0, synthBuffer.getNumSamples());
+        // Gain, envelope, gain modulation and the steal fade are folded into
+        // one multiplier per sample. Gain modulation, as a factor of
+        // max(0, 1 + m), is ramped linearly between control ticks
+        const float modGainTarget = gainMod != nullptr ? juce::jmax (0.0f, 1.0f + gainMod[tick]) : 1.0f;
+        const float modGainStep = (modGainTarget - modGainFactor) / (float) length;
+
+        for (int i = 0; i < length; ++i)
+        {
+            gainCurve[i] = envelope.getNextSample() * gain * (modGainFactor + modGainStep * (float) i) * fade;
+            fade = juce::jmax (0.0f, fade - fadeStep);
+        }
+
+        modGainFactor = modGainTarget;
+        peak = juce::jmax (peak, mixInto (outputBuffer, startSample + start, start, length, gainCurve));
+    }
+
+    level = peak;
+
+    if (beingStolen)
+    {
+        stealFadeRemaining = juce::jmax (0, stealFadeRemaining - numSamples);
+    }
+
+    if (! envelope.isActive() || (beingStolen && stealFadeRemaining == 0))
+    {
+        finishNote();
+    }
+}
+
+// Applies a gain curve to part of synthBuffer and adds it to the output, in
+// one pass over each channel.
+//
+// @param outputBuffer: The buffer the voice is rendering into.
+// @param outputStart: The first output sample to add to.
+// @param start: The first sample of synthBuffer to mix.
+// @param length: The number of samples, at most maxChunkSize.
+// @param gainCurve: The multiplier for each sample.
+// @return The peak absolute level of the mixed samples.
+float CustomVoice::mixInto (juce::AudioBuffer<float>& outputBuffer, int outputStart, int start, int length, const float* gainCurve) noexcept
+{
+    float peak = 0.0f;
 
-    // Add all samples from subset buffer back to output
     for (int channel = 0; channel < outputBuffer.getNumChannels(); ++channel)
     {
-        outputBuffer.addFrom (channel, startSample, synthBuffer, channel, 0, numSamples, 1.0f);
+        auto* samples = synthBuffer.getWritePointer (channel, start);
+        auto* output = outputBuffer.getWritePointer (channel, outputStart);
+
+        for (int i = 0; i < length; ++i)
+        {
+            samples[i] *= gainCurve[i];
+            output[i] += samples[i];
+        }
+
+        // Read back while the chunk is still in cache
+        const auto range = juce::FloatVectorOperations::findMinAndMax (samples, length);
+        peak = juce::jmax (peak, -range.getStart(), range.getEnd());
+    }
+
+    return peak;
+}
+
+// Renders part of synthBuffer like renderSources, except that the opening
+// of a note is streamed from the attack cache, or recorded into it, when
+// startAttack found or claimed an entry. At the end of a streamed opening the
+// recorded state is restored, and the rest of the chunk renders live.
+//
+// @param block: The samples to render.
+void CustomVoice::renderChunk (juce::dsp::AudioBlock<float> block)
+{
+    if (attackMode == AttackMode::live)
+    {
+        renderSources (block);
+        return;
+    }
+
+    const int length = (int) block.getNumSamples();
+    const int count = juce::jmin (length, attackCache->getLength() - attackPosition);
+    auto* cached = attackCache->getSamples (attackEntry) + attackPosition;
+
+    if (attackMode == AttackMode::recording)
+    {
+        renderSources (block.getSubBlock (0, (size_t) count));
+        juce::FloatVectorOperations::copy (cached, block.getChannelPointer (0), count);
+    }
+    else
+    {
+        for (size_t channel = 0; channel < block.getNumChannels(); ++channel)
+        {
+            juce::FloatVectorOperations::copy (block.getChannelPointer (channel), cached, count);
+        }
+    }
+
+    attackPosition += count;
+
+    if (attackPosition == attackCache->getLength())
+    {
+        if (attackMode == AttackMode::recording)
+        {
+            attackCache->finishRecording (attackEntry, captureState());
+        }
+        else
+        {
+            restoreState (attackCache->getSnapshot (attackEntry));
+        }
+
+        finishAttack();
+    }
+
+    if (count < length)
+    {
+        renderSources (block.getSubBlock ((size_t) count));
+    }
+}
+
+// Runs the active oscillator, the sub-oscillator and noise, and the active
+// filter over part of synthBuffer, through the render path for the current
+// waveform and filter type.
+//
+// @param block: The samples to render, replaced with the filtered oscillator output.
+void CustomVoice::renderSources (juce::dsp::AudioBlock<float> block)
+{
+    // Any waveform number without an oscillator of its own plays the triangle
+    const int waveIndex = wave >= 1 && wave <= granularWave ? wave - 1 : 3;
+
+    (this->*renderPaths[waveIndex][filterType - 1]) (block);
+}
+
+// Renders part of synthBuffer with the waveform and filter type fixed at
+// compile time. The tests on them are resolved by the compiler, leaving the
+// oscillator's shape and the filter's output type inlined into their loops.
+//
+// @param block: The samples to render, replaced with the filtered oscillator output.
+template <int waveform, int filter>
+void CustomVoice::renderPath (juce::dsp::AudioBlock<float>& block) noexcept
+{
+    // ProcessContextReplacing will fill block with processed data
+    const juce::dsp::ProcessContextReplacing<float> context (block);
+
+    if (waveform == 1)
+    {
+        sineOsc.process<BasicOscillator::Sine> (context);
+    }
+    else if (waveform == 2)
+    {
+        sqOsc.process<BasicOscillator::Square> (context);
+    }
+    else if (waveform == 3)
+    {
+        sawOsc.process<BasicOscillator::Saw> (context);
+    }
+    else if (waveform == sampleWave)
+    {
+        sampleOsc.process (context);
+    }
+    else if (waveform == customWave)
+    {
+        tableOsc.process (context);
+    }
+    else if (waveform == fmWave)
+    {
+        fmOsc.process (context);
+    }
+    else if (waveform == granularWave)
+    {
+        granularOsc.process (context);
+    }
+    else
+    {
+        triOsc.process<BasicOscillator::Triangle> (context);
+    }
+
+    const float sub = getSetting (MidiMapping::Parameter::subLevel, subLevel);
+    const float noiseAmount = getSetting (MidiMapping::Parameter::noiseLevel, noiseLevel);
+
+    // The sub-oscillator reads the main oscillator, so it goes in first. It
+    // divides zero crossings, so only follows the basic waveforms' pitch.
+    if (waveform <= 4 && sub > 0.0f)
+    {
+        subOsc.addTo (block, sub, subOctaves);
+    }
+
+    if (noiseAmount > 0.0f)
+    {
+        noise.addTo (block, noiseAmount, noiseColour);
+    }
+
+    if (filter == ladderFilter)
+    {
+        ladder.process (context);
+    }
+    else
+    {
+        SVFilter.process<filter == 1 ? StateVariableFilter::Parameters::Type::lowPass
+                                     : filter == 2 ? StateVariableFilter::Parameters::Type::bandPass
+                                                   : StateVariableFilter::Parameters::Type::highPass> (context);
+    }
+}
+
+// One render path per waveform (rows: sine, square, saw, triangle, sample,
+// custom, FM, granular) and filter type (columns: low pass, band pass, high
+// pass, ladder)
+const CustomVoice::RenderPath CustomVoice::renderPaths[granularWave][ladderFilter] = {
+    { &CustomVoice::renderPath<1, 1>, &CustomVoice::renderPath<1, 2>, &CustomVoice::renderPath<1, 3>, &CustomVoice::renderPath<1, 4> },
+    { &CustomVoice::renderPath<2, 1>, &CustomVoice::renderPath<2, 2>, &CustomVoice::renderPath<2, 3>, &CustomVoice::renderPath<2, 4> },
+    { &CustomVoice::renderPath<3, 1>, &CustomVoice::renderPath<3, 2>, &CustomVoice::renderPath<3, 3>, &CustomVoice::renderPath<3, 4> },
+    { &CustomVoice::renderPath<4, 1>, &CustomVoice::renderPath<4, 2>, &CustomVoice::renderPath<4, 3>, &CustomVoice::renderPath<4, 4> },
+    { &CustomVoice::renderPath<5, 1>, &CustomVoice::renderPath<5, 2>, &CustomVoice::renderPath<5, 3>, &CustomVoice::renderPath<5, 4> },
+    { &CustomVoice::renderPath<6, 1>, &CustomVoice::renderPath<6, 2>, &CustomVoice::renderPath<6, 3>, &CustomVoice::renderPath<6, 4> },
+    { &CustomVoice::renderPath<7, 1>, &CustomVoice::renderPath<7, 2>, &CustomVoice::renderPath<7, 3>, &CustomVoice::renderPath<7, 4> },
+    { &CustomVoice::renderPath<8, 1>, &CustomVoice::renderPath<8, 2>, &CustomVoice::renderPath<8, 3>, &CustomVoice::renderPath<8, 4> }
+};
+
+// Applies the control-rate destinations of the modulation matrix for one
+// tick. The matrix gives each destination's value at the end of the tick,
+// so the filter's coefficients and the oscillator's pitch ramp linearly to
+// it over exactly the tick's samples, the pitch apart from the oscillator's
+// glide between notes, rather than stepping at its start. Restores the
+// unmodulated settings once a destination stops being modulated. Mapped
+// controller values replace the patch's cutoff and resonance as the
+// settings the modulation offsets.
+//
+// @param matrix: The compiled matrix that filled modBuffer, or nullptr.
+// @param tick: The control tick whose values should be applied.
+// @param length: The number of samples in the tick.
+void CustomVoice::applyModulation (const CompiledModMatrix* matrix, int tick, int length)
+{
+    const bool modulatesFilter = matrix != nullptr && (matrix->modulates (ModDestination::cutoff) || matrix->modulates (ModDestination::resonance));
+    const bool filterMapped = isMapped[(int) MidiMapping::Parameter::cutoff] || isMapped[(int) MidiMapping::Parameter::resonance];
+
+    if (modulatesFilter || filterWasModulated || filterMapped)
+    {
+        const float cutoffMod = modulatesFilter && matrix->modulates (ModDestination::cutoff) ? modBuffer.getSample ((int) ModDestination::cutoff, tick) : 0.0f;
+        const float resonanceMod = modulatesFilter && matrix->modulates (ModDestination::resonance) ? modBuffer.getSample ((int) ModDestination::resonance, tick) : 0.0f;
 
-        if (! envelope.isActive())
+        const float baseCutoff = getSetting (MidiMapping::Parameter::cutoff, filterCutoff);
+        const float baseResonance = getSetting (MidiMapping::Parameter::resonance, filterResonance);
+        const float cutoff = juce::jlimit (20.0f, (float) sampleRateHolder * 0.45f, baseCutoff * std::exp2 (5.0f * cutoffMod));
+        const float resonance = juce::jlimit (0.5f, 10.0f, baseResonance + 4.0f * resonanceMod);
+
+        if (filterType == ladderFilter)
+        {
+            ladder.rampTo (cutoff, resonance, length);
+        }
+        else
         {
-            clearCurrentNote();
-            envelope.reset();
+            SVFilter.state->setCutOffFrequency (sampleRateHolder, cutoff, resonance);
+            SVFilter.rampToState (length);
         }
     }
+
+    const bool modulatesPitch = matrix != nullptr && matrix->modulates (ModDestination::pitch);
+
+    if ((modulatesPitch || pitchWasModulated) && wave != sampleWave)
+    {
+        const float pitchMod = modulatesPitch ? modBuffer.getSample ((int) ModDestination::pitch, tick) : 0.0f;
+        setOscillatorPitchRatio (std::exp2 (pitchMod), length);
+    }
+
+    filterWasModulated = modulatesFilter || filterMapped;
+    pitchWasModulated = modulatesPitch;
+}
+
+// Indicates if a note played from silence would always open the same way:
+// no sample playback, whose streaming position varies, no custom wavetable,
+// which may be rebuilt at any time, nor granular, which plays it or the
+// samples, no noise, and no modulation from MIDI CCs. Pitch modulation is
+// ruled out too, as the oscillators' frequency glides are not part of the
+// cache's snapshot, and so are mapped controllers, bar the volume, which is
+// applied after the cache.
+//
+// @param matrix: The compiled matrix the note would be rendered with, or nullptr.
+// @return True if the note's opening can be cached.
+bool CustomVoice::isDeterministic (const CompiledModMatrix* matrix) const noexcept
+{
+    if (wave == sampleWave || wave == customWave || wave == granularWave || noiseLevel > 0.0f)
+    {
+        return false;
+    }
+
+    for (int i = 1; i < MidiMapping::numParameters; ++i)
+    {
+        if (isMapped[i] && i != (int) MidiMapping::Parameter::volume)
+        {
+            return false;
+        }
+    }
+
+    return matrix == nullptr || matrix->isEmpty() || ! (matrix->modulates (ModDestination::pitch) || matrix->readsMidiControllers());
+}
+
+// Starts the sources and filters of a note from silence afresh: every
+// oscillator at the start of its cycle at the note's pitch, with no glide
+// from the last note, the filters cleared and back at the patch's settings,
+// and the mod envelope at rest. The voice is silent, so none of this can be
+// heard, and a note from silence opens the same way whatever the voice
+// played before, which the attack cache and checkpoints rely on.
+//
+// @param frequency: The note's pitch in Hz.
+void CustomVoice::resetSources (float frequency)
+{
+    for (auto* basic : { &sineOsc, &sqOsc, &sawOsc, &triOsc })
+    {
+        basic->setFrequency (frequency, true);
+        basic->reset();
+    }
+
+    tableOsc.reset (frequency);
+    fmOsc.setFrequency (frequency);
+    fmOsc.reset();
+    granularOsc.setFrequency (frequency);
+    granularOsc.reset();
+    subOsc.reset();
+    noise.reset();
+
+    setFilter (filterType, filterCutoff, filterResonance);
+    filterWasModulated = false;
+    pitchWasModulated = false;
+    SVFilter.reset();
+    ladder.reset();
+    modEnvelope.reset();
+}
+
+// Frees the voice once its note has faded out or been stolen, with both
+// envelopes and the pink noise filter at rest.
+void CustomVoice::finishNote()
+{
+    clearCurrentNote();
+    envelope.reset();
+    modEnvelope.reset();
+    noise.reset();
+    sampleOsc.stop();
+    finishAttack();
+    beingStolen = false;
+    level = 0.0f;
+}
+
+// Looks a note from silence up in the attack cache, streaming it if it has
+// been recorded and recording it if not. resetSources has already put the
+// voice in the state a cached opening starts from.
+//
+// @param midiNoteNumber: The note being started.
+// @param velocity: Its velocity, 0 to 1.
+void CustomVoice::startAttack (int midiNoteNumber, float velocity)
+{
+    const int velocityStep = juce::roundToInt (velocity * 127.0f);
+    attackEntry = attackCache->acquire (midiNoteNumber, velocityStep);
+    attackMode = AttackMode::streaming;
+
+    if (attackEntry < 0)
+    {
+        attackEntry = attackCache->startRecording (midiNoteNumber, velocityStep);
+        attackMode = attackEntry >= 0 ? AttackMode::recording : AttackMode::live;
+    }
+
+    attackPosition = 0;
+}
+
+// Lets go of the attack cache entry the note was using, if any, and renders
+// live from here on.
+void CustomVoice::finishAttack() noexcept
+{
+    if (attackEntry >= 0)
+    {
+        attackCache->release (attackEntry);
+    }
+
+    attackEntry = -1;
+    attackMode = AttackMode::live;
+}
+
+// @return The state of every oscillator and filter, for the attack cache.
+AttackCache::Snapshot CustomVoice::captureState() const noexcept
+{
+    AttackCache::Snapshot snapshot;
+    snapshot.oscillator = osc->getState();
+    snapshot.fm = fmOsc.getState();
+    snapshot.sub = subOsc.getState();
+    snapshot.stateVariable = SVFilter.getState();
+    snapshot.ladder = ladder.getState();
+    return snapshot;
+}
+
+// Puts every oscillator and filter back where captureState found them. Their
+// frequencies and coefficients are left as they are.
+//
+// @param snapshot: The state to restore.
+void CustomVoice::restoreState (const AttackCache::Snapshot& snapshot) noexcept
+{
+    osc->setState (snapshot.oscillator);
+    fmOsc.setState (snapshot.fm);
+    subOsc.setState (snapshot.sub);
+    SVFilter.setState (snapshot.stateVariable);
+    ladder.setState (snapshot.ladder);
+}
+
+// Ramps the pitch modulation of whichever pitched oscillator the current
+// waveform uses, on top of its frequency. Granular grains take their pitch
+// as they start, so the granular oscillator is simply retuned.
+//
+// @param ratio: The modulated frequency as a multiple of the note's.
+// @param numSamples: The samples to ramp over.
+void CustomVoice::setOscillatorPitchRatio (float ratio, int numSamples)
+{
+    if (wave == customWave)
+    {
+        tableOsc.setPitchRatio (ratio, numSamples);
+    }
+    else if (wave == fmWave)
+    {
+        fmOsc.setPitchRatio (ratio, numSamples);
+    }
+    else if (wave == granularWave)
+    {
+        granularOsc.setFrequency ((float) noteFrequency * ratio);
+    }
+    else
+    {
+        osc->setPitchRatio (ratio, numSamples);
+    }
+}
+
+// Sets the frequency of whichever pitched oscillator the current waveform uses.
+//
+// @param frequency: The frequency in Hz.
+void CustomVoice::setOscillatorFrequency (float frequency)
+{
+    if (wave == customWave)
+    {
+        tableOsc.setFrequency (frequency);
+    }
+    else if (wave == fmWave)
+    {
+        fmOsc.setFrequency (frequency);
+    }
+    else if (wave == granularWave)
+    {
+        granularOsc.setFrequency (frequency);
+    }
+    else
+    {
+        osc->setFrequency (frequency);
+    }
 }
 
 // Runs a set of unit-style tests related to methods changing DSP
@@ -245,6 +1039,13 @@ void CustomVoice::voiceTests()
     jassert (SVFilter.state->type == juce::dsp::StateVariableFilter::Parameters<float>::Type::bandPass);
     setFilter (3, cutoff, resonance);
     jassert (SVFilter.state->type == juce::dsp::StateVariableFilter::Parameters<float>::Type::highPass);
+    setFilter (ladderFilter, 1000.0, 5.0);
+    jassert (filterType == ladderFilter);
+    jassert (ladder.getCutoff() == 1000.0f);
+    jassert (ladder.getFeedback() == 3.95f);
+    jassert (SVFilter.state->type == juce::dsp::StateVariableFilter::Parameters<float>::Type::highPass);
+    jassert (std::abs (FastMath::tanh (0.5f) - std::tanh (0.5f)) < 1.0e-4f);
+    jassert (FastMath::tanh (100.0f) <= 1.0f);
 
     // Test oscillators
     setWave (2);
@@ -253,6 +1054,246 @@ void CustomVoice::voiceTests()
     jassert (osc == &sawOsc);
     setWave (4);
     jassert (osc == &triOsc);
+    setWave (sampleWave);
+    jassert (osc == &triOsc);
+    setWave (customWave);
+    jassert (osc == &triOsc);
+    setWave (fmWave);
+    jassert (osc == &triOsc);
+    setWave (granularWave);
+    jassert (osc == &triOsc);
+
+    // Test the fast sine and FM: with a zero index the FM oscillator is a
+    // plain sine, and the parameters are kept in range
+    jassert (std::abs (FastMath::sin (1.0f) - std::sin (1.0f)) < 1.0e-6f);
+    jassert (std::abs (FastMath::sin (-20.0f) - std::sin (-20.0f)) < 1.0e-6f);
+    jassert (std::abs (FastMath::sin (juce::MathConstants<float>::halfPi)) <= 1.0f);
+
+    float fmTest[64] {};
+    float* fmChannels[] = { fmTest };
+    FMOscillator testFM;
+    testFM.prepare ({ 48000.0, 64, 1 });
+    testFM.setParameters (2.0f, 0.0f, FMOscillator::Mode::phase);
+    testFM.setFrequency (3000.0f);
+    testFM.reset();
+    juce::dsp::AudioBlock<float> fmBlock (fmChannels, 1, 64);
+    testFM.process (juce::dsp::ProcessContextReplacing<float> (fmBlock));
+    jassert (fmTest[0] == 0.0f && std::abs (fmTest[4] - 1.0f) < 1.0e-3f);
+    testFM.setParameters (100.0f, -1.0f, FMOscillator::Mode::frequency);
+    jassert (testFM.getRatio() == 16.0f && testFM.getIndex() == 0.0f);
+
+    // Test the oscillator's state: at a quarter of the sample rate the sine
+    // steps a quarter cycle per sample, and a restored state repeats itself
+    float oscTest[8] {};
+    float* oscChannels[] = { oscTest };
+    juce::dsp::AudioBlock<float> oscBlock (oscChannels, 1, 8);
+    auto oscFirst = oscBlock.getSubBlock (0, 4);
+    auto oscSecond = oscBlock.getSubBlock (4);
+    BasicOscillator testOsc;
+    testOsc.prepare ({ 48000.0, 8, 1 });
+    testOsc.setFrequency (12000.0f, true);
+    testOsc.setState ({ juce::MathConstants<float>::halfPi });
+    const auto oscState = testOsc.getState();
+    testOsc.process<BasicOscillator::Sine> (juce::dsp::ProcessContextReplacing<float> (oscFirst));
+    jassert (std::abs (oscTest[0] + 1.0f) < 1.0e-4f && std::abs (oscTest[2] - 1.0f) < 1.0e-4f);
+    testOsc.setState (oscState);
+    testOsc.process<BasicOscillator::Sine> (juce::dsp::ProcessContextReplacing<float> (oscSecond));
+    jassert (oscTest[4] == oscTest[0] && oscTest[7] == oscTest[3]);
+
+    // Test waveforms: the branch-free triangle has its corners in place
+    const BasicOscillator::Triangle triangle;
+    const auto pi = juce::MathConstants<float>::pi;
+    jassert (std::abs (triangle (-pi)) < 1.0e-6f && std::abs (triangle (-pi / 2) + 1.0f) < 1.0e-6f);
+    jassert (std::abs (triangle (pi / 4) - 0.5f) < 1.0e-6f && std::abs (triangle (pi)) < 1.0e-6f);
+
+    // Test render paths: the path renderSources picks for a waveform and
+    // filter type renders what that oscillator and filter do run in turn
+    for (const int pathFilter : { 2, ladderFilter })
+    {
+        CustomVoice pathVoice, referenceVoice;
+
+        for (auto* voice : { &pathVoice, &referenceVoice })
+        {
+            voice->prepareToPlay (48000.0, 64, 1);
+            voice->setWave (pathFilter == ladderFilter ? 2 : 3);
+            voice->setFilter (pathFilter, 800.0, 3.0);
+            voice->resetSources (440.0f);
+        }
+
+        float pathTest[64] {};
+        float referenceTest[64] {};
+        float* pathChannels[] = { pathTest };
+        float* referenceChannels[] = { referenceTest };
+        pathVoice.renderSources (juce::dsp::AudioBlock<float> (pathChannels, 1, 64));
+
+        juce::dsp::AudioBlock<float> referenceBlock (referenceChannels, 1, 64);
+        const juce::dsp::ProcessContextReplacing<float> referenceContext (referenceBlock);
+
+        if (pathFilter == ladderFilter)
+        {
+            referenceVoice.sqOsc.process<BasicOscillator::Square> (referenceContext);
+            referenceVoice.ladder.process (referenceContext);
+        }
+        else
+        {
+            referenceVoice.sawOsc.process<BasicOscillator::Saw> (referenceContext);
+            referenceVoice.SVFilter.process<StateVariableFilter::Parameters::Type::bandPass> (referenceContext);
+        }
+
+        float pathPeak = 0.0f;
+
+        for (const float sample : pathTest)
+        {
+            pathPeak = juce::jmax (pathPeak, std::abs (sample));
+        }
+
+        jassert (pathPeak > 0.0f && std::equal (std::begin (pathTest), std::end (pathTest), std::begin (referenceTest)));
+    }
+
+    // Test the attack cache: a note is recorded once, can be streamed once
+    // the recording is finished, and is forgotten when the patch changes
+    AttackCache testCache;
+    testCache.prepare (48000.0);
+    jassert (testCache.getLength() == 480);
+    const int recording = testCache.startRecording (60, 100);
+    jassert (recording >= 0 && testCache.acquire (60, 100) < 0 && testCache.startRecording (60, 100) < 0);
+    testCache.finishRecording (recording, {});
+    testCache.release (recording);
+    jassert (testCache.acquire (60, 100) == recording);
+    testCache.release (recording);
+    testCache.setPatchVersion (1);
+    jassert (testCache.acquire (60, 100) < 0);
+
+    // Test wavetables: a single harmonic is a unit sine at every level, and
+    // levels drop harmonics as the note rises
+    auto sineTable = Wavetable::fromHarmonicAmplitudes ({ 1.0f });
+    jassert (std::abs (sineTable->getLevel (0)[Wavetable::tableSize / 4] - 1.0f) < 1.0e-4f);
+    jassert (std::abs (sineTable->getLevel (Wavetable::numLevels - 1)[Wavetable::tableSize / 4] - 1.0f) < 1.0e-4f);
+    jassert (Wavetable::getLevelForFrequency (20.0f, 48000.0) == 0);
+    jassert (Wavetable::getLevelForFrequency (440.0f, 48000.0) == 4);
+    jassert (Wavetable::getLevelForFrequency (20000.0f, 48000.0) == Wavetable::numLevels - 1);
+
+    // Test modulation compilation
+    const float lfoRates[] = { 1.0f, 2.0f };
+    auto matrix = CompiledModMatrix::compile ({ { ModSource::lfo1, ModDestination::cutoff, 0.5f },
+                                                { ModSource::velocity, ModDestination::gain, 0.0f } },
+                                              lfoRates);
+    jassert (! matrix->isEmpty());
+    jassert (matrix->modulates (ModDestination::cutoff));
+    jassert (! matrix->modulates (ModDestination::gain));
+
+    // Test the mod envelope as a source: a prepared voice routes it through
+    // the matrix, and it rises from zero once the note starts
+    CustomVoice envelopeVoice;
+    envelopeVoice.prepareToPlay (48000.0, 64, 2);
+    jassert (envelopeVoice.modState.envelope == &envelopeVoice.modEnvelope);
+
+    auto envelopeMatrix = CompiledModMatrix::compile ({ { ModSource::envelope, ModDestination::cutoff, 1.0f } }, lfoRates);
+    jassert (envelopeMatrix->modulates (ModDestination::cutoff));
+
+    envelopeVoice.modEnvelope.noteOn();
+    envelopeMatrix->process (envelopeVoice.modState, envelopeVoice.modBuffer, 64, 16);
+    const auto* envelopeTicks = envelopeVoice.modBuffer.getReadPointer ((int) ModDestination::cutoff);
+    jassert (envelopeTicks[0] > 0.0f && envelopeTicks[3] > envelopeTicks[0] && envelopeTicks[3] <= 1.0f);
+
+    // Test control-rate ramps: modulation moves the pitch and the filter
+    // linearly over exactly the tick it is given
+    RampedValue testRamp { 1.0f };
+    testRamp.rampTo (2.0f, 4);
+    jassert (testRamp.skip (2) == 1.5f && testRamp.skip (2) == 2.0f && ! testRamp.isSmoothing());
+
+    float rampSamples[32] {};
+    float* rampChannels[] = { rampSamples };
+    juce::dsp::AudioBlock<float> rampBlock (rampChannels, 1, 32);
+    auto firstHalf = rampBlock.getSubBlock (0, 16);
+    auto secondHalf = rampBlock.getSubBlock (16, 16);
+    LadderFilter testLadder;
+    testLadder.prepare ({ 48000.0, 32, 1 });
+    testLadder.setParameters (1000.0f, 1.0f);
+    testLadder.rampTo (1000.0f, 3.0f, 32);
+    testLadder.process (juce::dsp::ProcessContextReplacing<float> (firstHalf));
+    jassert (std::abs (testLadder.getFeedback() - 1.0f) < 1.0e-5f);
+    testLadder.process (juce::dsp::ProcessContextReplacing<float> (secondHalf));
+    jassert (testLadder.getFeedback() == 2.0f);
+
+    StateVariableFilter testFilter;
+    testFilter.prepare ({ 48000.0, 32, 1 });
+    testFilter.state->setCutOffFrequency (48000.0, 1000.0f, 1.0f);
+    testFilter.reset();
+    const float startG = testFilter.state->g;
+    testFilter.state->setCutOffFrequency (48000.0, 4000.0f, 1.0f);
+    testFilter.rampToState (32);
+    testFilter.process<StateVariableFilter::Parameters::Type::lowPass> (juce::dsp::ProcessContextReplacing<float> (firstHalf));
+    jassert (std::abs (testFilter.getState().current.g - 0.5f * (startG + testFilter.state->g)) < 1.0e-5f);
+    testFilter.process<StateVariableFilter::Parameters::Type::lowPass> (juce::dsp::ProcessContextReplacing<float> (secondHalf));
+    jassert (testFilter.getState().current.g == testFilter.state->g && testFilter.getState().rampRemaining == 0);
+
+    // Test control interval
+    setControlInterval (16);
+    jassert (controlInterval == 16);
+    setControlInterval (0);
+    jassert (controlInterval == 1);
+
+    // Test sub-oscillator: a square wave at 4 samples per cycle gives a sub
+    // at 8 samples per cycle one octave down
+    float subTest[32];
+
+    for (int i = 0; i < 32; ++i)
+    {
+        subTest[i] = (i % 4) < 2 ? -1.0f : 1.0f;
+    }
+
+    float* subChannels[] = { subTest };
+    SubOscillator testSub;
+    testSub.addTo (juce::dsp::AudioBlock<float> (subChannels, 1, 32), 0.5f, 1);
+    jassert (subTest[2] == 0.5f && subTest[6] == 1.5f && subTest[10] == 0.5f);
+
+    // Test noise: white noise stays within +/-1
+    float noiseTest[100] {};
+    float* noiseChannels[] = { noiseTest };
+    NoiseGenerator testNoise;
+    testNoise.addTo (juce::dsp::AudioBlock<float> (noiseChannels, 1, 100), 1.0f, NoiseGenerator::Colour::white);
+    const auto noiseRange = juce::FloatVectorOperations::findMinAndMax (noiseTest, 100);
+    jassert (noiseRange.getStart() >= -1.0f && noiseRange.getEnd() <= 1.0f && noiseRange.getLength() > 0.0f);
+
+    // Test granular: a grain starts with the note and one more every 480
+    // samples at 100 per second, 50 ms grains overlap five deep, and the
+    // parameters are kept in range
+    RcuPointer<Wavetable> grainTable;
+    grainTable.publish (Wavetable::fromHarmonicAmplitudes ({ 1.0f }));
+    float grainTest[64] {};
+    float* grainChannels[] = { grainTest };
+    juce::dsp::AudioBlock<float> grainBlock (grainChannels, 1, 64);
+    GranularOscillator testGranular;
+    testGranular.prepare ({ 48000.0, 64, 1 });
+    testGranular.setWavetableSource (&grainTable);
+    testGranular.setParameters ({ 0.0f, 0.0f, 100.0f, 0.05f, 0.0f, GranularOscillator::Source::wavetable });
+    testGranular.noteOn (69, 1.0f, 440.0f);
+    testGranular.process (juce::dsp::ProcessContextReplacing<float> (grainBlock));
+    jassert (testGranular.getNumGrains() == 1 && grainTest[0] == 0.0f && grainTest[63] != 0.0f);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        testGranular.process (juce::dsp::ProcessContextReplacing<float> (grainBlock));
+    }
+
+    jassert (testGranular.getNumGrains() == 5);
+    testGranular.setParameters ({ 2.0f, 100.0f, 0.0f, 1.0f, -1.0f, GranularOscillator::Source::sample });
+    jassert (testGranular.getParameters().position == 1.0f && testGranular.getParameters().pitch == 24.0f);
+    jassert (testGranular.getParameters().density == 1.0f && testGranular.getParameters().size == 0.5f);
+
+    // Test reduced quality
+    setReducedQuality (true);
+    jassert (! ladder.isSaturating());
+    setReducedQuality (false);
+    jassert (ladder.isSaturating());
+
+    // Test sample mapping note names
+    jassert (SampleMap::parseNoteName ("C4") == 60);
+    jassert (SampleMap::parseNoteName ("F#2") == 42);
+    jassert (SampleMap::parseNoteName ("Bb1") == 34);
+    jassert (SampleMap::parseNoteName ("64") == 64);
+    jassert (SampleMap::parseNoteName ("Bass") == -1);
 
     // Test ADSR
     const juce::ADSR::Parameters initADSR {
@@ -269,5 +1310,21 @@ void CustomVoice::voiceTests()
     double initGainDb = -10.0;
 
     setGain (initGainDb);
-    jassert (gain.getGainDecibels() == initGainDb);
+    jassert (gainFactor == juce::Decibels::decibelsToGain ((float) initGainDb));
+
+    // Test mapped parameters: a controller value stands in for the patch's
+    // setting without changing it, and the setting comes back when cleared
+    setFilter (ladderFilter, 1000.0, 2.0);
+    setMappedParameter (MidiMapping::Parameter::cutoff, 500.0);
+    applyModulation (nullptr, 0, 64);
+    jassert (ladder.getCutoff() == 500.0f && filterCutoff == 1000.0f);
+    clearMappedParameter (MidiMapping::Parameter::cutoff);
+    applyModulation (nullptr, 0, 64);
+    jassert (ladder.getCutoff() == 1000.0f);
+
+    setFM (2.0f, 3.0f, FMOscillator::Mode::phase);
+    setMappedParameter (MidiMapping::Parameter::fmRatio, 4.0);
+    jassert (fmOsc.getRatio() == 4.0f && fmOsc.getIndex() == 3.0f && fmRatio == 2.0f);
+    clearMappedParameter (MidiMapping::Parameter::fmRatio);
+    jassert (fmOsc.getRatio() == 2.0f);
 }
@@ -23,7 +23,22 @@
 */
 #pragma once
 
+#include "AttackCache.h"
+#include "BasicOscillator.h"
 #include "CustomSound.h"
+#include "Envelope.h"
+#include "FMOscillator.h"
+#include "FastMath.h"
+#include "FlightRecorder.h"
+#include "GranularOscillator.h"
+#include "LadderFilter.h"
+#include "MidiMapping.h"
+#include "ModMatrix.h"
+#include "NoiseGenerator.h"
+#include "SampleOscillator.h"
+#include "StateVariableFilter.h"
+#include "SubOscillator.h"
+#include "Wavetable.h"
 #include <JuceHeader.h>
 
 class CustomVoice : public juce::SynthesiserVoice
@@ -41,38 +56,235 @@ public:
     void setWave (int);
     void setGain (double);
     void setFilter (int, double, double);
+    void setSampleSource (RcuPointer<SampleMap>*, SampleOscillator::Playhead*);
+    void setWavetableSource (RcuPointer<Wavetable>*);
+    void setModulation (RcuPointer<CompiledModMatrix>*, const float*);
+    void setModEnvelope (juce::ADSR::Parameters);
+    void setControlInterval (int);
+    void setReducedQuality (bool);
+    void setSubOscillator (float, int);
+    void setNoise (float, NoiseGenerator::Colour);
+    void setFM (float, float, FMOscillator::Mode);
+    void setGranular (const GranularOscillator::Parameters&);
+    void setAttackCache (AttackCache*);
+    void setFlightRecorder (FlightRecorder*, int);
+    void steal();
+
+    // Audio thread only: controller values that stand in for the settings above
+    void setMappedParameter (MidiMapping::Parameter, double) noexcept;
+    void clearMappedParameter (MidiMapping::Parameter) noexcept;
+
+    // Peak level of the voice's last rendered block, after the envelope
+    float getLevel() const noexcept { return level; }
+    bool isBeingStolen() const noexcept { return beingStolen; }
+    bool isInAttack() const noexcept { return envelope.isInAttack(); }
+    int getWave() const noexcept { return wave; }
+    const GranularOscillator::Parameters& getGranular() const noexcept { return granular; }
+
+    template <typename Visitor>
+    void visitState (Visitor&);
+
+    // Waveform number that plays the loaded samples rather than an oscillator
+    static constexpr int sampleWave = 5;
+
+    // Waveform number that plays the user-defined wavetable
+    static constexpr int customWave = 6;
+
+    // Waveform number that plays the two-operator FM/PM oscillator
+    static constexpr int fmWave = 7;
+
+    // Waveform number that plays the granular oscillator
+    static constexpr int granularWave = 8;
+
+    // Filter number that selects the ladder filter rather than the state variable filter
+    static constexpr int ladderFilter = 4;
 
     double sampleRateHolder = 0;
 
     void voiceTests();
 
 private:
-    juce::dsp::Oscillator<float>* osc;
+    void renderChunk (juce::dsp::AudioBlock<float>);
+    void renderSources (juce::dsp::AudioBlock<float>);
+
+    // The sources and filter rendered by one instantiation per waveform and
+    // filter type, so each inner loop is compiled for exactly one of each.
+    // renderPaths[wave - 1][filterType - 1] is the one renderSources calls.
+    template <int waveform, int filter>
+    void renderPath (juce::dsp::AudioBlock<float>&) noexcept;
+
+    using RenderPath = void (CustomVoice::*) (juce::dsp::AudioBlock<float>&);
+    static const RenderPath renderPaths[granularWave][ladderFilter];
+
+    float mixInto (juce::AudioBuffer<float>&, int, int, int, const float*) noexcept;
+    void applyModulation (const CompiledModMatrix*, int, int);
+    void applyMappedSources() noexcept;
+    void setOscillatorFrequency (float);
+    void setOscillatorPitchRatio (float, int);
+    void prepareOscillator (int);
+    bool isDeterministic (const CompiledModMatrix*) const noexcept;
+    void resetSources (float);
+    void finishNote();
+    void startAttack (int, float);
+    void finishAttack() noexcept;
+    AttackCache::Snapshot captureState() const noexcept;
+    void restoreState (const AttackCache::Snapshot&) noexcept;
+
+    // The oscillator of the sine, square, saw or triangle waveform, whichever
+    // is selected, for retuning and for the attack cache
+    BasicOscillator* osc;
     // Sine wave oscillator
-    juce::dsp::Oscillator<float> sineOsc { [] (float x) { return std::sin (x); } };
+    BasicOscillator sineOsc;
     // Square wave oscillator
-    juce::dsp::Oscillator<float> sqOsc { [] (float x) { return x < 0.0f ? -1.0f : 1.0f; } };
+    BasicOscillator sqOsc;
     // Sawtooth wave oscillator
-    juce::dsp::Oscillator<float> sawOsc { [] (float x) { return x / (2 * juce::MathConstants<float>::pi); } };
+    BasicOscillator sawOsc;
     // Triangle wave oscillator
-    juce::dsp::Oscillator<float> triOsc { [] (float x) {
-        if (x <= -juce::MathConstants<float>::pi / 2)
-        {
-            return juce::jmap (x, -juce::MathConstants<float>::pi, -juce::MathConstants<float>::pi / 2, 0.0f, -1.0f);
-        }
-        else if (x > -juce::MathConstants<float>::pi / 2 && x <= juce::MathConstants<float>::pi / 2)
-        {
-            return juce::jmap (x, -juce::MathConstants<float>::pi / 2, juce::MathConstants<float>::pi / 2, -1.0f, 1.0f);
-        }
-        else
-        {
-            return juce::jmap (x, juce::MathConstants<float>::pi / 2, juce::MathConstants<float>::pi, 1.0f, 0.0f);
-        }
-    } };
-
-    juce::dsp::Gain<float> gain;
-    juce::ADSR envelope;
+    BasicOscillator triOsc;
+
+    // Sample playback oscillator
+    SampleOscillator sampleOsc;
+
+    // User-defined wavetable oscillator
+    WavetableOscillator tableOsc;
+
+    // Two-operator FM/PM oscillator, and the patch's settings for it
+    FMOscillator fmOsc;
+    float fmRatio = 1.0f;
+    float fmIndex = 0.0f;
+    FMOscillator::Mode fmMode = FMOscillator::Mode::phase;
+
+    // Granular oscillator over the custom wavetable or the samples, and the
+    // patch's settings for it
+    GranularOscillator granularOsc;
+    GranularOscillator::Parameters granular;
+
+    // Extra sources mixed in ahead of the filter; a level of 0 turns one off
+    SubOscillator subOsc;
+    float subLevel = 0.0f;
+    int subOctaves = 1;
+    NoiseGenerator noise;
+    float noiseLevel = 0.0f;
+    NoiseGenerator::Colour noiseColour = NoiseGenerator::Colour::white;
+
+    // Oscillators are prepared when first selected, not all in prepareToPlay.
+    // Bit n of preparedWaves is set once waveform n's oscillator is ready.
+    juce::dsp::ProcessSpec oscillatorSpec {};
+    int preparedWaves = 0;
+
+    // Output gain as a factor, folded into the envelope when mixing
+    float gainFactor = 1.0f;
+    Envelope envelope;
     int wave = 1;
     juce::AudioBuffer<float> synthBuffer;
-    juce::dsp::ProcessorDuplicator<juce::dsp::StateVariableFilter::Filter<float>, juce::dsp::StateVariableFilter::Parameters<float>> SVFilter;
+    StateVariableFilter SVFilter;
+    LadderFilter ladder;
+    int filterType = 1;
+    float filterCutoff = 20000.0f;
+    float filterResonance = 2.0f;
+
+    // Modulation matrix: the published routing, this voice's inputs to it,
+    // its envelope, and the scratch buffer its operations run in
+    RcuPointer<CompiledModMatrix>* modulation = nullptr;
+    ModVoiceState modState;
+    Envelope modEnvelope;
+    juce::AudioBuffer<float> modBuffer;
+    double noteFrequency = 440.0;
+    float modGainFactor = 1.0f;
+    int controlInterval = 32;
+
+    // Longest chunk rendered and mixed at once, and the longest control interval
+    static constexpr int maxChunkSize = 256;
+    bool filterWasModulated = false;
+    bool pitchWasModulated = false;
+
+    // Adaptive quality: reduced quality quadruples the control interval and
+    // runs the ladder filter linear; a stolen voice fades out over
+    // stealFadeLength samples, however the blocks fall, counting
+    // stealFadeRemaining down across them
+    static constexpr double stealFadeSeconds = 0.005;
+    bool reducedQuality = false;
+    bool beingStolen = false;
+    int stealFadeLength = 1;
+    int stealFadeRemaining = 0;
+    float level = 0.0f;
+
+    // Attack cache: the processor's cache, or nullptr when it is off, and
+    // the entry the opening of this note is streamed from or recorded into
+    enum class AttackMode
+    {
+        live,
+        streaming,
+        recording
+    };
+
+    AttackCache* attackCache = nullptr;
+    AttackMode attackMode = AttackMode::live;
+    int attackEntry = -1;
+    int attackPosition = 0;
+
+    // Where note starts and steals are recorded, and this voice's index there
+    FlightRecorder* flightRecorder = nullptr;
+    int voiceIndex = 0;
+
+    // Parameters mapped to hardware controllers, and their latest values,
+    // which stand in for the patch's settings. Written only on the audio
+    // thread, so they never race the setters the editor calls, and the
+    // patch's settings come back when a parameter is unmapped.
+    bool isMapped[MidiMapping::numParameters] {};
+    float mappedValue[MidiMapping::numParameters] {};
+
+    float getSetting (MidiMapping::Parameter parameter, float patchValue) const noexcept
+    {
+        return isMapped[(int) parameter] ? mappedValue[(int) parameter] : patchValue;
+    }
 };
+
+// Lists the voice's state for a checkpoint: its settings, the values of
+// mapped controllers, its envelopes and noise, and, while it sounds, its
+// sources and filters. A silent voice's sources and filters start afresh
+// with its next note, so they are left out, and a voice that has fallen
+// silent checkpoints the same however it got there. Read after the
+// synthesiser has given the voice its note. Sample playback streams from
+// disk and is not checkpointed, and nor are granular grains of the samples.
+//
+// @param visit: A CheckpointWriter or CheckpointReader.
+template <typename Visitor>
+void CustomVoice::visitState (Visitor& visit)
+{
+    jassert (wave != sampleWave && attackMode == AttackMode::live);
+    jassert (wave != granularWave || granular.source != GranularOscillator::Source::sample);
+
+    visit (wave, gainFactor, filterType, filterCutoff, filterResonance, subLevel, subOctaves, noiseLevel, noiseColour,
+           fmRatio, fmIndex, fmMode, controlInterval, reducedQuality);
+    visit (granular.position, granular.pitch, granular.density, granular.size, granular.spray, granular.source);
+    visit (isMapped, mappedValue);
+
+    if (Visitor::isReading)
+    {
+        setWave (wave);
+        setReducedQuality (reducedQuality);
+        applyMappedSources();
+    }
+
+    envelope.visitState (visit);
+    modEnvelope.visitState (visit);
+    noise.visitState (visit);
+
+    if (isVoiceActive() || envelope.isActive())
+    {
+        visit (noteFrequency, modGainFactor, filterWasModulated, pitchWasModulated, beingStolen, stealFadeRemaining, level,
+               modState.velocity, modState.keyTrack, modState.lfoPhase);
+
+        sineOsc.visitState (visit);
+        sqOsc.visitState (visit);
+        sawOsc.visitState (visit);
+        triOsc.visitState (visit);
+        tableOsc.visitState (visit);
+        fmOsc.visitState (visit);
+        granularOsc.visitState (visit);
+        subOsc.visitState (visit);
+        SVFilter.visitState (visit);
+        ladder.visitState (visit);
+    }
+}
@@ -0,0 +1,219 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the effects bus:
+    chorus, delay and convolution reverb applied once to the summed output of
+    all voices.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "EffectsBus.h"
+
+EffectsBus::EffectsBus()
+{
+    published.publish (std::make_unique<Parameters> (parameters));
+}
+
+// Allocates every effect's buffers and generates the reverb's impulse
+// response for the new sample rate.
+//
+// @param spec: The bus format.
+// @param isNonRealtime: True when the host is rendering offline, in which
+// case the reverb tail is rendered on the audio thread.
+void EffectsBus::prepare (const juce::dsp::ProcessSpec& spec, bool isNonRealtime)
+{
+    sampleRate = spec.sampleRate;
+    numChannels = (int) spec.numChannels;
+
+    chorus.prepare (spec);
+
+    delayLine.setMaximumDelayInSamples ((int) std::ceil (maxDelaySeconds * sampleRate) + 1);
+    delayLine.prepare (spec);
+    delaySamples.reset (sampleRate, 0.05);
+    delaySamples.setCurrentAndTargetValue ((float) (parameters.delayTime * sampleRate));
+
+    reverb.prepare (spec, maxReverbSeconds);
+    reverb.setSynchronousTail (isNonRealtime);
+    updateRoomResponse();
+
+    chorusActive = false;
+    delayActive = false;
+    reverbActive = false;
+}
+
+// Frees the parameter sets the audio thread has finished with. Only call
+// while audio is stopped.
+void EffectsBus::releaseResources()
+{
+    published.reclaimAll();
+}
+
+// Changes the effect settings. A new reverb decay time regenerates the
+// impulse response on the calling thread, unless another instance already
+// has; nothing here waits on the audio thread.
+//
+// @param newParameters: The new settings, clamped to their ranges.
+void EffectsBus::setParameters (const Parameters& newParameters)
+{
+    const bool decayChanged = newParameters.reverbDecay != parameters.reverbDecay;
+
+    parameters = newParameters;
+    parameters.chorusMix = juce::jlimit (0.0f, 1.0f, parameters.chorusMix);
+    parameters.chorusRate = juce::jlimit (0.01f, 20.0f, parameters.chorusRate);
+    parameters.chorusDepth = juce::jlimit (0.0f, 1.0f, parameters.chorusDepth);
+    parameters.delayMix = juce::jlimit (0.0f, 1.0f, parameters.delayMix);
+    parameters.delayTime = juce::jlimit (0.001f, (float) maxDelaySeconds, parameters.delayTime);
+    parameters.delayFeedback = juce::jlimit (0.0f, 0.95f, parameters.delayFeedback);
+    parameters.reverbMix = juce::jlimit (0.0f, 1.0f, parameters.reverbMix);
+    parameters.reverbDecay = juce::jlimit (0.1f, (float) maxReverbSeconds, parameters.reverbDecay);
+
+    if (decayChanged && numChannels > 0)
+    {
+        updateRoomResponse();
+    }
+
+    published.reclaim();
+    published.publish (std::make_unique<Parameters> (parameters));
+}
+
+// Gives the reverb the room response for the current sample rate and decay,
+// taking the kernel from the shared cache or building it there.
+void EffectsBus::updateRoomResponse()
+{
+    const auto key = "room reverb " + juce::String (sampleRate) + " " + juce::String (parameters.reverbDecay, 6) + " "
+                     + juce::String (reverb.getNumChannels()) + " " + juce::String (reverb.getMaxImpulseLength());
+
+    reverb.setKernel (sharedResources->getOrCreate<ReverbKernel> (key, [this] {
+        const auto response = ConvolutionReverb::createRoomResponse (sampleRate, parameters.reverbDecay, numChannels);
+        return ConvolutionReverb::createKernel (response, reverb.getNumChannels(), reverb.getMaxImpulseLength());
+    }));
+}
+
+// Returns how long the bus keeps sounding after its input stops.
+double EffectsBus::getTailLengthSeconds() const
+{
+    double tail = 0.0;
+
+    if (parameters.delayMix > 0.0f)
+    {
+        // Time for the repeats to fall by 60 dB
+        tail += parameters.delayFeedback > 0.0f ? parameters.delayTime * std::log (0.001) / std::log ((double) parameters.delayFeedback)
+                                                : parameters.delayTime;
+    }
+
+    if (parameters.reverbMix > 0.0f)
+    {
+        tail += parameters.reverbDecay;
+    }
+
+    return tail;
+}
+
+// Runs the chain over the summed voices.
+//
+// @param buffer: The synth output, processed in place.
+void EffectsBus::process (juce::AudioBuffer<float>& buffer) noexcept
+{
+    const auto& settings = *published.get();
+    const int channels = juce::jmin (numChannels, buffer.getNumChannels());
+
+    if (channels > 0)
+    {
+        auto block = juce::dsp::AudioBlock<float> (buffer).getSubsetChannelBlock (0, (size_t) channels);
+
+        applyParameters (settings);
+
+        // Each effect is cleared when it comes out of bypass, so it never
+        // replays what it held when it was switched off
+        if (settings.chorusMix > 0.0f)
+        {
+            if (! chorusActive)
+            {
+                chorus.reset();
+            }
+
+            chorus.process (juce::dsp::ProcessContextReplacing<float> (block));
+        }
+
+        if (settings.delayMix > 0.0f)
+        {
+            if (! delayActive)
+            {
+                delayLine.reset();
+                delaySamples.setCurrentAndTargetValue ((float) (settings.delayTime * sampleRate));
+            }
+
+            processDelay (block, settings);
+        }
+
+        if (settings.reverbMix > 0.0f)
+        {
+            if (! reverbActive)
+            {
+                reverb.restart();
+            }
+
+            reverb.process (block, settings.reverbMix);
+        }
+
+        chorusActive = settings.chorusMix > 0.0f;
+        delayActive = settings.delayMix > 0.0f;
+        reverbActive = settings.reverbMix > 0.0f;
+    }
+
+    published.finishedReading();
+}
+
+// Pushes the current settings into the chorus and delay. Cheap when nothing
+// has changed, so it is done every block.
+//
+// @param settings: The settings published to the audio thread.
+void EffectsBus::applyParameters (const Parameters& settings) noexcept
+{
+    chorus.setRate (settings.chorusRate);
+    chorus.setDepth (settings.chorusDepth);
+    chorus.setMix (settings.chorusMix);
+
+    delaySamples.setTargetValue ((float) (settings.delayTime * sampleRate));
+}
+
+// A feedback delay added to the dry signal. The delay time glides to new
+// settings rather than jumping.
+//
+// @param block: The bus, processed in place.
+// @param settings: The settings published to the audio thread.
+void EffectsBus::processDelay (juce::dsp::AudioBlock<float> block, const Parameters& settings) noexcept
+{
+    const int channels = (int) block.getNumChannels();
+    const int numSamples = (int) block.getNumSamples();
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        const float delay = delaySamples.getNextValue();
+
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            auto* data = block.getChannelPointer ((size_t) channel);
+            const float delayed = delayLine.popSample (channel, delay);
+
+            delayLine.pushSample (channel, data[n] + settings.delayFeedback * delayed);
+            data[n] += settings.delayMix * delayed;
+        }
+    }
+}
@@ -0,0 +1,94 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the effects bus: chorus,
+    delay and convolution reverb applied once to the summed output of all
+    voices.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "ConvolutionReverb.h"
+#include "RcuPointer.h"
+#include "SharedResources.h"
+#include <JuceHeader.h>
+
+// Chorus, then delay, then reverb, on the whole bus. None of them add
+// latency. An effect whose mix is zero is skipped entirely.
+class EffectsBus
+{
+public:
+    struct Parameters
+    {
+        float chorusMix = 0.0f; // 0 to 1
+        float chorusRate = 0.8f; // Hz
+        float chorusDepth = 0.25f; // 0 to 1
+
+        float delayMix = 0.0f; // 0 to 1
+        float delayTime = 0.35f; // seconds
+        float delayFeedback = 0.35f; // 0 to 0.95
+
+        float reverbMix = 0.0f; // 0 to 1
+        float reverbDecay = 1.8f; // seconds to decay by 60 dB
+    };
+
+    static constexpr double maxDelaySeconds = 2.0;
+    static constexpr double maxReverbSeconds = 6.0;
+
+    EffectsBus();
+
+    void prepare (const juce::dsp::ProcessSpec&, bool);
+    void releaseResources();
+    void setParameters (const Parameters&);
+    const Parameters& getParameters() const noexcept { return parameters; }
+    void process (juce::AudioBuffer<float>&) noexcept;
+    double getTailLengthSeconds() const;
+
+    // The reverb tail renderer, to be run on a juce::TimeSliceThread
+    juce::TimeSliceClient& getTailRenderer() noexcept { return reverb; }
+
+private:
+    void applyParameters (const Parameters&) noexcept;
+    void processDelay (juce::dsp::AudioBlock<float>, const Parameters&) noexcept;
+    void updateRoomResponse();
+
+    // The settings as last set, and the copy published to the audio thread
+    Parameters parameters;
+    RcuPointer<Parameters> published;
+
+    double sampleRate = 44100.0;
+    int numChannels = 0;
+
+    juce::dsp::Chorus<float> chorus;
+    juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::Linear> delayLine;
+    juce::SmoothedValue<float> delaySamples;
+    ConvolutionReverb reverb;
+
+    // Room reverb kernels are shared with other instances at the same
+    // sample rate and decay
+    juce::SharedResourcePointer<SharedResources> sharedResources;
+
+    // Audio thread state
+    bool chorusActive = false;
+    bool delayActive = false;
+    bool reverbActive = false;
+
+    JUCE_DECLARE_NON_COPYABLE (EffectsBus)
+};
@@ -0,0 +1,175 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the voices' ADSR
+    envelope.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "Envelope.h"
+
+// Sets the rate getNextSample is called at.
+//
+// @param newSampleRate: Samples per second.
+void Envelope::setSampleRate (double newSampleRate) noexcept
+{
+    jassert (newSampleRate > 0.0);
+    sampleRate = newSampleRate;
+    recalculateRates();
+}
+
+// Sets the stage times, in seconds, and the sustain level, 0 to 1. A stage
+// in progress continues at its new rate.
+//
+// @param newParameters: The attack, decay, sustain and release.
+void Envelope::setParameters (const Parameters& newParameters) noexcept
+{
+    parameters = newParameters;
+    recalculateRates();
+}
+
+// Returns to silence at once.
+void Envelope::reset() noexcept
+{
+    level = 0.0f;
+    stage = Stage::idle;
+}
+
+// Starts the attack from the current level, or skips to the first stage
+// with a length.
+void Envelope::noteOn() noexcept
+{
+    if (attackRate > 0.0f)
+    {
+        stage = Stage::attack;
+    }
+    else if (decayRate > 0.0f)
+    {
+        level = 1.0f;
+        stage = Stage::decay;
+    }
+    else
+    {
+        level = parameters.sustain;
+        stage = Stage::sustain;
+    }
+}
+
+// Starts the release from the current level, whatever the stage.
+void Envelope::noteOff() noexcept
+{
+    if (stage == Stage::idle)
+    {
+        return;
+    }
+
+    if (parameters.release > 0.0f)
+    {
+        releaseRate = (float) (level / (parameters.release * sampleRate));
+        stage = Stage::release;
+    }
+    else
+    {
+        reset();
+    }
+}
+
+// Advances the envelope by one sample.
+//
+// @return The level, 0 to 1.
+float Envelope::getNextSample() noexcept
+{
+    switch (stage)
+    {
+        case Stage::idle:
+            return 0.0f;
+
+        case Stage::attack:
+            level += attackRate;
+
+            if (level >= 1.0f)
+            {
+                level = 1.0f;
+                goToNextStage();
+            }
+
+            break;
+
+        case Stage::decay:
+            level -= decayRate;
+
+            if (level <= parameters.sustain)
+            {
+                level = parameters.sustain;
+                goToNextStage();
+            }
+
+            break;
+
+        case Stage::sustain:
+            level = parameters.sustain;
+            break;
+
+        case Stage::release:
+            level -= releaseRate;
+
+            if (level <= 0.0f)
+            {
+                goToNextStage();
+            }
+
+            break;
+    }
+
+    return level;
+}
+
+void Envelope::recalculateRates() noexcept
+{
+    auto getRate = [this] (float distance, float seconds) {
+        return seconds > 0.0f ? (float) (distance / (seconds * sampleRate)) : -1.0f;
+    };
+
+    attackRate = getRate (1.0f, parameters.attack);
+    decayRate = getRate (1.0f - parameters.sustain, parameters.decay);
+    releaseRate = getRate (parameters.sustain, parameters.release);
+
+    if ((stage == Stage::attack && attackRate <= 0.0f)
+        || (stage == Stage::decay && (decayRate <= 0.0f || level <= parameters.sustain))
+        || (stage == Stage::release && releaseRate <= 0.0f))
+    {
+        goToNextStage();
+    }
+}
+
+void Envelope::goToNextStage() noexcept
+{
+    if (stage == Stage::attack)
+    {
+        stage = decayRate > 0.0f ? Stage::decay : Stage::sustain;
+    }
+    else if (stage == Stage::decay)
+    {
+        stage = Stage::sustain;
+    }
+    else if (stage == Stage::release)
+    {
+        reset();
+    }
+}
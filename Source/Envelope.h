@@ -0,0 +1,82 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the voices' ADSR
+    envelope.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// The linear attack, decay, sustain and release of juce::ADSR, sample for
+// sample, with its stage and level visible to checkpoints, which
+// juce::ADSR keeps private. Takes the same juce::ADSR::Parameters.
+class Envelope
+{
+public:
+    using Parameters = juce::ADSR::Parameters;
+
+    void setSampleRate (double) noexcept;
+    void setParameters (const Parameters&) noexcept;
+    const Parameters& getParameters() const noexcept { return parameters; }
+
+    void reset() noexcept;
+    void noteOn() noexcept;
+    void noteOff() noexcept;
+    float getNextSample() noexcept;
+
+    bool isActive() const noexcept { return stage != Stage::idle; }
+    bool isInAttack() const noexcept { return stage == Stage::attack; }
+
+    // The release rate is set on entering the release stage and only read
+    // in it, so it is left out of the others
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        visit (stage, level, parameters.attack, parameters.decay, parameters.sustain, parameters.release, attackRate, decayRate);
+
+        if (stage == Stage::release)
+        {
+            visit (releaseRate);
+        }
+    }
+
+private:
+    enum class Stage : juce::uint8
+    {
+        idle,
+        attack,
+        decay,
+        sustain,
+        release
+    };
+
+    void recalculateRates() noexcept;
+    void goToNextStage() noexcept;
+
+    Parameters parameters;
+    double sampleRate = 44100.0;
+    Stage stage = Stage::idle;
+    float level = 0.0f;
+    float attackRate = 0.0f;
+    float decayRate = 0.0f;
+    float releaseRate = 0.0f;
+};
@@ -0,0 +1,151 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for a two-operator
+    FM/PM oscillator: a sine modulator at a ratio of the note's frequency
+    drives the phase or the frequency of a sine carrier.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "FMOscillator.h"
+#include "FastMath.h"
+
+// Prepares the oscillator for playback.
+//
+// @param spec: The prep info of the owning voice.
+void FMOscillator::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    sampleRate = spec.sampleRate;
+    frequency.reset (sampleRate, 0.05);
+    index.reset (sampleRate, 0.02);
+    reset();
+}
+
+// Restarts both operators at zero phase and jumps to the frequency last
+// set, with no pitch modulation, e.g. at the start of a note, so every note
+// begins with the same timbre.
+void FMOscillator::reset() noexcept
+{
+    frequency.setCurrentAndTargetValue (frequency.getTargetValue());
+    pitchRatio.setCurrentAndTargetValue (1.0f);
+    carrierPhase = 0.0f;
+    modulatorPhase = 0.0f;
+    index.setCurrentAndTargetValue (targetIndex);
+}
+
+// Sets the carrier frequency, gliding to it like juce::dsp::Oscillator does.
+//
+// @param newFrequency: The note's frequency in Hz.
+void FMOscillator::setFrequency (float newFrequency) noexcept
+{
+    frequency.setTargetValue (newFrequency);
+}
+
+// Sets the modulator's frequency ratio and depth.
+//
+// @param newRatio: The modulator frequency as a multiple of the carrier's, 0.25 to 16.
+// @param newIndex: The modulation index, the peak phase deviation in radians, 0 to 10.
+// @param newMode: Whether the modulator drives the carrier's phase or its frequency.
+void FMOscillator::setParameters (float newRatio, float newIndex, Mode newMode) noexcept
+{
+    ratio = juce::jlimit (0.25f, 16.0f, newRatio);
+    targetIndex = juce::jlimit (0.0f, 10.0f, newIndex);
+    mode = newMode;
+}
+
+// Fills a block with the carrier, the same on every channel.
+//
+// @param context: The block to be replaced.
+void FMOscillator::process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept
+{
+    constexpr int chunkSize = 64;
+    constexpr float twoPi = juce::MathConstants<float>::twoPi;
+    alignas (16) float carrier[chunkSize];
+    alignas (16) float modulator[chunkSize];
+    alignas (16) float depth[chunkSize];
+
+    auto& block = context.getOutputBlock();
+    auto* output = block.getChannelPointer (0);
+    const int numSamples = (int) block.getNumSamples();
+    const float inverseSampleRate = (float) (1.0 / sampleRate);
+    const float modulatorRatio = ratio;
+
+    index.setTargetValue (targetIndex);
+
+    for (int start = 0; start < numSamples; start += chunkSize)
+    {
+        const int length = juce::jmin (chunkSize, numSamples - start);
+
+        // Phases are accumulated one sample after another, which is cheap;
+        // the sines, which are not, then run over whole arrays. carrier
+        // holds each sample's phase increment until it is replaced below.
+        for (int i = 0; i < length; ++i)
+        {
+            const float step = frequency.getNextValue() * pitchRatio.getNextValue() * inverseSampleRate;
+
+            carrier[i] = step;
+            modulator[i] = modulatorPhase;
+            depth[i] = index.getNextValue();
+
+            modulatorPhase += step * modulatorRatio;
+            modulatorPhase -= (float) (int) modulatorPhase;
+        }
+
+        for (int i = 0; i < length; ++i)
+        {
+            modulator[i] = depth[i] * FastMath::sin (twoPi * modulator[i]);
+        }
+
+        if (mode == Mode::phase)
+        {
+            for (int i = 0; i < length; ++i)
+            {
+                const float step = carrier[i];
+
+                carrier[i] = twoPi * carrierPhase + modulator[i];
+                carrierPhase += step;
+                carrierPhase -= (float) (int) carrierPhase;
+            }
+        }
+        else
+        {
+            // A peak deviation of index times the modulator frequency gives
+            // the same sidebands as phase modulation by the same index. Deep
+            // modulation can take the frequency negative, so wrap with floor.
+            for (int i = 0; i < length; ++i)
+            {
+                const float step = carrier[i];
+
+                carrier[i] = twoPi * carrierPhase;
+                carrierPhase += step * (1.0f + modulatorRatio * modulator[i]);
+                carrierPhase -= std::floor (carrierPhase);
+            }
+        }
+
+        for (int i = 0; i < length; ++i)
+        {
+            output[start + i] = FastMath::sin (carrier[i]);
+        }
+    }
+
+    for (size_t channel = 1; channel < block.getNumChannels(); ++channel)
+    {
+        juce::FloatVectorOperations::copy (block.getChannelPointer (channel), output, numSamples);
+    }
+}
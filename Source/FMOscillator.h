@@ -0,0 +1,90 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for a two-operator FM/PM
+    oscillator: a sine modulator at a ratio of the note's frequency drives
+    the phase or the frequency of a sine carrier.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "RampedValue.h"
+#include <JuceHeader.h>
+
+class FMOscillator
+{
+public:
+    enum class Mode
+    {
+        phase, // the modulator is added to the carrier's phase (PM)
+        frequency // the modulator is added to the carrier's frequency (FM)
+    };
+
+    struct State
+    {
+        float carrierPhase = 0.0f;
+        float modulatorPhase = 0.0f;
+    };
+
+    void prepare (const juce::dsp::ProcessSpec&);
+    void reset() noexcept;
+    void setFrequency (float) noexcept;
+    void setPitchRatio (float ratio, int numSamples) noexcept { pitchRatio.rampTo (ratio, numSamples); }
+    void setParameters (float, float, Mode) noexcept;
+    void process (const juce::dsp::ProcessContextReplacing<float>&) noexcept;
+
+    float getRatio() const noexcept { return ratio; }
+    float getIndex() const noexcept { return targetIndex; }
+    Mode getMode() const noexcept { return mode; }
+
+    State getState() const noexcept { return { carrierPhase, modulatorPhase }; }
+    void setState (const State& state) noexcept
+    {
+        carrierPhase = state.carrierPhase;
+        modulatorPhase = state.modulatorPhase;
+    }
+
+    // The running state only; the ratio, index and mode are settings
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        visit (carrierPhase, modulatorPhase);
+        frequency.visitState (visit);
+        pitchRatio.visitState (visit);
+        index.visitState (visit);
+    }
+
+private:
+    double sampleRate = 44100.0;
+    RampedValue frequency;
+
+    // Pitch modulation, ramped separately from the glide between notes
+    RampedValue pitchRatio { 1.0f };
+
+    // Set from the message thread; the smoothed index catches up on the
+    // audio thread at the start of each block
+    float ratio = 1.0f;
+    float targetIndex = 0.0f;
+    Mode mode = Mode::phase;
+    RampedValue index;
+
+    float carrierPhase = 0.0f; // 0 to 1
+    float modulatorPhase = 0.0f; // 0 to 1
+};
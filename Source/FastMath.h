@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    This file contains the header and implementation information for fast
+    approximations of transcendental functions used in the voice's inner
+    loops, written so that the compiler can vectorise them.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+struct FastMath
+{
+    // Rational (7/6 Pade) approximation of tanh. Absolute error is below 1e-4
+    // everywhere, the output never exceeds +/-1, and it is branch free, so a
+    // loop calling it on plain arrays vectorises.
+    //
+    // @param x: Any value.
+    // @return Approximately std::tanh (x).
+    static inline float tanh (float x) noexcept
+    {
+        x = juce::jlimit (-4.97f, 4.97f, x);
+        const float x2 = x * x;
+
+        return x * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2)))
+               / (135135.0f + x2 * (62370.0f + x2 * (3150.0f + 28.0f * x2)));
+    }
+
+    // Sine by range reduction to [0, pi / 2] and a degree 9 minimax odd
+    // polynomial. Absolute error is below 2e-7 for |x| <= pi and 5e-7 for
+    // |x| <= 20, the output never exceeds +/-1, and it is branch free, so a
+    // loop calling it on plain arrays vectorises.
+    //
+    // @param x: Any value in radians; accuracy falls off as |x| grows large,
+    // and |x| must stay below about 1e10.
+    // @return Approximately std::sin (x).
+    static inline float sin (float x) noexcept
+    {
+        constexpr float pi = juce::MathConstants<float>::pi;
+
+        // Reduce to [-pi, pi] by taking off the nearest whole number of
+        // turns, then fold onto [0, pi / 2] using sin (pi - a) = sin (a) and
+        // sin (-a) = -sin (a). The rounding is a truncating conversion, which
+        // compilers vectorise without relaxed maths flags, unlike std::floor.
+        const float turns = x * (0.5f / pi);
+        const float r = x - juce::MathConstants<float>::twoPi * (float) (int) (turns + std::copysign (0.5f, turns));
+        const float a = std::abs (r);
+        const float y = juce::jmin (a, pi - a);
+        const float y2 = y * y;
+
+        const float s = y * (9.999999766e-1f + y2 * (-1.666664763e-1f + y2 * (8.332899823e-3f + y2 * (-1.980089776e-4f + y2 * 2.590488501e-6f))));
+        return std::copysign (s, r);
+    }
+};
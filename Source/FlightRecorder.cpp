@@ -0,0 +1,332 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the flight recorder,
+    which keeps a rolling record of what the audio thread was asked to do
+    and writes the last few seconds of it to disk after a missed deadline.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "FlightRecorder.h"
+
+FlightRecorder::FlightRecorder()
+    : directory (juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+                     .getChildFile ("Subsynth")
+                     .getChildFile ("Flight Recorder"))
+{
+}
+
+// Allocates the ring on first use and starts timing blocks at the new rate.
+// Call before playback.
+//
+// @param newSampleRate: The host sample rate the blocks are timed against.
+// @param shouldDump: False for offline rendering, where there is no deadline
+// to miss.
+void FlightRecorder::prepare (double newSampleRate, bool shouldDump)
+{
+    if (storage == nullptr)
+    {
+        storage.reset (new Slot[(size_t) capacity]);
+        slots.store (storage.get(), std::memory_order_release);
+    }
+
+    sampleRate = newSampleRate;
+    canDump = shouldDump;
+    nextDumpAllowed = blockStart.load();
+}
+
+// Turns recording on or off. Off, every record call returns at once.
+//
+// @param shouldRecord: True to record.
+void FlightRecorder::setEnabled (bool shouldRecord) noexcept
+{
+    enabled = shouldRecord;
+}
+
+// Sets where dumps are written. Defaults to a Flight Recorder folder in the
+// user's application data.
+//
+// @param newDirectory: The folder, created with the first dump.
+void FlightRecorder::setDumpDirectory (const juce::File& newDirectory)
+{
+    const juce::ScopedLock sl (fileLock);
+    directory = newDirectory;
+}
+
+// @return The last file written, or a default File before the first dump.
+juce::File FlightRecorder::getLastDump() const
+{
+    const juce::ScopedLock sl (fileLock);
+    return lastDump;
+}
+
+// Records a MIDI event of the current block.
+//
+// @param data: The raw message.
+// @param numBytes: Its size. Only the first three bytes are kept.
+// @param samplePosition: Its position in the block.
+void FlightRecorder::recordMidi (const juce::uint8* data, int numBytes, int samplePosition) noexcept
+{
+    Event event;
+    event.time = blockStart.load (std::memory_order_relaxed) + samplePosition / sampleRate;
+    event.type = EventType::midi;
+    event.count = numBytes;
+    std::copy (data, data + juce::jmin (numBytes, 3), event.data);
+    push (event);
+}
+
+// Records a parameter change, stamped with the start of the current block.
+//
+// @param name: What changed. Must be a string literal, as only the pointer is kept.
+// @param values: Up to four new values.
+void FlightRecorder::recordParameter (const char* name, std::initializer_list<float> values) noexcept
+{
+    Event event;
+    event.time = blockStart.load (std::memory_order_relaxed);
+    event.name = name;
+    event.type = EventType::parameter;
+    event.count = juce::jmin ((int) values.size(), 4);
+    std::copy (values.begin(), values.begin() + event.count, event.values);
+    push (event);
+}
+
+// Records a voice starting a note.
+//
+// @param voice: The voice's index.
+// @param note: The MIDI note.
+// @param velocity: The velocity, 0 to 1.
+// @param wasSounding: True if the voice cut off a note still sounding.
+void FlightRecorder::recordVoiceStart (int voice, int note, float velocity, bool wasSounding) noexcept
+{
+    Event event;
+    event.time = blockStart.load (std::memory_order_relaxed);
+    event.type = EventType::voiceStart;
+    event.count = voice;
+    event.values[0] = velocity;
+    event.values[1] = wasSounding ? 1.0f : 0.0f;
+    event.data[0] = (juce::uint8) juce::jlimit (0, 127, note);
+    push (event);
+}
+
+// Records a voice being taken from its note for another.
+//
+// @param voice: The voice's index.
+// @param note: The note it was playing.
+void FlightRecorder::recordVoiceSteal (int voice, int note) noexcept
+{
+    Event event;
+    event.time = blockStart.load (std::memory_order_relaxed);
+    event.type = EventType::voiceSteal;
+    event.count = voice;
+    event.data[0] = (juce::uint8) juce::jlimit (0, 127, note);
+    push (event);
+}
+
+// Records the block just rendered and moves the clock on. If the block took
+// longer than its own duration, asks the background thread for a dump,
+// unless one is waiting or the last was too recent.
+//
+// @param numSamples: The block's size at the host rate.
+// @param renderMs: How long the block took to render.
+void FlightRecorder::recordBlock (int numSamples, double renderMs) noexcept
+{
+    const double start = blockStart.load (std::memory_order_relaxed);
+
+    Event event;
+    event.time = start;
+    event.type = EventType::block;
+    event.count = numSamples;
+    event.values[0] = (float) renderMs;
+    event.values[1] = (float) (1000.0 * numSamples / sampleRate);
+    push (event);
+
+    if (event.values[0] > event.values[1] && canDump && start >= nextDumpAllowed
+        && enabled.load (std::memory_order_relaxed) && pendingDump.load (std::memory_order_acquire) == 0)
+    {
+        overrun = event;
+        nextDumpAllowed = start + minSecondsBetweenDumps;
+        pendingDump.store (writeIndex.load (std::memory_order_relaxed), std::memory_order_release);
+    }
+
+    blockStart.store (start + numSamples / sampleRate, std::memory_order_relaxed);
+}
+
+// Writes any requested dump.
+//
+// @return The time to wait before the next call, in ms.
+int FlightRecorder::useTimeSlice()
+{
+    const auto end = pendingDump.load (std::memory_order_acquire);
+
+    if (end == 0)
+    {
+        return 100;
+    }
+
+    writeDump (copyRecent (end));
+    ++numDumps;
+    pendingDump.store (0, std::memory_order_release);
+    return 100;
+}
+
+// Claims the next slot and writes the event into it. The slot's sequence is
+// odd while it is being written and 2 * (index + 1) once it holds the event
+// with that index, so a reader can tell a whole event from a torn one.
+//
+// @param event: The event to record.
+void FlightRecorder::push (const Event& event) noexcept
+{
+    auto* ring = slots.load (std::memory_order_acquire);
+
+    if (ring == nullptr || ! enabled.load (std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    const auto index = writeIndex.fetch_add (1, std::memory_order_relaxed);
+    auto& slot = ring[index % (juce::uint64) capacity];
+
+    slot.sequence.store (2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+    slot.event = event;
+    slot.sequence.store (2 * index + 2, std::memory_order_release);
+}
+
+// Copies out the events of the dumpSeconds up to the overrun, oldest first.
+// An event still being written is left out; one already overwritten by a
+// newer lap of the ring ends the copy, as everything older is gone too.
+//
+// @param end: The write index just past the overrunning block.
+// @return The events.
+std::vector<FlightRecorder::Event> FlightRecorder::copyRecent (juce::uint64 end) const
+{
+    std::vector<Event> events;
+    const auto* ring = slots.load (std::memory_order_acquire);
+    const double earliest = overrun.time - dumpSeconds;
+    const juce::uint64 oldest = end > (juce::uint64) capacity ? end - (juce::uint64) capacity : 0;
+
+    for (auto index = end; index > oldest; --index)
+    {
+        const auto& slot = ring[(index - 1) % (juce::uint64) capacity];
+        const auto expected = 2 * index;
+        const auto before = slot.sequence.load (std::memory_order_acquire);
+
+        if (before > expected)
+        {
+            break;
+        }
+
+        const Event event = slot.event;
+        std::atomic_thread_fence (std::memory_order_acquire);
+
+        if (before != expected || slot.sequence.load (std::memory_order_relaxed) != expected)
+        {
+            continue;
+        }
+
+        if (event.time < earliest)
+        {
+            break;
+        }
+
+        events.push_back (event);
+    }
+
+    std::reverse (events.begin(), events.end());
+    return events;
+}
+
+// Writes the events as text, one per line, to a new file named after the
+// wall-clock time of the dump.
+//
+// @param events: The events, oldest first.
+void FlightRecorder::writeDump (const std::vector<Event>& events)
+{
+    juce::File folder;
+
+    {
+        const juce::ScopedLock sl (fileLock);
+        folder = directory;
+    }
+
+    if (folder.createDirectory().failed())
+    {
+        return;
+    }
+
+    const auto file = folder.getChildFile ("Overrun " + juce::Time::getCurrentTime().formatted ("%Y-%m-%d %H-%M-%S") + ".txt")
+                          .getNonexistentSibling();
+
+    juce::String text;
+    text << "Subsynth flight recorder\n"
+         << "Block at " << juce::String (overrun.time, 4) << " s of " << overrun.count << " samples took "
+         << juce::String (overrun.values[0], 3) << " ms, budget " << juce::String (overrun.values[1], 3) << " ms\n"
+         << "Last " << events.size() << " events, times in seconds of audio\n\n";
+
+    for (const auto& event : events)
+    {
+        text << juce::String (event.time, 4).paddedLeft (' ', 12) << "  ";
+
+        switch (event.type)
+        {
+            case EventType::block:
+                text << "block " << event.count << " samples, " << juce::String (event.values[0], 3) << " ms of "
+                     << juce::String (event.values[1], 3) << (event.values[0] > event.values[1] ? "  OVERRUN" : "");
+                break;
+
+            case EventType::midi:
+                if (event.count > 3 || event.count < 1)
+                {
+                    text << "midi, " << event.count << " bytes";
+                }
+                else
+                {
+                    text << "midi " << juce::String::toHexString (event.data, event.count) << ", "
+                         << juce::MidiMessage (event.data, event.count).getDescription();
+                }
+                break;
+
+            case EventType::parameter:
+                text << event.name << " =";
+
+                for (int i = 0; i < event.count; ++i)
+                {
+                    text << (i > 0 ? ", " : " ") << juce::String (event.values[i], 3);
+                }
+                break;
+
+            case EventType::voiceStart:
+                text << "voice " << event.count << " starts note " << (int) event.data[0] << " velocity "
+                     << juce::String (event.values[0], 2) << (event.values[1] != 0.0f ? ", cutting off its last note" : "");
+                break;
+
+            case EventType::voiceSteal:
+                text << "voice " << event.count << " stolen from note " << (int) event.data[0];
+                break;
+        }
+
+        text << "\n";
+    }
+
+    if (file.replaceWithText (text))
+    {
+        const juce::ScopedLock sl (fileLock);
+        lastDump = file;
+    }
+}
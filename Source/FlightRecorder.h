@@ -0,0 +1,122 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the flight recorder,
+    which keeps a rolling record of what the audio thread was asked to do
+    and writes the last few seconds of it to disk after a missed deadline.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// Records every block's render time, every MIDI event, every parameter
+// change, and every voice start and steal into a fixed ring of events. When
+// a block takes longer than its own duration, the background thread copies
+// out the last dumpSeconds of the ring and writes it to a text file, so an
+// intermittent dropout can be traced back to the exact input that caused it.
+//
+// Recording is lock and allocation free from any thread: a writer claims a
+// slot with one atomic increment and stamps it with a sequence number once
+// written, and the dump skips slots that were being overwritten as it read
+// them. The ring is allocated by the first prepare, so an instance that is
+// never played does not pay for it.
+class FlightRecorder : public juce::TimeSliceClient
+{
+public:
+    static constexpr int capacity = 1 << 15;
+    static constexpr double dumpSeconds = 5.0;
+
+    // After a dump is triggered, further overruns are ignored for this long,
+    // so a machine that is overloaded for a while does not fill the disk
+    static constexpr double minSecondsBetweenDumps = 30.0;
+
+    enum class EventType : juce::uint8
+    {
+        block,
+        midi,
+        parameter,
+        voiceStart,
+        voiceSteal
+    };
+
+    struct Event
+    {
+        double time = 0.0; // seconds of audio since the first prepare
+        const char* name = nullptr; // parameter events: a string literal
+        float values[4] {}; // block: render and budget ms; parameter: its values; voice: velocity
+        juce::int32 count = 0; // block: samples; midi: bytes; parameter: values; voice: index
+        EventType type = EventType::block;
+        juce::uint8 data[3] {}; // midi: the first bytes; voice: the note in data[0]
+    };
+
+    FlightRecorder();
+
+    void prepare (double, bool);
+    void setEnabled (bool) noexcept;
+    void setDumpDirectory (const juce::File&);
+
+    // Any thread
+    void recordMidi (const juce::uint8*, int, int) noexcept;
+    void recordParameter (const char*, std::initializer_list<float>) noexcept;
+    void recordVoiceStart (int, int, float, bool) noexcept;
+    void recordVoiceSteal (int, int) noexcept;
+
+    // Audio thread, once at the end of each block
+    void recordBlock (int, double) noexcept;
+
+    int getNumDumps() const noexcept { return numDumps.load(); }
+    juce::File getLastDump() const;
+
+    int useTimeSlice() override;
+
+private:
+    struct Slot
+    {
+        std::atomic<juce::uint64> sequence { 0 };
+        Event event;
+    };
+
+    void push (const Event&) noexcept;
+    std::vector<Event> copyRecent (juce::uint64) const;
+    void writeDump (const std::vector<Event>&);
+
+    std::unique_ptr<Slot[]> storage;
+    std::atomic<Slot*> slots { nullptr };
+    std::atomic<juce::uint64> writeIndex { 0 };
+    std::atomic<bool> enabled { true };
+
+    // Audio time keeps counting across prepares, so events from before a
+    // sample rate change still sort before the ones after it
+    double sampleRate = 44100.0;
+    bool canDump = true;
+    std::atomic<double> blockStart { 0.0 };
+    double nextDumpAllowed = 0.0;
+
+    // The overrunning block, and the write index just past it, or 0 when no
+    // dump is waiting. The block is written before pendingDump is set.
+    Event overrun;
+    std::atomic<juce::uint64> pendingDump { 0 };
+    std::atomic<int> numDumps { 0 };
+
+    juce::CriticalSection fileLock;
+    juce::File directory;
+    juce::File lastDump;
+};
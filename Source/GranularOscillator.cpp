@@ -0,0 +1,317 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for a granular
+    oscillator, which plays many short windowed grains of the custom
+    wavetable or of the loaded samples at once.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "GranularOscillator.h"
+#include "FastMath.h"
+
+// Prepares the oscillator for playback.
+//
+// @param spec: The prep info of the owning voice.
+void GranularOscillator::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    sampleRate = spec.sampleRate;
+    reset();
+}
+
+// Sets how grains are spawned. Grains already playing keep their own pitch
+// and length.
+//
+// @param newParameters: The position, pitch, density, size, spray and source.
+void GranularOscillator::setParameters (const Parameters& newParameters) noexcept
+{
+    parameters.position = juce::jlimit (0.0f, 1.0f, newParameters.position);
+    parameters.pitch = juce::jlimit (-24.0f, 24.0f, newParameters.pitch);
+    parameters.density = juce::jlimit (1.0f, 1000.0f, newParameters.density);
+    parameters.size = juce::jlimit (0.005f, 0.5f, newParameters.size);
+    parameters.spray = juce::jlimit (0.0f, 1.0f, newParameters.spray);
+    parameters.source = newParameters.source;
+}
+
+// Starts a note: grains from here on play at its pitch, from the sample
+// zone that covers it when the source is the samples, and the first grain
+// starts at once. Grains of the note it cuts off play out.
+//
+// @param midiNoteNumber: The note to be played.
+// @param velocity: The velocity of the note, 0 to 1, for choosing a zone.
+// @param newFrequency: The frequency of the note in Hz.
+void GranularOscillator::noteOn (int midiNoteNumber, float velocity, float newFrequency) noexcept
+{
+    frequency = newFrequency;
+    untilNextGrain = 0.0f;
+
+    playingMap = samples != nullptr ? samples->get() : nullptr;
+    zone = playingMap != nullptr ? playingMap->findZone (midiNoteNumber, juce::jlimit (1, 127, juce::roundToInt (velocity * 127.0f))) : nullptr;
+
+    // Grains interpolate between neighbouring samples, so need two of them
+    if (zone != nullptr && zone->attack.getNumSamples() < 2)
+    {
+        zone = nullptr;
+    }
+
+    if (zone != nullptr)
+    {
+        rootFrequency = (float) juce::MidiMessage::getMidiNoteInHertz (zone->rootNote);
+    }
+}
+
+// Stops every grain and restarts the random spray from its seed, so a note
+// from silence sprays the same way every time.
+void GranularOscillator::reset() noexcept
+{
+    numGrains = 0;
+    untilNextGrain = 0.0f;
+    random = 0x9e3779b9;
+}
+
+// Fills a block with the sum of the grains, the same on every channel,
+// starting the grains that fall due during it.
+//
+// @param context: The block to be replaced.
+void GranularOscillator::process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept
+{
+    auto& block = context.getOutputBlock();
+    const int numSamples = (int) block.getNumSamples();
+    auto* output = block.getChannelPointer (0);
+
+    // The sample set was replaced mid-note, so the old zone may be reclaimed soon
+    if (zone != nullptr && (samples == nullptr || samples->get() != playingMap))
+    {
+        zone = nullptr;
+        playingMap = nullptr;
+        numGrains = 0;
+    }
+
+    const float* source = nullptr;
+    int length = 0;
+    const bool cyclic = parameters.source == Source::wavetable;
+
+    if (cyclic)
+    {
+        const auto* table = wavetable != nullptr ? wavetable->get() : nullptr;
+
+        if (table != nullptr)
+        {
+            const float grainFrequency = frequency * std::exp2 (parameters.pitch / 12.0f);
+            source = table->getLevel (Wavetable::getLevelForFrequency (grainFrequency, sampleRate));
+            length = Wavetable::tableSize;
+        }
+    }
+    else if (zone != nullptr)
+    {
+        source = zone->attack.getReadPointer (0);
+        length = zone->attack.getNumSamples();
+    }
+
+    if (source == nullptr)
+    {
+        numGrains = 0;
+        block.clear();
+        return;
+    }
+
+    // A rise in density takes effect at once rather than after the old wait
+    const float period = (float) (sampleRate / parameters.density);
+    const int grainLength = juce::jmax (1, juce::roundToInt (parameters.size * sampleRate));
+    untilNextGrain = juce::jmin (untilNextGrain, period);
+
+    for (; untilNextGrain < (float) numSamples; untilNextGrain += period)
+    {
+        spawnGrain ((int) untilNextGrain, cyclic, length, grainLength);
+    }
+
+    untilNextGrain -= (float) numSamples;
+
+    juce::FloatVectorOperations::clear (output, numSamples);
+
+    if (cyclic)
+    {
+        renderGrains<true> (source, length, output, numSamples);
+    }
+    else
+    {
+        renderGrains<false> (source, length, output, numSamples);
+    }
+
+    // Finished grains make way for the last one in the pool
+    for (int g = 0; g < numGrains;)
+    {
+        if (remaining[g] > 0)
+        {
+            ++g;
+            continue;
+        }
+
+        const int last = --numGrains;
+        readPosition[g] = readPosition[last];
+        increment[g] = increment[last];
+        windowPosition[g] = windowPosition[last];
+        windowIncrement[g] = windowIncrement[last];
+        gain[g] = gain[last];
+        remaining[g] = remaining[last];
+    }
+
+    for (size_t channel = 1; channel < block.getNumChannels(); ++channel)
+    {
+        juce::FloatVectorOperations::copy (block.getChannelPointer (channel), output, numSamples);
+    }
+}
+
+// Adds every grain's part of the block to the output. Each grain's samples
+// are worked out from its position and window at the start of the block,
+// with no dependency from one sample to the next, 64 at a time: the read
+// positions and windows in one loop, which vectorises, then the reads from
+// the source, which are gathers, in another. Only a grain that starts or
+// ends during the block covers less than all of it.
+//
+// @param source: The wavetable level or sample channel the grains read.
+// @param length: Its length in samples, not counting a wavetable's wrap-around copy.
+// @param output: The block's first channel, cleared.
+// @param numSamples: The block's length.
+template <bool cyclic>
+void GranularOscillator::renderGrains (const float* source, int length, float* output, int numSamples) noexcept
+{
+    constexpr int chunkSize = 64;
+    constexpr float pi = juce::MathConstants<float>::pi;
+    const float size = (float) length;
+    const float inverseSize = 1.0f / size;
+
+    // A wavetable wraps round and has a copy of its first sample at the end;
+    // a sample is held at its last one
+    const float limit = cyclic ? size : size - 1.0f;
+    const int lastIndex = cyclic ? length - 1 : length - 2;
+
+    alignas (16) int index[chunkSize];
+    alignas (16) float fraction[chunkSize];
+    alignas (16) float weight[chunkSize];
+
+    for (int g = 0; g < numGrains; ++g)
+    {
+        const int begin = blockStart[g];
+        const int count = juce::jmin (numSamples - begin, remaining[g]);
+        const float start = readPosition[g];
+        const float step = increment[g];
+        const float windowStart = windowPosition[g];
+        const float windowStep = windowIncrement[g];
+        const float amplitude = gain[g];
+
+        for (int done = 0; done < count; done += chunkSize)
+        {
+            const int todo = juce::jmin (chunkSize, count - done);
+            float* destination = output + begin + done;
+
+            for (int n = 0; n < todo; ++n)
+            {
+                float position = start + step * (float) (done + n);
+
+                if (cyclic)
+                {
+                    position -= size * (float) (int) (position * inverseSize);
+                }
+
+                position = juce::jmin (position, limit);
+                index[n] = juce::jmin ((int) position, lastIndex);
+                fraction[n] = position - (float) index[n];
+
+                const float window = FastMath::sin (pi * (windowStart + windowStep * (float) (done + n)));
+                weight[n] = amplitude * window * window;
+            }
+
+            for (int n = 0; n < todo; ++n)
+            {
+                const float* at = source + index[n];
+                destination[n] += weight[n] * (at[0] + fraction[n] * (at[1] - at[0]));
+            }
+        }
+
+        float next = start + step * (float) count;
+
+        if (cyclic)
+        {
+            next -= size * (float) (int) (next * inverseSize);
+        }
+
+        readPosition[g] = next;
+        windowPosition[g] = windowStart + windowStep * (float) count;
+        remaining[g] -= count;
+        blockStart[g] = 0;
+    }
+}
+
+// Adds a grain to the pool, starting part way through the block, unless
+// the pool is full.
+//
+// @param startInBlock: The sample of the block the grain starts at.
+// @param cyclic: True when the source is a wavetable.
+// @param length: The source's length in samples.
+// @param grainLength: The grain's length in samples.
+void GranularOscillator::spawnGrain (int startInBlock, bool cyclic, int length, int grainLength) noexcept
+{
+    if (numGrains == maxGrains)
+    {
+        return;
+    }
+
+    const float ratio = std::exp2 (parameters.pitch / 12.0f);
+    float where = parameters.position + parameters.spray * (nextRandom() - 0.5f);
+    float step;
+    float start;
+
+    if (cyclic)
+    {
+        // One cycle per note period, starting at a phase
+        step = frequency * ratio * (float) length / (float) sampleRate;
+        start = (where - std::floor (where)) * (float) length;
+    }
+    else
+    {
+        // The zone repitched to the note, starting early enough to fit
+        // where it can
+        const float end = (float) (length - 1);
+        step = frequency / rootFrequency * (float) (zone->sampleRate / sampleRate) * ratio;
+        start = juce::jlimit (0.0f, 1.0f, where) * end;
+        start = juce::jmax (0.0f, juce::jmin (start, end - step * (float) grainLength));
+    }
+
+    // Overlapping grains are uncorrelated enough to add in power
+    const float overlap = parameters.density * parameters.size;
+
+    const int g = numGrains++;
+    readPosition[g] = start;
+    increment[g] = step;
+    windowPosition[g] = 0.0f;
+    windowIncrement[g] = 1.0f / (float) grainLength;
+    gain[g] = 1.0f / std::sqrt (juce::jmax (1.0f, overlap));
+    remaining[g] = grainLength;
+    blockStart[g] = startInBlock;
+}
+
+// @return The next of the spray's xorshift random numbers, 0 to 1.
+float GranularOscillator::nextRandom() noexcept
+{
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return (float) (random >> 8) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,127 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for a granular oscillator,
+    which plays many short windowed grains of the custom wavetable or of the
+    loaded samples at once.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "RcuPointer.h"
+#include "SampleOscillator.h"
+#include "Wavetable.h"
+#include <JuceHeader.h>
+
+// Spawns Hann-windowed grains at a steady rate, each reading its source
+// from around the same position at the note's pitch, and sums them.
+//
+// Grains live in a fixed pool held as a structure of arrays, one array per
+// field, with the playing grains packed at the front. Each grain is
+// rendered across a whole block at once, its read position and window
+// worked out from the block's start rather than accumulated, so the inner
+// loop is branch free over plain arrays and vectorises. Finished grains
+// are removed by moving the last one into their slot. Nothing is allocated
+// and nothing is a per-grain object.
+class GranularOscillator
+{
+public:
+    enum class Source : juce::uint8
+    {
+        wavetable, // the custom wavetable, one cycle read at the note's pitch
+        sample // the resident opening of the loaded sample zone for the note
+    };
+
+    struct Parameters
+    {
+        float position = 0.5f; // where grains start in the source, 0 to 1
+        float pitch = 0.0f; // grain transposition from the note, -24 to 24 semitones
+        float density = 40.0f; // grains started per second, 1 to 1000
+        float size = 0.08f; // grain length, 0.005 to 0.5 seconds
+        float spray = 0.1f; // random spread of the start position, 0 to 1
+        Source source = Source::wavetable;
+    };
+
+    // Grains playing at once per voice; a grain due while the pool is full is skipped
+    static constexpr int maxGrains = 512;
+
+    void prepare (const juce::dsp::ProcessSpec&);
+    void setWavetableSource (RcuPointer<Wavetable>* table) noexcept { wavetable = table; }
+    void setSampleSource (RcuPointer<SampleMap>* sampleMap) noexcept { samples = sampleMap; }
+    void setParameters (const Parameters&) noexcept;
+    const Parameters& getParameters() const noexcept { return parameters; }
+    void noteOn (int, float, float) noexcept;
+    void setFrequency (float newFrequency) noexcept { frequency = newFrequency; }
+    void reset() noexcept;
+    void process (const juce::dsp::ProcessContextReplacing<float>&) noexcept;
+
+    int getNumGrains() const noexcept { return numGrains; }
+
+    // The running state only; the parameters are settings. The sample zone
+    // is not included, so grains of the sample source cannot be restored.
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        visit (frequency, untilNextGrain, random, numGrains);
+
+        // A restored count bounds the loop below, so keep it inside the pool
+        jassert (numGrains >= 0 && numGrains <= maxGrains);
+        numGrains = juce::jlimit (0, maxGrains, numGrains);
+
+        for (int g = 0; g < numGrains; ++g)
+        {
+            visit (readPosition[g], increment[g], windowPosition[g], windowIncrement[g], gain[g], remaining[g]);
+        }
+    }
+
+private:
+    template <bool cyclic>
+    void renderGrains (const float*, int, float*, int) noexcept;
+    void spawnGrain (int, bool, int, int) noexcept;
+    float nextRandom() noexcept;
+
+    RcuPointer<Wavetable>* wavetable = nullptr;
+    RcuPointer<SampleMap>* samples = nullptr;
+
+    // The sample map and zone of the playing note, dropped if the map is replaced
+    const SampleMap* playingMap = nullptr;
+    const SampleZone* zone = nullptr;
+    float rootFrequency = 440.0f;
+
+    Parameters parameters;
+    double sampleRate = 44100.0;
+    float frequency = 440.0f;
+    float untilNextGrain = 0.0f; // samples from the start of the next block
+    juce::uint32 random = 1;
+
+    // The grain pool. Positions are in source samples, windows run from 0
+    // to 1 over a grain, and remaining counts the grain's samples left.
+    int numGrains = 0;
+    alignas (16) float readPosition[maxGrains] {};
+    alignas (16) float increment[maxGrains] {};
+    alignas (16) float windowPosition[maxGrains] {};
+    alignas (16) float windowIncrement[maxGrains] {};
+    alignas (16) float gain[maxGrains] {};
+    alignas (16) int remaining[maxGrains] {};
+
+    // Where in the current block each grain starts: 0, or later for a grain
+    // spawned during it
+    alignas (16) int blockStart[maxGrains] {};
+};
@@ -0,0 +1,121 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the instantiation
+    benchmark, which measures how long a new instance takes to become
+    playable, as when a host loads a session.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "InstantiationBenchmark.h"
+
+#include <chrono>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince (Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli> (Clock::now() - start).count();
+}
+
+void addToStage (InstantiationBenchmark::Stage& stage, double ms, int numInstances)
+{
+    stage.meanMs += ms / numInstances;
+    stage.worstMs = juce::jmax (stage.worstMs, ms);
+}
+} // namespace
+
+// Runs the benchmark. The instances are deleted before returning.
+//
+// @param settings: The sample rate, block size and number of instances.
+// @return The time taken by each stage.
+InstantiationBenchmark::Report InstantiationBenchmark::run (const Settings& settings)
+{
+    Report report;
+    report.numInstances = juce::jmax (1, settings.numInstances);
+
+    const int blockSize = juce::jmax (1, settings.blockSize);
+    std::vector<std::unique_ptr<SubsynthAudioProcessor>> instances;
+
+    const auto sessionStart = Clock::now();
+
+    for (int i = 0; i < report.numInstances; ++i)
+    {
+        auto start = Clock::now();
+        auto processor = std::make_unique<SubsynthAudioProcessor>();
+        processor->enableAllBuses();
+        const double constructMs = millisecondsSince (start);
+
+        start = Clock::now();
+        processor->setRateAndBufferSizeDetails (settings.sampleRate, blockSize);
+        processor->prepareToPlay (settings.sampleRate, blockSize);
+        const double prepareMs = millisecondsSince (start);
+
+        // Render until the note is heard, or give up after a second
+        juce::AudioBuffer<float> buffer (processor->getTotalNumOutputChannels(), blockSize);
+        juce::MidiBuffer midi;
+        midi.addEvent (juce::MidiMessage::noteOn (1, 60, 0.8f), 0);
+
+        start = Clock::now();
+
+        for (int rendered = 0; rendered < settings.sampleRate; rendered += blockSize)
+        {
+            processor->processBlock (buffer, midi);
+            midi.clear();
+
+            if (buffer.getMagnitude (0, blockSize) > 0.001f)
+            {
+                break;
+            }
+        }
+
+        const double firstSoundMs = millisecondsSince (start);
+
+        addToStage (report.construct, constructMs, report.numInstances);
+        addToStage (report.prepare, prepareMs, report.numInstances);
+        addToStage (report.firstSound, firstSoundMs, report.numInstances);
+        addToStage (report.playable, constructMs + prepareMs + firstSoundMs, report.numInstances);
+
+        if (i == 0)
+        {
+            report.firstInstancePlayableMs = constructMs + prepareMs + firstSoundMs;
+        }
+
+        if (settings.withEditor)
+        {
+            start = Clock::now();
+            std::unique_ptr<juce::AudioProcessorEditor> editor (processor->createEditor());
+            editor = nullptr;
+            addToStage (report.editor, millisecondsSince (start), report.numInstances);
+        }
+
+        instances.push_back (std::move (processor));
+    }
+
+    report.totalMs = millisecondsSince (sessionStart);
+
+    for (auto& instance : instances)
+    {
+        instance->releaseResources();
+    }
+
+    return report;
+}
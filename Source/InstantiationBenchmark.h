@@ -0,0 +1,68 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the instantiation
+    benchmark, which measures how long a new instance takes to become
+    playable, as when a host loads a session.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "PluginProcessor.h"
+#include <JuceHeader.h>
+
+// Creates instances one after another, keeping them all alive like a host
+// session, and times each stage of bringing one up: construction,
+// prepareToPlay, and rendering until a note played at the start of the first
+// block is heard. Optionally also times creating and deleting an editor.
+//
+// Call on the message thread.
+class InstantiationBenchmark
+{
+public:
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 256;
+        int numInstances = 32;
+        bool withEditor = false;
+    };
+
+    // Milliseconds, as the mean over all instances and the worst instance
+    struct Stage
+    {
+        double meanMs = 0.0;
+        double worstMs = 0.0;
+    };
+
+    struct Report
+    {
+        int numInstances = 0;
+        Stage construct;
+        Stage prepare;
+        Stage firstSound;
+        Stage playable; // the sum of the three above
+        Stage editor;
+        double firstInstancePlayableMs = 0.0;
+        double totalMs = 0.0;
+    };
+
+    static Report run (const Settings&);
+};
@@ -0,0 +1,241 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for a nonlinear 4-pole
+    ladder low-pass filter with rational tanh saturation, processed across
+    all channels at once.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "LadderFilter.h"
+#include "FastMath.h"
+
+// Stores the sample rate and clears the filter state.
+//
+// @param spec: The prep info of the owning voice. At most numLanes channels.
+void LadderFilter::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    jassert (spec.numChannels <= (juce::uint32) numLanes);
+
+    sampleRate = spec.sampleRate;
+    setParameters (cutoff, feedback + 1.0f);
+    reset();
+}
+
+// Clears the integrator state of every stage.
+void LadderFilter::reset() noexcept
+{
+    for (auto& lanes : stage)
+    {
+        std::fill (std::begin (lanes), std::end (lanes), 0.0f);
+    }
+}
+
+// @return The integrator state of every stage, and the coefficients in use
+// with any ramp in progress, to be restored with setState.
+LadderFilter::State LadderFilter::getState() const noexcept
+{
+    State state;
+    std::copy (&stage[0][0], &stage[0][0] + 4 * numLanes, &state.stage[0][0]);
+    state.G = G;
+    state.feedback = feedback;
+    state.GStep = GStep;
+    state.feedbackStep = feedbackStep;
+    state.rampRemaining = rampRemaining;
+    return state;
+}
+
+// Puts the filter back where getState found it. The target of a ramp in
+// progress is left as it is.
+//
+// @param state: The state to restore.
+void LadderFilter::setState (const State& state) noexcept
+{
+    std::copy (&state.stage[0][0], &state.stage[0][0] + 4 * numLanes, &stage[0][0]);
+    G = state.G;
+    oneMinusG = 1.0f - G;
+    feedback = state.feedback;
+    GStep = state.GStep;
+    feedbackStep = state.feedbackStep;
+    rampRemaining = state.rampRemaining;
+}
+
+// Sets the cutoff and resonance. Cheap enough to call at control rate.
+//
+// @param cutoffHz: The cutoff frequency in Hz.
+// @param resonance: The resonance on the same 1 to 5 scale as the state
+// variable filter: 1 is none, 5 is just short of self-oscillation.
+void LadderFilter::setParameters (float cutoffHz, float resonance) noexcept
+{
+    cutoff = juce::jlimit (20.0f, (float) sampleRate * 0.45f, cutoffHz);
+    feedback = targetFeedback = juce::jlimit (0.0f, 3.95f, resonance - 1.0f);
+    G = targetG = toG (cutoff, sampleRate);
+    oneMinusG = 1.0f - G;
+    GStep = feedbackStep = 0.0f;
+    rampRemaining = 0;
+}
+
+// Moves the cutoff and resonance linearly, as G and the feedback, from
+// where they are to new values over the next numSamples samples, across
+// blocks if need be.
+//
+// @param cutoffHz: The cutoff frequency in Hz.
+// @param resonance: The resonance, 1 to 5, as for setParameters.
+// @param numSamples: The length of the ramp.
+void LadderFilter::rampTo (float cutoffHz, float resonance, int numSamples) noexcept
+{
+    if (numSamples <= 0)
+    {
+        setParameters (cutoffHz, resonance);
+        return;
+    }
+
+    cutoff = juce::jlimit (20.0f, (float) sampleRate * 0.45f, cutoffHz);
+    targetFeedback = juce::jlimit (0.0f, 3.95f, resonance - 1.0f);
+    targetG = toG (cutoff, sampleRate);
+    GStep = (targetG - G) / (float) numSamples;
+    feedbackStep = (targetFeedback - feedback) / (float) numSamples;
+    rampRemaining = numSamples;
+}
+
+// @param cutoffHz: A cutoff frequency in Hz, below half the sample rate.
+// @param sampleRate: The sample rate.
+// @return The one-pole TPT gain G = g / (1 + g) for it.
+float LadderFilter::toG (float cutoffHz, double sampleRate) noexcept
+{
+    const float g = std::tan (juce::MathConstants<float>::pi * cutoffHz / (float) sampleRate);
+    return g / (1.0f + g);
+}
+
+// Turns the tanh saturation on or off. Without it the filter is the linear
+// ladder, which costs about half as much per sample.
+//
+// @param shouldSaturate: True for the nonlinear filter.
+void LadderFilter::setSaturation (bool shouldSaturate) noexcept
+{
+    saturate = shouldSaturate;
+}
+
+// Filters a block in place.
+//
+// @param context: The block to be filtered.
+void LadderFilter::process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept
+{
+    auto& block = context.getOutputBlock();
+
+    if (saturate)
+    {
+        processSamples<true> (block);
+    }
+    else
+    {
+        processSamples<false> (block);
+    }
+}
+
+// Each sample solves the linear zero-delay feedback loop for the output
+// estimate, then runs four one-pole TPT stages, with the loop input and each
+// stage input saturated by FastMath::tanh when saturating. All the work for
+// one sample is done on numLanes channel lanes at once. While a ramp is in
+// progress the coefficients step every sample.
+//
+// @param block: The block to be filtered.
+template <bool saturating>
+void LadderFilter::processSamples (const juce::dsp::AudioBlock<float>& block) noexcept
+{
+    const int numChannels = juce::jmin ((int) block.getNumChannels(), numLanes);
+    const int numSamples = (int) block.getNumSamples();
+    const int rampLength = juce::jmin (rampRemaining, numSamples);
+
+    // Coefficients in locals, which the stores to the channels cannot alias
+    float g = G;
+    float oneMinusGain = oneMinusG;
+    float k = feedback;
+    float G2 = g * g;
+    float G3 = G2 * g;
+    float G4 = G2 * G2;
+    float loopGain = 1.0f / (1.0f + k * G4);
+
+    float* channels[numLanes] {};
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        channels[channel] = block.getChannelPointer ((size_t) channel);
+    }
+
+    alignas (16) float x[numLanes] {};
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        if (n < rampLength)
+        {
+            const bool last = n == rampRemaining - 1;
+            g = last ? targetG : g + GStep;
+            k = last ? targetFeedback : k + feedbackStep;
+            oneMinusGain = 1.0f - g;
+            G2 = g * g;
+            G3 = G2 * g;
+            G4 = G2 * G2;
+            loopGain = 1.0f / (1.0f + k * G4);
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            x[channel] = channels[channel][n];
+        }
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            const float sigma = oneMinusGain * (G3 * stage[0][lane] + G2 * stage[1][lane] + g * stage[2][lane] + stage[3][lane]);
+            const float estimate = (G4 * x[lane] + sigma) * loopGain;
+
+            float input = x[lane] - k * estimate;
+
+            if (saturating)
+            {
+                input = FastMath::tanh (input);
+            }
+
+            for (int i = 0; i < 4; ++i)
+            {
+                const float v = g * (input - stage[i][lane]);
+                const float y = v + stage[i][lane];
+                stage[i][lane] = y + v;
+                input = saturating && i < 3 ? FastMath::tanh (y) : y;
+            }
+
+            x[lane] = input;
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            channels[channel][n] = x[channel];
+        }
+    }
+
+    G = g;
+    oneMinusG = oneMinusGain;
+    feedback = k;
+    rampRemaining -= rampLength;
+
+    if (rampRemaining == 0)
+    {
+        GStep = feedbackStep = 0.0f;
+    }
+}
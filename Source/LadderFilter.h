@@ -0,0 +1,99 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for a nonlinear 4-pole ladder
+    low-pass filter with rational tanh saturation, processed across all
+    channels at once.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class LadderFilter
+{
+public:
+    // Channels are processed as lanes of one fixed-width group, padded up to
+    // this count, so every per-sample loop has a constant trip count
+    static constexpr int numLanes = 4;
+
+    // The stages, and the coefficients with their ramp while one is in progress
+    struct State
+    {
+        float stage[4][numLanes] {};
+        float G = 0.0f;
+        float feedback = 0.0f;
+        float GStep = 0.0f;
+        float feedbackStep = 0.0f;
+        int rampRemaining = 0;
+    };
+
+    void prepare (const juce::dsp::ProcessSpec&);
+    void reset() noexcept;
+    void setParameters (float, float) noexcept;
+    void rampTo (float, float, int) noexcept;
+    void setSaturation (bool) noexcept;
+    void process (const juce::dsp::ProcessContextReplacing<float>&) noexcept;
+
+    float getCutoff() const noexcept { return cutoff; }
+    float getFeedback() const noexcept { return feedback; }
+    bool isSaturating() const noexcept { return saturate; }
+
+    State getState() const noexcept;
+    void setState (const State&) noexcept;
+
+    // The stages and the coefficients, which modulation may have moved away
+    // from the patch's. Saturation follows the voice's quality setting.
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        visit (cutoff, feedback, G, oneMinusG, stage, rampRemaining);
+
+        if (rampRemaining > 0)
+        {
+            visit (targetG, targetFeedback, GStep, feedbackStep);
+        }
+    }
+
+private:
+    template <bool saturating>
+    void processSamples (const juce::dsp::AudioBlock<float>&) noexcept;
+    static float toG (float, double) noexcept;
+
+    double sampleRate = 44100.0;
+    float cutoff = 20000.0f;
+    float feedback = 0.0f;
+    bool saturate = true;
+
+    // One-pole TPT gain G = g / (1 + g), and 1 - G
+    float G = 0.0f;
+    float oneMinusG = 1.0f;
+
+    // A ramp of G and the feedback to those of cutoff and the resonance,
+    // for modulation at control rate
+    float targetG = 0.0f;
+    float targetFeedback = 0.0f;
+    float GStep = 0.0f;
+    float feedbackStep = 0.0f;
+    int rampRemaining = 0;
+
+    // Integrator state of each of the four stages, per lane
+    alignas (16) float stage[4][numLanes] {};
+};
@@ -0,0 +1,240 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the note latency
+    probe, a headless harness that plays single notes into the processor at
+    known sample positions and measures when each one is first heard.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "LatencyProbe.h"
+#include "LowLatencyMode.h"
+#include "RealtimeChecker.h"
+
+#include <chrono>
+#include <thread>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// When each note starts and stops, in samples from the start of the session
+struct ScheduledNote
+{
+    juce::int64 onSample;
+    juce::int64 offSample;
+};
+
+Clock::time_point getSampleTime (Clock::time_point start, juce::int64 sample, double sampleRate)
+{
+    return start + std::chrono::duration_cast<Clock::duration> (std::chrono::duration<double> (sample / sampleRate));
+}
+} // namespace
+
+// Plays the notes and measures them. Blocks until the session is over,
+// about a quarter second per note. Call on the message thread, which plays
+// the keyboard notes.
+//
+// @param processor: The processor to measure. It is prepared, set to an
+// instant attack square wave, and released again.
+// @param settings: The session's sample rate, block size, notes and MIDI source.
+// @return The latency distribution and callback times.
+LatencyProbe::Report LatencyProbe::run (SubsynthAudioProcessor& processor, const Settings& settings)
+{
+    class ProbeThread : public juce::Thread
+    {
+    public:
+        ProbeThread (SubsynthAudioProcessor& p, const Settings& s, const std::vector<ScheduledNote>& n, Clock::time_point t)
+            : juce::Thread ("Subsynth latency probe"), processor (p), settings (s), notes (n), start (t)
+        {
+            latenciesMs.reserve (notes.size());
+            noteOnCallbacksMs.reserve (notes.size());
+        }
+
+        void run() override
+        {
+            LowLatencyMode::promoteCurrentThread (LowLatencyMode::defaultPriority);
+            LowLatencyMode::prefaultStack();
+
+            const int blockSize = settings.blockSize;
+            juce::AudioBuffer<float> buffer (processor.getTotalNumOutputChannels(), blockSize);
+            juce::MidiBuffer midi;
+            midi.ensureSize (256);
+            LowLatencyMode::prefaultBuffer (buffer);
+
+            // Run on for as long again as the last note was held
+            const juce::int64 endSample = notes.back().offSample + notes.back().offSample - notes.back().onSample;
+            size_t nextEvent = 0; // host notes: index of the next note to send
+            size_t nextToDetect = 0;
+            double totalCallbackMs = 0.0;
+            int numCallbacks = 0;
+
+            for (juce::int64 blockStart = 0; blockStart < endSample && ! threadShouldExit(); blockStart += blockSize)
+            {
+                const juce::int64 blockEnd = blockStart + blockSize;
+                std::this_thread::sleep_until (getSampleTime (start, blockStart, settings.sampleRate));
+
+                if (settings.source == Source::host)
+                {
+                    for (; nextEvent < notes.size() && notes[nextEvent].onSample < blockEnd; ++nextEvent)
+                    {
+                        midi.addEvent (juce::MidiMessage::noteOn (1, 60, 0.8f), (int) (notes[nextEvent].onSample - blockStart));
+                    }
+
+                    for (size_t i = 0; i < nextEvent; ++i)
+                    {
+                        if (notes[i].offSample >= blockStart && notes[i].offSample < blockEnd)
+                        {
+                            midi.addEvent (juce::MidiMessage::noteOff (1, 60), (int) (notes[i].offSample - blockStart));
+                        }
+                    }
+                }
+
+                const auto callbackStart = Clock::now();
+                processor.processBlock (buffer, midi);
+                const double callbackMs = std::chrono::duration<double, std::milli> (Clock::now() - callbackStart).count();
+
+                midi.clear();
+                totalCallbackMs += callbackMs;
+                ++numCallbacks;
+
+                // A note not heard before it is released is given up on
+                while (nextToDetect < notes.size() && notes[nextToDetect].offSample <= blockStart)
+                {
+                    ++nextToDetect;
+                }
+
+                if (nextToDetect < notes.size() && notes[nextToDetect].onSample < blockEnd)
+                {
+                    const auto* samples = buffer.getReadPointer (0);
+                    const juce::int64 onSample = notes[nextToDetect].onSample;
+
+                    for (int i = (int) juce::jmax ((juce::int64) 0, onSample - blockStart); i < blockSize; ++i)
+                    {
+                        if (std::abs (samples[i]) > threshold)
+                        {
+                            latenciesMs.push_back (1000.0 * (double) (blockStart + i - onSample) / settings.sampleRate);
+                            noteOnCallbacksMs.push_back (callbackMs);
+                            ++nextToDetect;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            meanCallbackMs = numCallbacks > 0 ? totalCallbackMs / numCallbacks : 0.0;
+        }
+
+        std::vector<double> latenciesMs;
+        std::vector<double> noteOnCallbacksMs;
+        double meanCallbackMs = 0.0;
+
+    private:
+        SubsynthAudioProcessor& processor;
+        const Settings& settings;
+        const std::vector<ScheduledNote>& notes;
+        Clock::time_point start;
+    };
+
+    Report report;
+    report.numNotes = juce::jmax (1, settings.numNotes);
+    report.deadlineMs = 1000.0 * settings.blockSize / settings.sampleRate;
+
+    // Notes a whole number of blocks apart, each starting at a different
+    // position within its block
+    const int blockSize = juce::jmax (1, settings.blockSize);
+    const juce::int64 spacing = blockSize * (juce::int64) juce::jmax (1, juce::roundToInt (0.25 * settings.sampleRate / blockSize));
+    std::vector<ScheduledNote> notes;
+
+    for (int k = 0; k < report.numNotes; ++k)
+    {
+        const juce::int64 onSample = (k + 1) * spacing + (k * (juce::int64) blockSize) / report.numNotes;
+        notes.push_back ({ onSample, onSample + spacing / 2 });
+    }
+
+    processor.setRateAndBufferSizeDetails (settings.sampleRate, blockSize);
+    processor.prepareToPlay (settings.sampleRate, blockSize);
+    processor.changeWaveform (2);
+    processor.changeADSREnv ({ 0.0f, 0.05f, 1.0f, 0.02f });
+    RealtimeChecker::resetViolations();
+
+    {
+        const auto start = Clock::now() + std::chrono::milliseconds (50);
+        ProbeThread thread (processor, settings, notes, start);
+        thread.startThread();
+
+        // The message thread plays the on-screen keyboard, as the only
+        // producer of the processor's keyboard queue
+        if (settings.source == Source::keyboard)
+        {
+            JUCE_ASSERT_MESSAGE_THREAD
+
+            for (const auto& note : notes)
+            {
+                std::this_thread::sleep_until (getSampleTime (start, note.onSample, settings.sampleRate));
+                processor.addMidiEvent (juce::MidiMessage::noteOn (1, 60, 0.8f));
+                std::this_thread::sleep_until (getSampleTime (start, note.offSample, settings.sampleRate));
+                processor.addMidiEvent (juce::MidiMessage::noteOff (1, 60));
+            }
+        }
+
+        thread.waitForThreadToExit (-1);
+
+        report.numRealtimeViolations = RealtimeChecker::getNumViolations();
+        report.numDetected = (int) thread.latenciesMs.size();
+        report.meanCallbackMs = thread.meanCallbackMs;
+
+        auto latencies = thread.latenciesMs;
+
+        if (! latencies.empty())
+        {
+            std::sort (latencies.begin(), latencies.end());
+
+            auto percentile = [&latencies] (double p) {
+                return latencies[(size_t) juce::jmin ((int) latencies.size() - 1, (int) (p * (double) latencies.size()))];
+            };
+
+            report.minMs = latencies.front();
+            report.medianMs = percentile (0.5);
+            report.p99Ms = percentile (0.99);
+            report.maxMs = latencies.back();
+
+            double sum = 0.0, sumOfSquares = 0.0;
+
+            for (auto latency : latencies)
+            {
+                sum += latency;
+                sumOfSquares += latency * latency;
+            }
+
+            report.meanMs = sum / (double) latencies.size();
+            report.jitterMs = std::sqrt (juce::jmax (0.0, sumOfSquares / (double) latencies.size() - report.meanMs * report.meanMs));
+        }
+
+        for (auto callbackMs : thread.noteOnCallbacksMs)
+        {
+            report.meanNoteOnCallbackMs += callbackMs / (double) thread.noteOnCallbacksMs.size();
+            report.worstNoteOnCallbackMs = juce::jmax (report.worstNoteOnCallbackMs, callbackMs);
+        }
+    }
+
+    processor.releaseResources();
+
+    return report;
+}
@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the note latency probe,
+    a headless harness that plays single notes into the processor at known
+    sample positions and measures when each one is first heard.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "PluginProcessor.h"
+#include <JuceHeader.h>
+
+// Measures note-on to sound latency and its jitter.
+//
+// An audio thread calls processBlock in real time, as a device would. Notes
+// are spaced a quarter second apart and their start positions are swept
+// across the block. Each note's latency is the distance from its intended
+// sample to the first output sample above -60 dBFS, played as an instant
+// attack square wave so the onset is unambiguous.
+//
+// Host notes are placed in the block's MidiBuffer at their exact offsets.
+// Keyboard notes are queued with addMidiEvent from the message thread, which
+// run must be called on, at the wall-clock time of their intended sample, as
+// the on-screen keyboard would.
+class LatencyProbe
+{
+public:
+    enum class Source
+    {
+        host,
+        keyboard
+    };
+
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 32;
+        int numNotes = 40;
+        Source source = Source::host;
+    };
+
+    struct Report
+    {
+        int numNotes = 0;
+        int numDetected = 0;
+        double deadlineMs = 0.0;
+
+        // Latency distribution
+        double minMs = 0.0;
+        double medianMs = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+        double meanMs = 0.0;
+        double jitterMs = 0.0; // standard deviation
+
+        // Callback times, to show what starting a voice costs
+        double meanCallbackMs = 0.0;
+        double meanNoteOnCallbackMs = 0.0;
+        double worstNoteOnCallbackMs = 0.0;
+
+        int numRealtimeViolations = 0;
+    };
+
+    static constexpr float threshold = 0.001f;
+
+    static Report run (SubsynthAudioProcessor&, const Settings&);
+};
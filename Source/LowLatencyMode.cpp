@@ -0,0 +1,234 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the low-latency
+    standalone mode: real-time scheduling, locked memory and a null audio
+    device used to exercise the audio callback without hardware.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "LowLatencyMode.h"
+#include "RealtimeChecker.h"
+
+#include <chrono>
+#include <thread>
+
+#if JUCE_LINUX
+ #include <pthread.h>
+ #include <sched.h>
+ #include <sys/mman.h>
+#endif
+
+static std::atomic<bool> lowLatencyEnabled { false };
+
+// Indicates if the current platform supports the low-latency mode. Only Linux
+// exposes SCHED_FIFO and mlockall to an unprivileged (rtprio/memlock) user.
+bool LowLatencyMode::isAvailable()
+{
+#if JUCE_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Turns the low-latency mode on or off for every processor in this process.
+// Must be called before the processor is prepared to take effect.
+//
+// @param shouldBeEnabled: True to request real-time scheduling and locked memory.
+void LowLatencyMode::setEnabled (bool shouldBeEnabled)
+{
+    lowLatencyEnabled = shouldBeEnabled && isAvailable();
+}
+
+// Returns true if the low-latency mode has been requested for this process.
+bool LowLatencyMode::isEnabled()
+{
+    return lowLatencyEnabled;
+}
+
+// Locks all current and future pages of the process into RAM so the audio
+// callback can never take a major page fault.
+//
+// @return True if the memory was locked, else false (usually RLIMIT_MEMLOCK).
+bool LowLatencyMode::lockProcessMemory()
+{
+#if JUCE_LINUX
+    return mlockall (MCL_CURRENT | MCL_FUTURE) == 0;
+#else
+    return false;
+#endif
+}
+
+// Releases the memory locked by lockProcessMemory.
+void LowLatencyMode::unlockProcessMemory()
+{
+#if JUCE_LINUX
+    munlockall();
+#endif
+}
+
+// Moves the calling thread into the SCHED_FIFO real-time class.
+//
+// @param priority: The SCHED_FIFO priority, clamped to the range the OS allows.
+// @return True if the scheduler accepted the request, else false (usually RLIMIT_RTPRIO).
+bool LowLatencyMode::promoteCurrentThread (int priority)
+{
+#if JUCE_LINUX
+    sched_param param {};
+    param.sched_priority = juce::jlimit (sched_get_priority_min (SCHED_FIFO),
+                                         sched_get_priority_max (SCHED_FIFO),
+                                         priority);
+
+    return pthread_setschedparam (pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+    juce::ignoreUnused (priority);
+    return false;
+#endif
+}
+
+// Touches a chunk of the calling thread's stack so that the pages backing it
+// are resident before the first real-time callback needs them.
+void LowLatencyMode::prefaultStack()
+{
+    volatile char stackPages[64 * 1024];
+
+    for (size_t i = 0; i < sizeof (stackPages); i += 4096)
+    {
+        stackPages[i] = 0;
+    }
+}
+
+// Writes every sample of a buffer so the OS has to back it with real pages
+// now rather than on first use in the audio callback.
+//
+// @param buffer: The buffer to prefault, already sized to its largest use.
+void LowLatencyMode::prefaultBuffer (juce::AudioBuffer<float>& buffer)
+{
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+    {
+        juce::FloatVectorOperations::fill (buffer.getWritePointer (channel), 0.0f, buffer.getNumSamples());
+    }
+}
+
+// Drives a processor from a real-time thread paced like an audio device but
+// without any hardware, counting the callbacks that missed their deadline.
+// Used by the standalone's --null-device option and for testing.
+//
+// @param processor: The processor to run. It is prepared by this method.
+// @param sampleRate: The sample rate of the simulated device.
+// @param blockSize: The number of samples per simulated callback.
+// @param seconds: The length of the session.
+// @return A summary of the session.
+LowLatencyMode::NullDeviceReport LowLatencyMode::runOnNullDevice (juce::AudioProcessor& processor, double sampleRate, int blockSize, double seconds)
+{
+    class NullDeviceThread : public juce::Thread
+    {
+    public:
+        NullDeviceThread (juce::AudioProcessor& p, double rate, int size, double length)
+            : juce::Thread ("Subsynth null device"), processor (p), sampleRate (rate), blockSize (size)
+        {
+            report.numBlocks = juce::roundToInt (length * sampleRate / blockSize);
+            report.deadlineMs = 1000.0 * blockSize / sampleRate;
+        }
+
+        void run() override
+        {
+            using Clock = std::chrono::steady_clock;
+
+            report.realtimeGranted = promoteCurrentThread (defaultPriority);
+            prefaultStack();
+
+            juce::AudioBuffer<float> buffer (processor.getTotalNumOutputChannels(), blockSize);
+            juce::MidiBuffer midi;
+            midi.ensureSize (256);
+            prefaultBuffer (buffer);
+
+            // Play a chord every quarter second so the voices are kept busy
+            const int blocksPerChord = juce::jmax (1, juce::roundToInt (0.25 * sampleRate / blockSize));
+            const auto period = std::chrono::duration_cast<Clock::duration> (std::chrono::duration<double> (blockSize / sampleRate));
+            auto deadline = Clock::now();
+
+            for (int block = 0; block < report.numBlocks && ! threadShouldExit(); ++block)
+            {
+                deadline += period;
+
+                if (block % blocksPerChord == 0)
+                {
+                    const int root = 48 + (block / blocksPerChord) % 24;
+
+                    for (int note : { root, root + 4, root + 7 })
+                    {
+                        midi.addEvent (juce::MidiMessage::noteOn (1, note, 0.8f), 0);
+                    }
+                }
+                else if (block % blocksPerChord == blocksPerChord / 2)
+                {
+                    midi.addEvent (juce::MidiMessage::allNotesOff (1), 0);
+                }
+
+                const auto start = Clock::now();
+                processor.processBlock (buffer, midi);
+                const auto end = Clock::now();
+
+                midi.clear();
+
+                const double callbackMs = std::chrono::duration<double, std::milli> (end - start).count();
+                report.worstCallbackMs = juce::jmax (report.worstCallbackMs, callbackMs);
+
+                if (end > deadline)
+                {
+                    ++report.numOverruns;
+                    deadline = end;
+                }
+
+                std::this_thread::sleep_until (deadline);
+            }
+        }
+
+        NullDeviceReport report;
+
+    private:
+        juce::AudioProcessor& processor;
+        double sampleRate;
+        int blockSize;
+    };
+
+    NullDeviceReport report;
+    report.memoryLocked = lockProcessMemory();
+
+    processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+    processor.prepareToPlay (sampleRate, blockSize);
+    RealtimeChecker::resetViolations();
+
+    {
+        NullDeviceThread thread (processor, sampleRate, blockSize, seconds);
+        thread.startThread();
+        thread.waitForThreadToExit (-1);
+
+        const bool memoryLocked = report.memoryLocked;
+        report = thread.report;
+        report.memoryLocked = memoryLocked;
+        report.numRealtimeViolations = RealtimeChecker::getNumViolations();
+    }
+
+    processor.releaseResources();
+
+    return report;
+}
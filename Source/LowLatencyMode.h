@@ -0,0 +1,62 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the low-latency
+    standalone mode: real-time scheduling, locked memory and a null audio
+    device used to exercise the audio callback without hardware.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class LowLatencyMode
+{
+public:
+    // SCHED_FIFO priority requested for the audio callback thread
+    static constexpr int defaultPriority = 80;
+
+    // Smallest block size the standalone will ask the audio device for
+    static constexpr int minimumBlockSize = 32;
+
+    static bool isAvailable();
+    static void setEnabled (bool);
+    static bool isEnabled();
+
+    static bool lockProcessMemory();
+    static void unlockProcessMemory();
+    static bool promoteCurrentThread (int);
+    static void prefaultStack();
+    static void prefaultBuffer (juce::AudioBuffer<float>&);
+
+    // Results of running a processor against the null audio device
+    struct NullDeviceReport
+    {
+        int numBlocks = 0;
+        int numOverruns = 0;
+        int numRealtimeViolations = 0;
+        double deadlineMs = 0.0;
+        double worstCallbackMs = 0.0;
+        bool realtimeGranted = false;
+        bool memoryLocked = false;
+    };
+
+    static NullDeviceReport runOnNullDevice (juce::AudioProcessor&, double, int, double);
+};
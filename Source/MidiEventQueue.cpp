@@ -0,0 +1,187 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for a lock-free queue
+    of MIDI events, and for the injector that uses it to pass the on-screen
+    keyboard's notes to the audio thread without sharing a lock with it.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "MidiEventQueue.h"
+
+// Producer: adds a message to the back of the queue.
+//
+// @param message: The message. Longer than three bytes (sysex) is rejected.
+// @param timeMs: When the message happened, on the
+// juce::Time::getMillisecondCounterHiRes clock.
+// @return False if the message was rejected or the queue was full.
+bool MidiEventQueue::push (const juce::MidiMessage& message, double timeMs) noexcept
+{
+    const int numBytes = message.getRawDataSize();
+
+    if (numBytes > 3)
+    {
+        return false;
+    }
+
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite (1, start1, size1, start2, size2);
+
+    if (size1 + size2 == 0)
+    {
+        return false;
+    }
+
+    auto& event = events[size1 > 0 ? start1 : start2];
+    std::copy (message.getRawData(), message.getRawData() + numBytes, event.data);
+    event.numBytes = numBytes;
+    event.timeMs = timeMs;
+
+    fifo.finishedWrite (1);
+    return true;
+}
+
+// Consumer: takes the message at the front of the queue.
+//
+// @param event: Receives the message.
+// @return False if the queue was empty.
+bool MidiEventQueue::pop (Event& event) noexcept
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead (1, start1, size1, start2, size2);
+
+    if (size1 + size2 == 0)
+    {
+        return false;
+    }
+
+    event = events[size1 > 0 ? start1 : start2];
+
+    fifo.finishedRead (1);
+    return true;
+}
+
+//==============================================================================
+
+MidiInjector::MidiInjector (juce::MidiKeyboardState& state)
+    : keyState (state)
+{
+    keyState.addListener (this);
+    startTimerHz (30);
+}
+
+MidiInjector::~MidiInjector()
+{
+    keyState.removeListener (this);
+}
+
+// Message thread: queues an event for the next block, e.g. from a MIDI
+// source other than the host or the on-screen keyboard. The queue has a
+// single producer, so it must not be called from any other thread.
+//
+// @param message: A short (up to three byte) MIDI message.
+void MidiInjector::addEvent (const juce::MidiMessage& message)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    toAudio.push (message, juce::Time::getMillisecondCounterHiRes());
+}
+
+// Forgets the previous block's time, so the next block places queued events
+// at its start. Call while audio is stopped, e.g. from prepareToPlay.
+void MidiInjector::reset() noexcept
+{
+    lastBlockTimeMs = 0.0;
+}
+
+// Audio thread: builds the block's MIDI from the host's events and those
+// queued since the previous block. Queued events keep their spacing: one
+// that arrived a third of the way between the previous block and this one is
+// played a third of the way into this block.
+//
+// @param hostMidi: The host's events for this block.
+// @param blockMidi: Cleared and filled with the merged events. Should have
+// storage reserved, so adding to it does not allocate.
+// @param numSamples: The length of the block.
+void MidiInjector::processNextMidiBuffer (const juce::MidiBuffer& hostMidi, juce::MidiBuffer& blockMidi, int numSamples) noexcept
+{
+    const double nowMs = juce::Time::getMillisecondCounterHiRes();
+    const double intervalMs = nowMs - lastBlockTimeMs;
+
+    blockMidi.clear();
+
+    for (const auto metadata : hostMidi)
+    {
+        blockMidi.addEvent (metadata.data, metadata.numBytes, metadata.samplePosition);
+
+        if (metadata.numBytes == 3 && ((metadata.data[0] & 0xf0) == 0x90 || (metadata.data[0] & 0xf0) == 0x80))
+        {
+            toDisplay.push (metadata.getMessage(), nowMs);
+        }
+    }
+
+    MidiEventQueue::Event event;
+
+    while (toAudio.pop (event))
+    {
+        int position = 0;
+
+        if (lastBlockTimeMs > 0.0 && intervalMs > 0.0)
+        {
+            position = juce::jlimit (0, numSamples - 1, (int) ((event.timeMs - lastBlockTimeMs) / intervalMs * numSamples));
+        }
+
+        blockMidi.addEvent (event.data, event.numBytes, position);
+    }
+
+    lastBlockTimeMs = nowMs;
+}
+
+// Message thread: a key on the on-screen keyboard was pressed.
+void MidiInjector::handleNoteOn (juce::MidiKeyboardState*, int midiChannel, int midiNoteNumber, float velocity)
+{
+    if (! showingHostEvents)
+    {
+        addEvent (juce::MidiMessage::noteOn (midiChannel, midiNoteNumber, velocity));
+    }
+}
+
+// Message thread: a key on the on-screen keyboard was released.
+void MidiInjector::handleNoteOff (juce::MidiKeyboardState*, int midiChannel, int midiNoteNumber, float velocity)
+{
+    if (! showingHostEvents)
+    {
+        addEvent (juce::MidiMessage::noteOff (midiChannel, midiNoteNumber, velocity));
+    }
+}
+
+// Message thread: shows the notes the host has played on the keyboard state.
+void MidiInjector::timerCallback()
+{
+    MidiEventQueue::Event event;
+
+    showingHostEvents = true;
+
+    while (toDisplay.pop (event))
+    {
+        keyState.processNextMidiEvent (juce::MidiMessage (event.data, event.numBytes));
+    }
+
+    showingHostEvents = false;
+}
@@ -0,0 +1,91 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for a lock-free queue of MIDI
+    events, and for the injector that uses it to pass the on-screen keyboard's
+    notes to the audio thread without sharing a lock with it.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// Fixed-capacity single-producer, single-consumer queue of short MIDI
+// messages (up to three bytes), each stamped with the time it was pushed.
+// Neither side ever blocks; a push onto a full queue is dropped.
+class MidiEventQueue
+{
+public:
+    struct Event
+    {
+        juce::uint8 data[3];
+        int numBytes;
+        double timeMs; // juce::Time::getMillisecondCounterHiRes
+    };
+
+    static constexpr int capacity = 512;
+
+    bool push (const juce::MidiMessage&, double) noexcept;
+    bool pop (Event&) noexcept;
+    int getNumReady() const noexcept { return fifo.getNumReady(); }
+
+private:
+    juce::AbstractFifo fifo { capacity };
+    Event events[capacity] {};
+};
+
+// Carries MIDI that does not come from the host into processBlock.
+//
+// Notes played on the MidiKeyboardState (the on-screen keyboard), and events
+// passed to addEvent, go into a queue the audio thread drains at the start
+// of each block. The message thread is the queue's only producer, so both
+// must come from it. In the other direction, host notes are queued back to the
+// message thread so the on-screen keyboard still shows them.
+class MidiInjector : private juce::MidiKeyboardState::Listener,
+                     private juce::Timer
+{
+public:
+    explicit MidiInjector (juce::MidiKeyboardState&);
+    ~MidiInjector() override;
+
+    void addEvent (const juce::MidiMessage&);
+    void reset() noexcept;
+    void processNextMidiBuffer (const juce::MidiBuffer&, juce::MidiBuffer&, int) noexcept;
+
+private:
+    void handleNoteOn (juce::MidiKeyboardState*, int, int, float) override;
+    void handleNoteOff (juce::MidiKeyboardState*, int, int, float) override;
+    void timerCallback() override;
+
+    juce::MidiKeyboardState& keyState;
+
+    // Message thread to audio thread, and back for display
+    MidiEventQueue toAudio;
+    MidiEventQueue toDisplay;
+
+    // Audio thread: when the previous block's events were drained
+    double lastBlockTimeMs = 0.0;
+
+    // Message thread: set while host notes are shown on keyState, so they
+    // are not sent back to the audio thread
+    bool showingHostEvents = false;
+
+    JUCE_DECLARE_NON_COPYABLE (MidiInjector)
+};
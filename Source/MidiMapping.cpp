@@ -0,0 +1,247 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the MIDI
+    controller mapping, which routes hardware CCs to synth parameters and
+    learns new routes from the next controller moved.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "MidiMapping.h"
+
+// Scales a controller value to the range of its parameter, the range of the
+// matching control in the editor where there is one.
+//
+// @param parameter: The parameter being controlled.
+// @param normalised: The controller value, 0 to 1.
+// @return The value to pass to the processor: Hz for the cutoff, dB for the
+// volume, semitones for the grain pitch, grains per second for the density,
+// a ratio or level for the rest.
+double MidiMapping::toParameterValue (Parameter parameter, float normalised) noexcept
+{
+    const double x = juce::jlimit (0.0, 1.0, (double) normalised);
+
+    switch (parameter)
+    {
+        case Parameter::cutoff:
+            return 20.0 * std::pow (1000.0, x);
+
+        case Parameter::resonance:
+            return 1.0 + 4.0 * x;
+
+        case Parameter::volume:
+            return -50.0 + 50.0 * x;
+
+        case Parameter::fmRatio:
+            return 0.25 * std::pow (64.0, x);
+
+        case Parameter::fmIndex:
+            return 10.0 * x;
+
+        case Parameter::grainPitch:
+            return -24.0 + 48.0 * x;
+
+        case Parameter::grainDensity:
+            return std::pow (1000.0, x);
+
+        default:
+            return x;
+    }
+}
+
+// Routes a controller to a parameter, replacing any earlier route of that
+// controller.
+//
+// @param channel: The MIDI channel, 1 to 16.
+// @param controller: The controller number, 0 to 119.
+// @param parameter: The parameter, or Parameter::none to remove the route.
+void MidiMapping::map (int channel, int controller, Parameter parameter) noexcept
+{
+    if (channel >= 1 && channel <= numChannels && controller >= 0 && controller < numControllers)
+    {
+        const int previous = table[channel - 1][controller].exchange ((juce::uint8) parameter);
+
+        if (previous != (int) Parameter::none && previous != (int) parameter)
+        {
+            unmapped.fetch_or (1u << previous);
+        }
+    }
+}
+
+// Removes every route to a parameter.
+//
+// @param parameter: The parameter to stop controlling.
+void MidiMapping::unmap (Parameter parameter) noexcept
+{
+    for (auto& channel : table)
+    {
+        for (auto& entry : channel)
+        {
+            if (entry.load() == (juce::uint8) parameter)
+            {
+                entry.store ((juce::uint8) Parameter::none);
+            }
+        }
+    }
+
+    unmapped.fetch_or (1u << (int) parameter);
+}
+
+// Removes every route.
+void MidiMapping::clear() noexcept
+{
+    for (auto& channel : table)
+    {
+        for (auto& entry : channel)
+        {
+            entry.store ((juce::uint8) Parameter::none);
+        }
+    }
+
+    // Every parameter but none
+    unmapped.store ((1u << numParameters) - 2);
+}
+
+// Routes the next controller that moves, on any channel, to a parameter.
+//
+// @param parameter: The parameter to learn, or Parameter::none to cancel learning.
+void MidiMapping::startLearning (Parameter parameter) noexcept
+{
+    learning.store ((juce::uint8) parameter);
+}
+
+// @param channel: The MIDI channel, 1 to 16.
+// @param controller: The controller number.
+// @return The parameter the controller is routed to, or Parameter::none.
+MidiMapping::Parameter MidiMapping::getMapping (int channel, int controller) const noexcept
+{
+    if (channel < 1 || channel > numChannels || controller < 0 || controller >= numControllers)
+    {
+        return Parameter::none;
+    }
+
+    return (Parameter) table[channel - 1][controller].load();
+}
+
+// Sets the smoothing time and forgets the controller values. Call before playback.
+//
+// @param sampleRate: The rate of the samples getNextValue is advanced by.
+void MidiMapping::prepare (double sampleRate)
+{
+    for (int i = 0; i < numParameters; ++i)
+    {
+        values[i].reset (sampleRate, 0.02);
+        received[i] = false;
+        changed[i] = false;
+    }
+}
+
+// Routes a controller message, learning it first if a parameter is waiting
+// to be learnt. Constant time, and allocation and lock free.
+//
+// @param channel: The MIDI channel, 1 to 16.
+// @param controller: The controller number.
+// @param value: The controller value, 0 to 1.
+// @return True if the controller is routed to a parameter.
+bool MidiMapping::handleController (int channel, int controller, float value) noexcept
+{
+    if (channel < 1 || channel > numChannels || controller < 0 || controller >= numControllers)
+    {
+        return false;
+    }
+
+    auto& entry = table[channel - 1][controller];
+
+    // Taken in one exchange, so a cancel cannot land between the test and
+    // the store. The route replaced is released as map() releases it.
+    if (learning.load (std::memory_order_relaxed) != (juce::uint8) Parameter::none)
+    {
+        const auto learned = learning.exchange ((juce::uint8) Parameter::none);
+
+        if (learned != (juce::uint8) Parameter::none)
+        {
+            const int previous = entry.exchange (learned);
+
+            if (previous != (int) Parameter::none && previous != (int) learned)
+            {
+                unmapped.fetch_or (1u << previous);
+            }
+        }
+    }
+
+    const int parameter = entry.load (std::memory_order_relaxed);
+
+    if (parameter == (int) Parameter::none)
+    {
+        return false;
+    }
+
+    if (received[parameter])
+    {
+        values[parameter].setTargetValue (value);
+    }
+    else
+    {
+        values[parameter].setCurrentAndTargetValue (value);
+        received[parameter] = true;
+    }
+
+    changed[parameter] = true;
+    return true;
+}
+
+// Advances a parameter's smoothed value.
+//
+// @param parameter: The parameter to advance.
+// @param numSamples: The number of samples since the last call.
+// @param value: Set to the new value, 0 to 1, if it changed.
+// @return True if the value changed and should be applied.
+bool MidiMapping::getNextValue (Parameter parameter, int numSamples, float& value) noexcept
+{
+    const int index = (int) parameter;
+
+    if (! changed[index])
+    {
+        return false;
+    }
+
+    value = values[index].skip (numSamples);
+    changed[index] = values[index].isSmoothing();
+    return true;
+}
+
+// Takes the parameters unmapped since the last call, and forgets their
+// controller values, so a parameter mapped again takes its first value at once.
+//
+// @return One bit per unmapped parameter, bit n for Parameter n.
+juce::uint32 MidiMapping::takeUnmapped() noexcept
+{
+    const auto bits = unmapped.exchange (0);
+
+    for (int i = 1; i < numParameters; ++i)
+    {
+        if ((bits & (1u << i)) != 0)
+        {
+            received[i] = false;
+            changed[i] = false;
+        }
+    }
+
+    return bits;
+}
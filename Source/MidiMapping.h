@@ -0,0 +1,108 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the MIDI controller
+    mapping, which routes hardware CCs to synth parameters and learns new
+    routes from the next controller moved.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "RampedValue.h"
+#include <JuceHeader.h>
+
+// Routes MIDI CCs to synth parameters. Each of the 16 MIDI channels has a
+// flat table of 128 entries, one per controller number, so a controller is
+// dispatched with one lookup however many are mapped. The tables are atomics:
+// the message thread edits them and the audio thread reads them, without
+// locks, and a flood of controller messages costs one lookup and one
+// smoother update each.
+//
+// Each parameter's value is smoothed over 20 ms, advanced a block at a time
+// on the audio thread, so a coarse 7-bit controller does not step audibly.
+class MidiMapping
+{
+public:
+    enum class Parameter : juce::uint8
+    {
+        none,
+        cutoff,
+        resonance,
+        volume,
+        subLevel,
+        noiseLevel,
+        fmRatio,
+        fmIndex,
+        grainPosition,
+        grainPitch,
+        grainDensity,
+        grainSpray,
+        numParameters
+    };
+
+    static constexpr int numParameters = (int) Parameter::numParameters;
+    static constexpr int numChannels = 16;
+
+    // Controllers 120 and up are channel mode messages, not controls
+    static constexpr int numControllers = 120;
+
+    static double toParameterValue (Parameter, float) noexcept;
+
+    // Message thread
+    void map (int, int, Parameter) noexcept;
+    void unmap (Parameter) noexcept;
+    void clear() noexcept;
+    void startLearning (Parameter) noexcept;
+    bool isLearning() const noexcept { return learning.load() != (juce::uint8) Parameter::none; }
+    Parameter getMapping (int, int) const noexcept;
+
+    // Audio thread
+    void prepare (double);
+    bool handleController (int, int, float) noexcept;
+    bool getNextValue (Parameter, int, float&) noexcept;
+    juce::uint32 takeUnmapped() noexcept;
+
+    // The smoothed controller values; the mapping table is configuration
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        for (auto& value : values)
+        {
+            value.visitState (visit);
+        }
+
+        visit (received, changed);
+    }
+
+private:
+    std::atomic<juce::uint8> table[numChannels][numControllers] {};
+    std::atomic<juce::uint8> learning { (juce::uint8) Parameter::none };
+
+    // One bit per parameter whose route was removed, for the audio thread
+    // to put back to the patch's setting
+    std::atomic<juce::uint32> unmapped { 0 };
+
+    // Per parameter: the controller value, 0 to 1, whether one has been
+    // received, so the first is taken at once rather than glided to, and
+    // whether the value has moved since it was last applied
+    RampedValue values[numParameters];
+    bool received[numParameters] {};
+    bool changed[numParameters] {};
+};
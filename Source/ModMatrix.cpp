@@ -0,0 +1,164 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the modulation
+    matrix. Routes are edited on the message thread and compiled into a flat
+    list of per-block vector operations that each voice runs on the audio
+    thread.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "ModMatrix.h"
+
+// Flattens a set of routes: each distinct source becomes one slot that is
+// generated once per block, and each route becomes one multiply-add from a
+// source slot into a destination. Routes with no depth are dropped.
+//
+// @param routes: The routes as edited by the user.
+// @param lfoRates: The rates of LFO 1 and LFO 2 in Hz.
+// @return The compiled matrix. Never nullptr, but may be empty.
+std::unique_ptr<CompiledModMatrix> CompiledModMatrix::compile (const std::vector<ModRoute>& routes, const float* lfoRates)
+{
+    auto matrix = std::make_unique<CompiledModMatrix>();
+    matrix->lfoRates[0] = lfoRates[0];
+    matrix->lfoRates[1] = lfoRates[1];
+
+    for (auto& route : routes)
+    {
+        const float depth = juce::jlimit (-1.0f, 1.0f, route.depth);
+
+        if (depth == 0.0f)
+        {
+            continue;
+        }
+
+        const int ccNumber = route.source == ModSource::midiCC ? juce::jlimit (0, 127, route.ccNumber) : 0;
+
+        auto slot = std::find_if (matrix->sources.begin(), matrix->sources.end(), [&] (const SourceSlot& s) {
+            return s.type == route.source && s.ccNumber == ccNumber;
+        });
+
+        if (slot == matrix->sources.end())
+        {
+            if ((int) matrix->sources.size() == maxSourceSlots)
+            {
+                continue;
+            }
+
+            slot = matrix->sources.insert (slot, { route.source, ccNumber });
+        }
+
+        matrix->operations.push_back ({ (int) std::distance (matrix->sources.begin(), slot), (int) route.destination, depth });
+        matrix->destinationMask |= 1u << (int) route.destination;
+        matrix->readsControllers |= route.source == ModSource::midiCC;
+    }
+
+    return matrix;
+}
+
+// Generates every source slot for the next block, then runs the route
+// operations to sum them into the destination channels of the scratch buffer.
+// Channel d (0 to numDestinations - 1) holds destination d, one value per
+// control tick taken at the end of the tick. Destinations that are not
+// modulated are left untouched.
+//
+// @param state: The voice's inputs; LFO phases and the envelope are advanced.
+// @param scratch: At least numScratchChannels channels, one sample per tick.
+// @param numSamples: The number of audio samples in the block.
+// @param samplesPerTick: The control interval. The last tick may be shorter.
+void CompiledModMatrix::process (ModVoiceState& state, juce::AudioBuffer<float>& scratch, int numSamples, int samplesPerTick) const noexcept
+{
+    const int numTicks = (numSamples + samplesPerTick - 1) / samplesPerTick;
+
+    auto getTickLength = [=] (int tick) { return juce::jmin (samplesPerTick, numSamples - tick * samplesPerTick); };
+
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        auto* slot = scratch.getWritePointer (numDestinations + (int) i);
+
+        switch (sources[i].type)
+        {
+            case ModSource::lfo1:
+            case ModSource::lfo2:
+            {
+                const int lfo = sources[i].type == ModSource::lfo1 ? 0 : 1;
+                const double increment = juce::MathConstants<double>::twoPi * lfoRates[lfo] / state.sampleRate;
+                double phase = state.lfoPhase[lfo];
+
+                for (int tick = 0; tick < numTicks; ++tick)
+                {
+                    phase += increment * getTickLength (tick);
+
+                    while (phase >= juce::MathConstants<double>::pi)
+                    {
+                        phase -= juce::MathConstants<double>::twoPi;
+                    }
+
+                    slot[tick] = juce::dsp::FastMathApproximations::sin ((float) phase);
+                }
+
+                state.lfoPhase[lfo] = phase;
+                break;
+            }
+
+            case ModSource::envelope:
+                // The envelope still advances every sample; its value is taken once per tick
+                for (int tick = 0; tick < numTicks; ++tick)
+                {
+                    float level = 0.0f;
+
+                    for (int n = getTickLength (tick); n > 0; --n)
+                    {
+                        level = state.envelope->getNextSample();
+                    }
+
+                    slot[tick] = level;
+                }
+                break;
+
+            case ModSource::velocity:
+                juce::FloatVectorOperations::fill (slot, state.velocity, numTicks);
+                break;
+
+            case ModSource::keyTrack:
+                juce::FloatVectorOperations::fill (slot, state.keyTrack, numTicks);
+                break;
+
+            case ModSource::midiCC:
+                juce::FloatVectorOperations::fill (slot, state.midiControllers != nullptr ? state.midiControllers[sources[i].ccNumber] : 0.0f, numTicks);
+                break;
+        }
+    }
+
+    for (int destination = 0; destination < numDestinations; ++destination)
+    {
+        if ((destinationMask & (1u << destination)) != 0)
+        {
+            juce::FloatVectorOperations::clear (scratch.getWritePointer (destination), numTicks);
+        }
+    }
+
+    for (auto& op : operations)
+    {
+        juce::FloatVectorOperations::addWithMultiply (scratch.getWritePointer (op.destination),
+                                                      scratch.getReadPointer (numDestinations + op.sourceSlot),
+                                                      op.depth,
+                                                      numTicks);
+    }
+}
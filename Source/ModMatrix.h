@@ -0,0 +1,115 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the modulation matrix.
+    Routes are edited on the message thread and compiled into a flat list of
+    per-block vector operations that each voice runs on the audio thread.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Envelope.h"
+#include <JuceHeader.h>
+
+enum class ModSource
+{
+    lfo1,
+    lfo2,
+    envelope,
+    velocity,
+    keyTrack,
+    midiCC
+};
+
+// Each destination sums its routes into a value m, applied as:
+//   cutoff:    cutoff * 2^(5m)       (+/- 5 octaves at full depth)
+//   resonance: resonance + 4m
+//   gain:      gain * max(0, 1 + m)
+//   pitch:     frequency * 2^m       (+/- 1 octave at full depth)
+enum class ModDestination
+{
+    cutoff,
+    resonance,
+    gain,
+    pitch
+};
+
+// One connection in the matrix, as edited by the user
+struct ModRoute
+{
+    ModSource source = ModSource::lfo1;
+    ModDestination destination = ModDestination::cutoff;
+    float depth = 0.0f; // -1 to 1
+    int ccNumber = 1; // only used by ModSource::midiCC
+};
+
+// The per-voice inputs and state a compiled matrix reads and advances
+struct ModVoiceState
+{
+    double sampleRate = 44100.0;
+    float velocity = 0.0f;
+    float keyTrack = 0.0f;
+    double lfoPhase[2] {};
+    Envelope* envelope = nullptr;
+    const float* midiControllers = nullptr; // 128 values, 0 to 1
+};
+
+// An immutable, flattened form of a set of routes. Built off the audio thread
+// and published to the voices through an RcuPointer.
+class CompiledModMatrix
+{
+public:
+    static constexpr int numDestinations = 4;
+    static constexpr int maxSourceSlots = 12;
+
+    // Number of channels the scratch buffer passed to process must have
+    static constexpr int numScratchChannels = numDestinations + maxSourceSlots;
+
+    static std::unique_ptr<CompiledModMatrix> compile (const std::vector<ModRoute>&, const float*);
+
+    bool isEmpty() const noexcept { return operations.empty(); }
+    bool modulates (ModDestination destination) const noexcept { return (destinationMask & (1u << (int) destination)) != 0; }
+
+    // True if a route reads a MIDI CC, so the same note can modulate
+    // differently each time it is played
+    bool readsMidiControllers() const noexcept { return readsControllers; }
+
+    void process (ModVoiceState&, juce::AudioBuffer<float>&, int, int) const noexcept;
+
+private:
+    struct SourceSlot
+    {
+        ModSource type;
+        int ccNumber;
+    };
+
+    struct Operation
+    {
+        int sourceSlot;
+        int destination;
+        float depth;
+    };
+
+    std::vector<SourceSlot> sources;
+    std::vector<Operation> operations;
+    juce::uint32 destinationMask = 0;
+    bool readsControllers = false;
+    float lfoRates[2] {};
+};
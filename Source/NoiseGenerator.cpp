@@ -0,0 +1,125 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the voice noise
+    source: white noise from a multi-lane xorshift generator, optionally
+    shaped into pink noise.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "NoiseGenerator.h"
+
+// Each generator is seeded differently, so voices never play the same noise.
+NoiseGenerator::NoiseGenerator()
+{
+    auto& random = juce::Random::getSystemRandom();
+
+    for (auto& lane : state)
+    {
+        // xorshift must never be seeded with zero
+        lane = (juce::uint32) random.nextInt() | 1u;
+    }
+}
+
+// Clears the pink filter, e.g. at the start of a note.
+void NoiseGenerator::reset() noexcept
+{
+    std::fill (std::begin (pink), std::end (pink), 0.0f);
+}
+
+// Adds the same noise to every channel of a block.
+//
+// @param block: The samples to add to.
+// @param level: The gain applied to the noise; white noise peaks at +/-1.
+// @param colour: White, or pink with about the same RMS level as white.
+void NoiseGenerator::addTo (const juce::dsp::AudioBlock<float>& block, float level, Colour colour) noexcept
+{
+    constexpr int chunkSize = 64;
+    alignas (16) float noise[chunkSize];
+    const int numSamples = (int) block.getNumSamples();
+
+    for (int start = 0; start < numSamples; start += chunkSize)
+    {
+        const int length = juce::jmin (chunkSize, numSamples - start);
+        fillWhite (noise, length);
+
+        if (colour == Colour::pink)
+        {
+            float b0 = pink[0], b1 = pink[1], b2 = pink[2];
+
+            for (int i = 0; i < length; ++i)
+            {
+                const float white = noise[i];
+                b0 = 0.99765f * b0 + white * 0.0990460f;
+                b1 = 0.96300f * b1 + white * 0.2965164f;
+                b2 = 0.57000f * b2 + white * 1.0526913f;
+                noise[i] = 0.337f * (b0 + b1 + b2 + white * 0.1848f);
+            }
+
+            pink[0] = b0;
+            pink[1] = b1;
+            pink[2] = b2;
+        }
+
+        for (size_t channel = 0; channel < block.getNumChannels(); ++channel)
+        {
+            juce::FloatVectorOperations::addWithMultiply (block.getChannelPointer (channel) + start, noise, level, length);
+        }
+    }
+}
+
+// Fills an array with white noise between -1 and 1.
+//
+// @param destination: The samples to replace.
+// @param numSamples: The number of samples.
+void NoiseGenerator::fillWhite (float* destination, int numSamples) noexcept
+{
+    constexpr float scale = 1.0f / 2147483648.0f;
+    int done = 0;
+
+    // Use up what was left over from the previous call
+    for (; numSpare > 0 && done < numSamples; ++done)
+    {
+        destination[done] = spare[numLanes - numSpare--];
+    }
+
+    for (; done + numLanes <= numSamples; done += numLanes)
+    {
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            auto x = state[lane];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            state[lane] = x;
+            destination[done + lane] = (float) (juce::int32) x * scale;
+        }
+    }
+
+    if (done < numSamples)
+    {
+        fillWhite (spare, numLanes);
+        numSpare = numLanes;
+
+        for (; done < numSamples; ++done)
+        {
+            destination[done] = spare[numLanes - numSpare--];
+        }
+    }
+}
@@ -0,0 +1,67 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the voice noise source:
+    white noise from a multi-lane xorshift generator, optionally shaped into
+    pink noise.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class NoiseGenerator
+{
+public:
+    enum class Colour
+    {
+        white,
+        pink
+    };
+
+    // Independent xorshift32 generators advanced together, so the inner
+    // loop has a constant trip count and vectorises
+    static constexpr int numLanes = 4;
+
+    NoiseGenerator();
+
+    void reset() noexcept;
+    void addTo (const juce::dsp::AudioBlock<float>&, float, Colour) noexcept;
+
+    // The generator's position in its sequence carries from note to note,
+    // so it is saved along with the pink filter
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        visit (state, spare, numSpare, pink);
+    }
+
+private:
+    void fillWhite (float*, int) noexcept;
+
+    alignas (16) juce::uint32 state[numLanes] {};
+
+    // Scratch for one group of lanes when a block is not a whole number of them
+    alignas (16) float spare[numLanes] {};
+    int numSpare = 0;
+
+    // Pink filter state (Paul Kellet's economy filter)
+    float pink[3] {};
+};
@@ -0,0 +1,359 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the parallel
+    offline renderer, which splits a long MIDI render into segments rendered
+    on separate cores from checkpoints and stitched back bit-exactly.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "ParallelRender.h"
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+std::unique_ptr<SubsynthAudioProcessor> createProcessor (const ParallelRender::Settings& settings, const ParallelRender::SetUp& setUp, bool voicesOnly)
+{
+    auto processor = std::make_unique<SubsynthAudioProcessor>();
+    processor->enableAllBuses();
+    processor->setNonRealtime (true);
+    processor->setAttackCache (false);
+    processor->setEffectsBypassed (voicesOnly);
+    processor->prepareToPlay (settings.sampleRate, settings.blockSize);
+
+    if (setUp != nullptr)
+    {
+        setUp (*processor);
+    }
+
+    return processor;
+}
+
+// Renders samples start to end of a sequence, in blocks on the grid that
+// starts at sample 0, so every block matches one of a render from the top.
+//
+// @param processor: The processor, left where the last block ends.
+// @param sequence: The MIDI, with timestamps in samples.
+// @param output: Where the blocks go, or nullptr to discard them.
+// @param start: The first sample, on the block grid.
+// @param end: The sample after the last.
+// @param blockSize: The grid's block size.
+// @param leadIn: Events sent at the first block's first sample, before its own.
+void renderRange (SubsynthAudioProcessor& processor, const juce::MidiMessageSequence& sequence, juce::AudioBuffer<float>* output,
+                  int start, int end, int blockSize, const juce::MidiBuffer& leadIn)
+{
+    const int numChannels = processor.getTotalNumOutputChannels();
+    juce::AudioBuffer<float> scratch (numChannels, blockSize);
+    juce::MidiBuffer midi;
+    int next = sequence.getNextIndexAtTime ((double) start);
+
+    for (int position = start; position < end; position += blockSize)
+    {
+        const int length = juce::jmin (blockSize, end - position);
+        midi.clear();
+
+        if (position == start)
+        {
+            midi.addEvents (leadIn, 0, -1, 0);
+        }
+
+        for (; next < sequence.getNumEvents(); ++next)
+        {
+            const auto& message = sequence.getEventPointer (next)->message;
+
+            if (message.getTimeStamp() >= (double) (position + length))
+            {
+                break;
+            }
+
+            midi.addEvent (message, juce::jmax (0, (int) message.getTimeStamp() - position));
+        }
+
+        if (output != nullptr)
+        {
+            juce::AudioBuffer<float> block (output->getArrayOfWritePointers(), numChannels, position, length);
+            block.clear();
+            processor.processBlock (block, midi);
+        }
+        else
+        {
+            scratch.setSize (numChannels, length, false, false, true);
+            scratch.clear();
+            processor.processBlock (scratch, midi);
+        }
+    }
+}
+
+// Everything but notes before a time, to bring a processor's controllers,
+// pitch wheel and pedals up to date there.
+//
+// @param sequence: The MIDI, with timestamps in samples.
+// @param time: The sample the events must come before.
+// @return The events, all at sample 0.
+juce::MidiBuffer getControlsBefore (const juce::MidiMessageSequence& sequence, int time)
+{
+    juce::MidiBuffer controls;
+
+    for (int i = 0; i < sequence.getNumEvents(); ++i)
+    {
+        const auto& message = sequence.getEventPointer (i)->message;
+
+        if (message.getTimeStamp() >= (double) time)
+        {
+            break;
+        }
+
+        if (! message.isNoteOnOrOff())
+        {
+            controls.addEvent (message, 0);
+        }
+    }
+
+    return controls;
+}
+
+// Picks the samples to split a render at: block boundaries at least
+// targetLength apart, where no note has been held and no sustain pedal
+// down for quietLength samples.
+//
+// @return The splits, starting with 0 and ending with numSamples.
+std::vector<int> chooseSplits (const juce::MidiMessageSequence& sequence, int numSamples, int blockSize, int targetLength, int quietLength)
+{
+    std::vector<int> splits { 0 };
+    bool held[16][128] {};
+    bool pedal[16] {};
+    int numHeld = 0;
+    int numPedals = 0;
+    int quietSince = 0; // -1 while anything is held
+    int next = 0;
+
+    for (int split = blockSize; split < numSamples; split += blockSize)
+    {
+        for (; next < sequence.getNumEvents(); ++next)
+        {
+            const auto& message = sequence.getEventPointer (next)->message;
+            const int time = (int) message.getTimeStamp();
+            const int channel = message.getChannel() - 1;
+
+            if (time >= split)
+            {
+                break;
+            }
+
+            if (channel < 0)
+            {
+                continue;
+            }
+
+            if (message.isNoteOnOrOff())
+            {
+                bool& note = held[channel][message.getNoteNumber()];
+                numHeld += (message.isNoteOn() ? 1 : 0) - (note ? 1 : 0);
+                note = message.isNoteOn();
+            }
+            else if (message.isSustainPedalOn() || message.isSustainPedalOff())
+            {
+                numPedals += (message.isSustainPedalOn() ? 1 : 0) - (pedal[channel] ? 1 : 0);
+                pedal[channel] = message.isSustainPedalOn();
+            }
+            else if (message.isAllNotesOff() || message.isAllSoundOff())
+            {
+                for (auto& note : held[channel])
+                {
+                    numHeld -= note ? 1 : 0;
+                    note = false;
+                }
+            }
+
+            if (numHeld > 0 || numPedals > 0)
+            {
+                quietSince = -1;
+            }
+            else if (quietSince < 0)
+            {
+                quietSince = time;
+            }
+        }
+
+        if (quietSince >= 0 && split - quietSince >= quietLength && split - splits.back() >= targetLength)
+        {
+            splits.push_back (split);
+        }
+    }
+
+    splits.push_back (numSamples);
+    return splits;
+}
+} // namespace
+
+// Renders a sequence across every core, bit-exactly.
+//
+// @param sequence: The MIDI, with timestamps in samples at the settings' rate.
+// @param numSamples: The length of the render.
+// @param output: Resized to the processor's outputs and numSamples, and filled.
+// @param settings: The rate, block size, threads and where splits may go.
+// @param setUp: Sets up each processor's patch after it is prepared.
+// @return How many segments there were and how many had to be rendered again.
+ParallelRender::Report ParallelRender::render (const juce::MidiMessageSequence& sequence, int numSamples, juce::AudioBuffer<float>& output,
+                                               const Settings& settings, const SetUp& setUp)
+{
+    const auto start = Clock::now();
+    const int blockSize = juce::jmax (1, settings.blockSize);
+    const int numThreads = settings.numThreads > 0 ? settings.numThreads : juce::SystemStats::getNumCpus();
+
+    auto toBlocks = [&settings, blockSize] (double seconds) {
+        return blockSize * (int) std::ceil (seconds * settings.sampleRate / blockSize);
+    };
+
+    const int targetLength = juce::jmax (toBlocks (settings.minSegmentSeconds), numSamples / (2 * numThreads));
+    const int quietLength = toBlocks (settings.quietSeconds);
+    const auto splits = chooseSplits (sequence, numSamples, blockSize, targetLength, quietLength);
+
+    struct Segment
+    {
+        int start = 0;
+        int end = 0;
+        std::unique_ptr<SubsynthAudioProcessor> processor;
+        juce::MemoryBlock entry;
+        juce::MemoryBlock exit;
+    };
+
+    // The processors are all created and set up here, on the calling
+    // thread; the pool's threads only render
+    std::vector<Segment> segments (splits.size() - 1);
+
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        segments[i].start = splits[i];
+        segments[i].end = splits[i + 1];
+        segments[i].processor = createProcessor (settings, setUp, true);
+    }
+
+    // Every processor starts from the first one's state, so all their
+    // noise generators share its seeds
+    const auto initial = segments.front().processor->createCheckpoint();
+
+    if (initial.isEmpty())
+    {
+        segments.clear();
+        return renderSequential (sequence, numSamples, output, settings, setUp);
+    }
+
+    for (size_t i = 1; i < segments.size(); ++i)
+    {
+        segments[i].processor->restoreCheckpoint (initial);
+    }
+
+    output.setSize (segments.front().processor->getTotalNumOutputChannels(), numSamples);
+
+    {
+        juce::ThreadPool pool (numThreads);
+        juce::WaitableEvent finished;
+        std::atomic<int> remaining { (int) segments.size() };
+
+        for (size_t i = 0; i < segments.size(); ++i)
+        {
+            pool.addJob ([&, i] {
+                auto& segment = segments[i];
+
+                if (i > 0)
+                {
+                    const int preRollStart = juce::jmax (0, segment.start - quietLength);
+                    renderRange (*segment.processor, sequence, nullptr, preRollStart, segment.start, blockSize, getControlsBefore (sequence, preRollStart));
+                    segment.entry = segment.processor->createCheckpoint();
+                }
+
+                renderRange (*segment.processor, sequence, &output, segment.start, segment.end, blockSize, {});
+                segment.exit = segment.processor->createCheckpoint();
+
+                if (--remaining == 0)
+                {
+                    finished.signal();
+                }
+            });
+        }
+
+        finished.wait();
+    }
+
+    Report report;
+    report.numSegments = (int) segments.size();
+    report.checkpointed = true;
+
+    // Stitch in order: each segment either started where the one before
+    // ended, or is rendered again from there
+    for (size_t i = 1; i < segments.size(); ++i)
+    {
+        auto& segment = segments[i];
+
+        if (segment.entry == segments[i - 1].exit)
+        {
+            ++report.numVerified;
+            continue;
+        }
+
+        segment.processor->restoreCheckpoint (segments[i - 1].exit);
+        renderRange (*segment.processor, sequence, &output, segment.start, segment.end, blockSize, {});
+        segment.exit = segment.processor->createCheckpoint();
+        ++report.numRerendered;
+    }
+
+    // The first processor's effects have not run yet; they now run over the
+    // whole render, block by block as they would have in a single pass
+    auto& effects = *segments.front().processor;
+
+    for (int position = 0; position < numSamples; position += blockSize)
+    {
+        juce::AudioBuffer<float> block (output.getArrayOfWritePointers(), output.getNumChannels(), position, juce::jmin (blockSize, numSamples - position));
+        effects.applyEffects (block);
+    }
+
+    report.seconds = std::chrono::duration<double> (Clock::now() - start).count();
+    return report;
+}
+
+// Renders a sequence on one processor from the top, as a host would
+// offline: the reference a parallel render must match, and the fallback
+// for patches that cannot be checkpointed.
+//
+// @param sequence: The MIDI, with timestamps in samples at the settings' rate.
+// @param numSamples: The length of the render.
+// @param output: Resized to the processor's outputs and numSamples, and filled.
+// @param settings: The rate and block size; the rest is unused.
+// @param setUp: Sets up the processor's patch after it is prepared.
+// @return A report of one segment.
+ParallelRender::Report ParallelRender::renderSequential (const juce::MidiMessageSequence& sequence, int numSamples, juce::AudioBuffer<float>& output,
+                                                         const Settings& settings, const SetUp& setUp)
+{
+    const auto start = Clock::now();
+    auto processor = createProcessor (settings, setUp, false);
+
+    output.setSize (processor->getTotalNumOutputChannels(), numSamples);
+    renderRange (*processor, sequence, &output, 0, numSamples, juce::jmax (1, settings.blockSize), {});
+
+    Report report;
+    report.numSegments = 1;
+    report.seconds = std::chrono::duration<double> (Clock::now() - start).count();
+    return report;
+}
@@ -0,0 +1,76 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the parallel offline
+    renderer, which splits a long MIDI render into segments rendered on
+    separate cores from checkpoints and stitched back bit-exactly.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "PluginProcessor.h"
+#include <JuceHeader.h>
+#include <functional>
+
+// Renders a MIDI sequence offline on every core, to the same samples a
+// single processor rendering it block by block would produce.
+//
+// The sequence is split at block boundaries where nothing has been held
+// for a while. Each segment gets its own processor, which replays the
+// controllers that came before it, pre-rolls the quiet stretch and
+// checkpoints the voices where its segment starts, then renders it. That
+// start is a guess: the segments are stitched in order, and one whose
+// start checkpoint differs from the end checkpoint of the segment before
+// is rendered again from that end, so the result is exact whether or not
+// the guess held. Long releases or noise running through a split make
+// guesses fail and cost a re-render, never a wrong sample.
+//
+// The effects bus carries its state across splits and cannot be
+// checkpointed, so the voices render dry and the effects then run once
+// over the stitched output, on the same block grid. A patch that cannot be
+// checkpointed, such as sample playback, renders on one core.
+class ParallelRender
+{
+public:
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 512;
+        int numThreads = 0; // 0 for one per core
+        double minSegmentSeconds = 5.0;
+        double quietSeconds = 2.0; // before a split, and pre-rolled from it
+    };
+
+    struct Report
+    {
+        int numSegments = 0;
+        int numVerified = 0; // segments whose guessed start was right
+        int numRerendered = 0;
+        bool checkpointed = false;
+        double seconds = 0.0;
+    };
+
+    // Sets up the patch of a prepared processor. Every segment's processor
+    // must end up with the same patch, with any custom wavetable published.
+    using SetUp = std::function<void (SubsynthAudioProcessor&)>;
+
+    static Report render (const juce::MidiMessageSequence&, int, juce::AudioBuffer<float>&, const Settings&, const SetUp& = nullptr);
+    static Report renderSequential (const juce::MidiMessageSequence&, int, juce::AudioBuffer<float>&, const Settings&, const SetUp& = nullptr);
+};
@@ -28,10 +28,10 @@ using juce::roundToInt;
 
 //==============================================================================
 SubsynthAudioProcessorEditor::SubsynthAudioProcessorEditor (SubsynthAudioProcessor& p)
-    : AudioProcessorEditor (&p), audioProcessor (p), keyboard (audioProcessor.keyState, juce::MidiKeyboardComponent::horizontalKeyboard)
+    : AudioProcessorEditor (&p), audioProcessor (p)
 {
     // Set size of plugin and styling of interactive components
-    setSize (width, roundToInt (0.665f * width));
+    setSize (width, roundToInt (0.7882f * width));
 
     setGainStyle();
 
@@ -39,11 +39,18 @@ SubsynthAudioProcessorEditor::SubsynthAudioProcessorEditor (SubsynthAudioProcess
     waveSelect.addItem ("Square", 2);
     waveSelect.addItem ("Saw", 3);
     waveSelect.addItem ("Triangle", 4);
+    waveSelect.addItem ("Sample", CustomVoice::sampleWave);
+    waveSelect.addItem ("Custom", CustomVoice::customWave);
+    waveSelect.addItem ("FM", CustomVoice::fmWave);
+    waveSelect.addItem ("Granular", CustomVoice::granularWave);
     waveSelect.setSelectedId (1);
 
+    loadSamplesButton.onClick = [this] { chooseSamples(); };
+
     filterSelect.addItem ("Low Pass", 1);
     filterSelect.addItem ("Band Pass", 2);
     filterSelect.addItem ("High Pass", 3);
+    filterSelect.addItem ("Ladder", CustomVoice::ladderFilter);
     filterSelect.onChange = [this] { filterChanged(); };
     filterSelect.setSelectedId (1);
 
@@ -65,7 +72,7 @@ SubsynthAudioProcessorEditor::SubsynthAudioProcessorEditor (SubsynthAudioProcess
 
     // Expose interactive elements to UI/Editor
     addAndMakeVisible (&waveSelect);
-    addAndMakeVisible (&keyboard);
+    addAndMakeVisible (&loadSamplesButton);
     addAndMakeVisible (&adsrSliders);
     addAndMakeVisible (&gainSlide);
     addAndMakeVisible (&gainLabel);
@@ -80,9 +87,7 @@ SubsynthAudioProcessorEditor::SubsynthAudioProcessorEditor (SubsynthAudioProcess
     filterRes.addMouseListener (this, true);
     adsrSliders.addMouseListener (this, true);
     gainSlide.addListener (this);
-
-    // Waveform Visualiser
-    addAndMakeVisible (&p.wfVisualiser);
+    gainSlide.addMouseListener (this, true);
 
     // Setup color scheme of interactive elements
     getLookAndFeel().setColour (juce::Slider::thumbColourId, juce::Colours::blueviolet);
@@ -94,6 +99,49 @@ SubsynthAudioProcessorEditor::~SubsynthAudioProcessorEditor()
 {
 }
 
+// Creates the custom wave editor, the keyboard and the waveform visualiser
+// once the editor is first on screen. A host that opens an editor it does
+// not show, or a session that loads many instances, does not build them.
+void SubsynthAudioProcessorEditor::createDeferredComponents()
+{
+    if (keyboard != nullptr || ! isShowing())
+    {
+        return;
+    }
+
+    wavetableEditor = std::make_unique<WavetableComponent>();
+
+    // Edits are built into a wavetable off the message thread, so the pad can
+    // send every drag straight through
+    wavetableEditor->onCycleDrawn = [this] (const std::vector<float>& cycle) {
+        audioProcessor.setCustomWaveCycle (cycle);
+        waveSelect.setSelectedId (CustomVoice::customWave);
+    };
+    wavetableEditor->onHarmonicsEntered = [this] (const std::vector<float>& amplitudes) {
+        audioProcessor.setCustomWaveHarmonics (amplitudes);
+        waveSelect.setSelectedId (CustomVoice::customWave);
+    };
+
+    keyboard = std::make_unique<juce::MidiKeyboardComponent> (audioProcessor.keyState, juce::MidiKeyboardComponent::horizontalKeyboard);
+
+    addAndMakeVisible (keyboard.get());
+    addAndMakeVisible (wavetableEditor.get());
+    addAndMakeVisible (&audioProcessor.getVisualiser());
+    resized();
+}
+
+// Called when the editor is shown or hidden.
+void SubsynthAudioProcessorEditor::visibilityChanged()
+{
+    createDeferredComponents();
+}
+
+// Called when the editor is added to a window, which may already be showing.
+void SubsynthAudioProcessorEditor::parentHierarchyChanged()
+{
+    createDeferredComponents();
+}
+
 // Listens for changes on the `slider` parameter and sets
 // the Gain rotary's value.
 //
@@ -120,9 +168,49 @@ void SubsynthAudioProcessorEditor::comboBoxChanged (juce::ComboBox* combobox)
 // at the end of the event.
 //
 // @param event: A mouse event triggering the change
-void SubsynthAudioProcessorEditor::mouseDrag (const juce::MouseEvent&)
+void SubsynthAudioProcessorEditor::mouseDrag (const juce::MouseEvent& event)
 {
-    audioProcessor.changeADSREnv (adsrSliders.getEnvelope());
+    // The gain slider is only listened to for MIDI learn
+    if (event.eventComponent != &gainSlide)
+    {
+        audioProcessor.changeADSREnv (adsrSliders.getEnvelope());
+    }
+}
+
+// Offers MIDI learn when the cutoff, resonance or gain slider is
+// right-clicked: the next hardware controller moved is routed to it.
+//
+// @param event: A mouse event on one of the listened-to components
+void SubsynthAudioProcessorEditor::mouseDown (const juce::MouseEvent& event)
+{
+    if (! event.mods.isPopupMenu())
+    {
+        return;
+    }
+
+    auto parameter = MidiMapping::Parameter::none;
+
+    if (event.eventComponent == &filterCutoff)
+    {
+        parameter = MidiMapping::Parameter::cutoff;
+    }
+    else if (event.eventComponent == &filterRes)
+    {
+        parameter = MidiMapping::Parameter::resonance;
+    }
+    else if (event.eventComponent == &gainSlide)
+    {
+        parameter = MidiMapping::Parameter::volume;
+    }
+    else
+    {
+        return;
+    }
+
+    juce::PopupMenu menu;
+    menu.addItem ("MIDI Learn", [this, parameter] { audioProcessor.startMidiLearn (parameter); });
+    menu.addItem ("Forget MIDI Mapping", [this, parameter] { audioProcessor.clearMidiMapping (parameter); });
+    menu.showMenuAsync (juce::PopupMenu::Options());
 }
 
 // Calls the changeFilter method in the AudioProcessor to set filter type,
@@ -132,6 +220,24 @@ void SubsynthAudioProcessorEditor::filterChanged()
     audioProcessor.changeFilter (filterSelect.getSelectedId(), filterCutoff.getValue(), filterRes.getValue());
 }
 
+// Lets the user pick one or more WAV/AIFF files, loads them as the
+// multisample, and switches the waveform to sample playback.
+void SubsynthAudioProcessorEditor::chooseSamples()
+{
+    sampleChooser = std::make_unique<juce::FileChooser> ("Load samples", juce::File(), "*.wav;*.aif;*.aiff");
+
+    auto flags = juce::FileBrowserComponent::openMode
+                 | juce::FileBrowserComponent::canSelectFiles
+                 | juce::FileBrowserComponent::canSelectMultipleItems;
+
+    sampleChooser->launchAsync (flags, [this] (const juce::FileChooser& chooser) {
+        if (audioProcessor.loadSamples (chooser.getResults()))
+        {
+            waveSelect.setSelectedId (CustomVoice::sampleWave);
+        }
+    });
+}
+
 // Draws the content of the method on the GUI
 //
 // @param g: The graphics context that must be used to do the drawing operations.
@@ -153,6 +259,7 @@ void SubsynthAudioProcessorEditor::paint (juce::Graphics& g)
     g.drawText ("Filter", roundToInt (0.1894 * width), roundToInt (0.0353 * width), roundToInt (0.1176 * width), roundToInt (0.0353 * width), juce::Justification::centred);
     g.drawText ("ADSR Envelope", roundToInt (0.3298 * width), roundToInt (0.0353 * width), roundToInt (0.4706 * width), roundToInt (0.0353 * width), juce::Justification::centred);
     g.drawText ("Gain", roundToInt (0.8235 * width), roundToInt (0.0353 * width), roundToInt (0.1176 * width), roundToInt (0.0353 * width), juce::Justification::centred);
+    g.drawText ("Custom Wave", roundToInt (0.0118 * width), roundToInt (0.6647 * width), roundToInt (0.9765 * width), roundToInt (0.0353 * width), juce::Justification::centred);
 
     // Sub-component Titles
     g.setFont (0.0176f * width);
@@ -171,23 +278,32 @@ void SubsynthAudioProcessorEditor::resized()
 
     // Wave Selector
     waveSelect.setBounds (roundToInt (0.0618 * width), roundToInt (0.0706 * width), roundToInt (0.1059 * width), roundToInt (0.0235 * width));
-
-    // Keyboard
-    keyboard.setBounds (roundToInt (0.0118 * width), roundToInt (0.2412 * width), roundToInt (0.9765 * width), roundToInt (0.1765 * width));
+    loadSamplesButton.setBounds (roundToInt (0.0618 * width), roundToInt (0.1059 * width), roundToInt (0.1059 * width), roundToInt (0.0235 * width));
 
     // Filter Components
     filterSelect.setBounds (roundToInt (0.1894 * width), roundToInt (0.0706 * width), roundToInt (0.1176 * width), roundToInt (0.0235 * width));
     filterCutoff.setBounds (roundToInt (0.1894 * width), roundToInt (0.1118 * width), roundToInt (0.1176 * width), roundToInt (0.0588 * width));
     filterRes.setBounds (roundToInt (0.1894 * width), roundToInt (0.1647 * width), roundToInt (0.1176 * width), roundToInt (0.0588 * width));
 
-    // Waveform Visualiser
-    audioProcessor.wfVisualiser.setBounds (roundToInt (0.0118 * width), roundToInt (0.4235 * width), roundToInt (0.9765 * width), roundToInt (0.2353 * width));
-
     // ADSR Components
     adsrSliders.setBounds (roundToInt (0.3298 * width), roundToInt (0.0647 * width), roundToInt (0.4706 * width), roundToInt (0.1176 * width));
 
     // Gain Slider
     gainSlide.setBounds (roundToInt (0.8235 * width), roundToInt (0.0588 * width), roundToInt (0.1176 * width), roundToInt (0.1176 * width));
+
+    if (keyboard == nullptr)
+    {
+        return;
+    }
+
+    // Keyboard
+    keyboard->setBounds (roundToInt (0.0118 * width), roundToInt (0.2412 * width), roundToInt (0.9765 * width), roundToInt (0.1765 * width));
+
+    // Waveform Visualiser
+    audioProcessor.getVisualiser().setBounds (roundToInt (0.0118 * width), roundToInt (0.4235 * width), roundToInt (0.9765 * width), roundToInt (0.2353 * width));
+
+    // Custom Wave Components
+    wavetableEditor->setBounds (roundToInt (0.0118 * width), roundToInt (0.7000 * width), roundToInt (0.9765 * width), roundToInt (0.0765 * width));
 }
 
 // Establishes GUI configuration for gain rotary
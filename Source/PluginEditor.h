@@ -25,6 +25,7 @@
 
 #include "ADSRComponent.h"
 #include "PluginProcessor.h"
+#include "WavetableComponent.h"
 #include "WfVisualiser.h"
 #include <JuceHeader.h>
 
@@ -42,6 +43,8 @@ public:
     //==============================================================================
     void paint (juce::Graphics&) override;
     void resized() override;
+    void visibilityChanged() override;
+    void parentHierarchyChanged() override;
 
 private:
     // sets the initial width of the plug-in window, with other components dynamically sized
@@ -50,13 +53,18 @@ private:
     void sliderValueChanged (juce::Slider*) override;
     void comboBoxChanged (juce::ComboBox*) override;
     void mouseDrag (const juce::MouseEvent&) override;
+    void mouseDown (const juce::MouseEvent&) override;
     void setGainStyle();
     void filterChanged();
+    void chooseSamples();
+    void createDeferredComponents();
 
     SubsynthAudioProcessor& audioProcessor;
 
     // UI elements
     juce::ComboBox waveSelect;
+    juce::TextButton loadSamplesButton { "Load Samples" };
+    std::unique_ptr<juce::FileChooser> sampleChooser;
     juce::ComboBox filterSelect;
     juce::Slider filterCutoff;
     juce::Slider filterRes;
@@ -68,8 +76,11 @@ private:
     juce::Slider gainSlide;
     juce::Label gainLabel;
 
-    // Keyboard
-    juce::MidiKeyboardComponent keyboard;
+    // Custom waveform drawing pad and harmonics box, the keyboard and the
+    // waveform visualiser. The heaviest components, so they are created the
+    // first time the editor is showing, not with the editor.
+    std::unique_ptr<WavetableComponent> wavetableEditor;
+    std::unique_ptr<juce::MidiKeyboardComponent> keyboard;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SubsynthAudioProcessorEditor)
 };
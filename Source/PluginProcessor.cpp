@@ -23,6 +23,7 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "ParallelRender.h"
 
 //==============================================================================
 SubsynthAudioProcessor::SubsynthAudioProcessor()
@@ -44,12 +45,34 @@ SubsynthAudioProcessor::SubsynthAudioProcessor()
 
     for (int i = 0; i < numVoices; i++)
     {
-        synth.addVoice (new CustomVoice());
+        auto* voice = new CustomVoice();
+        voice->setSampleSource (&sampleMap, samplePlayheads.add (new SampleOscillator::Playhead()));
+        voice->setWavetableSource (&wavetable);
+        voice->setModulation (&modulation, midiControllers);
+        voice->setFlightRecorder (&flightRecorder, i);
+        synth.addVoice (voice);
     }
+
+    // The custom waveform starts as a sine until the user edits it
+    wavetableBuilder.requestHarmonics ({ 1.0f });
+
+    // The threads themselves are started by the first prepareToPlay, so an
+    // instance that is never played never starts them
+    backgroundThread.addTimeSliceClient (&sampleStreamer);
+    backgroundThread.addTimeSliceClient (&wavetableBuilder);
+    backgroundThread.addTimeSliceClient (&flightRecorder);
+    effectsThread.addTimeSliceClient (&effects.getTailRenderer());
 }
 
 SubsynthAudioProcessor::~SubsynthAudioProcessor()
 {
+    backgroundThread.removeTimeSliceClient (&sampleStreamer);
+    backgroundThread.removeTimeSliceClient (&wavetableBuilder);
+    backgroundThread.removeTimeSliceClient (&flightRecorder);
+    backgroundThread.stopThread (1000);
+
+    effectsThread.removeTimeSliceClient (&effects.getTailRenderer());
+    effectsThread.stopThread (1000);
 }
 
 // Returns the name of this processor.
@@ -90,10 +113,11 @@ bool SubsynthAudioProcessor::isMidiEffect() const
 #endif
 }
 
-// Returns the length of the processor's tail, in seconds. No tail used (0 seconds).
+// Returns the length of the processor's tail, in seconds: how long the delay
+// and reverb keep sounding after the voices stop.
 double SubsynthAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    return effects.getTailLengthSeconds();
 }
 
 // Returns the number of preset programs the processor supports. Always returns at least 1.
@@ -117,12 +141,55 @@ int SubsynthAudioProcessor::getCurrentProgram()
 // that will be provided in each block.
 void SubsynthAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    synth.setCurrentPlaybackSampleRate (sampleRate);
+    // The voices and effects run at the engine rate, a whole fraction of the
+    // host rate when the fixed internal rate is on, and the upsampler's
+    // filter delay is reported to the host
+    const int factor = fixedInternalRateEnabled && ! isNonRealtime() ? PolyphaseUpsampler::chooseFactor (sampleRate, minimumInternalRate) : 1;
+    const int engineBlockSize = (samplesPerBlock + factor - 1) / factor;
+    engineSampleRate = sampleRate / factor;
+
+    upsampler.prepare (factor, getTotalNumOutputChannels());
+    engineBuffer.setSize (getTotalNumOutputChannels(), engineBlockSize);
+    LowLatencyMode::prefaultBuffer (engineBuffer);
+    engineMidi.ensureSize (8192);
+    engineMidi.clear();
+    setLatencySamples (upsampler.getLatencyInSamples());
+
+    attackCache.prepare (engineSampleRate);
+
+    synth.setCurrentPlaybackSampleRate (engineSampleRate);
     for (int i = 0; i < synth.getNumVoices(); i++)
-        (dynamic_cast<CustomVoice*> (synth.getVoice (i)))->prepareToPlay (sampleRate, samplesPerBlock, getTotalNumOutputChannels());
+    {
+        auto* voice = dynamic_cast<CustomVoice*> (synth.getVoice (i));
+        voice->prepareToPlay (engineSampleRate, juce::jmin (engineBlockSize, microBlockSize), getTotalNumOutputChannels());
+        voice->setAttackCache (attackCacheEnabled ? &attackCache : nullptr);
+    }
+
+    effects.prepare ({ engineSampleRate, (juce::uint32) engineBlockSize, (juce::uint32) getTotalNumOutputChannels() }, isNonRealtime());
+    startBackgroundThreads();
 
-    wfVisualiser.clear();
-    runTests();
+    blockMidi.ensureSize (8192);
+    microBlockMidi.ensureSize (8192);
+    midiInjector.reset();
+    midiMapping.prepare (engineSampleRate);
+    flightRecorder.prepare (sampleRate, ! isNonRealtime());
+
+    quality.prepare (sampleRate, synth.getNumVoices());
+    quality.setEnabled (adaptiveQualityEnabled && ! isNonRealtime());
+    applyQualityTier();
+
+    if (visualiser != nullptr)
+    {
+        visualiser->clear();
+    }
+
+    // Lock memory now that every voice buffer is allocated, and have the audio
+    // thread promote itself on its first callback
+    if (wrapperType == wrapperType_Standalone && LowLatencyMode::isEnabled())
+    {
+        LowLatencyMode::lockProcessMemory();
+        promoteAudioThread = true;
+    }
 }
 
 // Called after playback has stopped, to let the object free up any
@@ -130,6 +197,23 @@ void SubsynthAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlo
 void SubsynthAudioProcessor::releaseResources()
 {
     keyState.reset();
+    promoteAudioThread = false;
+
+    // The streamer may be touching a retired sample map through a voice's
+    // playhead, so the playheads are cleared and any time slice still
+    // running is waited out before the retired maps are freed
+    for (auto* playhead : samplePlayheads)
+    {
+        playhead->zone = nullptr;
+    }
+
+    backgroundThread.removeTimeSliceClient (&sampleStreamer);
+    sampleMap.reclaimAll();
+    backgroundThread.addTimeSliceClient (&sampleStreamer);
+
+    modulation.reclaimAll();
+    wavetable.reclaimAll();
+    effects.releaseResources();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -172,6 +256,16 @@ void SubsynthAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juc
         return;
     }
 
+    if (promoteAudioThread.exchange (false))
+    {
+        LowLatencyMode::promoteCurrentThread (LowLatencyMode::defaultPriority);
+        LowLatencyMode::prefaultStack();
+    }
+
+    // Everything below must stay allocation, lock and system call free
+    RealtimeChecker::ScopedAudioThread realtimeScope;
+    const auto renderStart = juce::Time::getHighResolutionTicks();
+
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -180,12 +274,150 @@ void SubsynthAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juc
     {
         buffer.clear (i, 0, buffer.getNumSamples());
     }
-    // Scan midi buffer and add any messages generated by onscreen keyboard to buffer
-    // injectIndirectEvents bool (last argument) must be true
-    keyState.processNextMidiBuffer (midiMessages, 0, buffer.getNumSamples(), true);
-    synth.renderNextBlock (buffer, midiMessages, 0, buffer.getNumSamples());
+    // Merge the host's MIDI with the events queued by the onscreen keyboard
+    midiInjector.processNextMidiBuffer (midiMessages, blockMidi, buffer.getNumSamples());
+    attackCache.setPatchVersion (patchVersion.load());
+
+    for (const auto metadata : blockMidi)
+    {
+        flightRecorder.recordMidi (metadata.data, metadata.numBytes, metadata.samplePosition);
+    }
+
+    if (upsampler.getFactor() == 1)
+    {
+        renderEngine (buffer, blockMidi);
+    }
+    else
+    {
+        renderUpsampled (buffer);
+    }
+
+    if (auto* display = visualiserForAudio.load())
+    {
+        display->pushBuffer (buffer);
+    }
+
+    // Adapt to the time this block took: the tier applies from the next block
+    const auto renderTicks = juce::Time::getHighResolutionTicks() - renderStart;
+    const auto renderSeconds = juce::Time::highResolutionTicksToSeconds (renderTicks);
+
+    flightRecorder.recordBlock (buffer.getNumSamples(), renderSeconds * 1000.0);
+
+    if (quality.update (renderSeconds, buffer.getNumSamples()))
+    {
+        applyQualityTier();
+    }
+
+    limitPolyphony (quality.getTier().maxVoices);
+}
+
+// Renders the voices and then the effects into a buffer at the engine rate.
+// The effects process the whole buffer at once.
+//
+// @param buffer: The cleared buffer to render into.
+// @param midi: The block's MIDI, with positions at the engine rate.
+void SubsynthAudioProcessor::renderEngine (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi)
+{
+    const int numSamples = buffer.getNumSamples();
+    auto event = midi.cbegin();
+
+    // Parameters no longer mapped go back to the patch's settings
+    if (const auto unmapped = midiMapping.takeUnmapped())
+    {
+        for (int parameter = 1; parameter < MidiMapping::numParameters; ++parameter)
+        {
+            if ((unmapped & (1u << parameter)) != 0)
+            {
+                for (int i = 0; i < synth.getNumVoices(); i++)
+                {
+                    dynamic_cast<CustomVoice*> (synth.getVoice (i))->clearMappedParameter ((MidiMapping::Parameter) parameter);
+                }
+            }
+        }
+    }
+
+    // The voices render in micro-blocks, so their buffers stay in cache
+    // however large the host's blocks are. Notes still start on their own
+    // sample; controller values change at micro-block boundaries.
+    for (int start = 0; start < numSamples; start += microBlockSize)
+    {
+        const int length = juce::jmin (microBlockSize, numSamples - start);
+
+        // Track the latest value of every CC for the modulation matrix, and
+        // pass mapped CCs on to their parameters
+        for (; event != midi.cend() && (*event).samplePosition < start + length; ++event)
+        {
+            const auto metadata = *event;
+
+            if (metadata.numBytes == 3 && (metadata.data[0] & 0xf0) == 0xb0)
+            {
+                const float value = metadata.data[2] / 127.0f;
+                midiControllers[metadata.data[1] & 0x7f] = value;
+                midiMapping.handleController ((metadata.data[0] & 0x0f) + 1, metadata.data[1] & 0x7f, value);
+            }
+        }
+
+        // Mapped parameters move once per micro-block, smoothed
+        for (int i = 1; i < MidiMapping::numParameters; ++i)
+        {
+            float value;
+
+            if (midiMapping.getNextValue ((MidiMapping::Parameter) i, length, value))
+            {
+                applyMappedParameter ((MidiMapping::Parameter) i, value);
+            }
+        }
+
+        // The synthesiser handles every event left in the buffer at the end
+        // of the range it renders, so each micro-block is passed only its own
+        microBlockMidi.clear();
+        microBlockMidi.addEvents (midi, start, length, 0);
+
+        // The synthesiser takes its lock on every render. The only other
+        // callers that take it are prepareToPlay and restoreCheckpoint, through
+        // CustomSynthesiser::assignVoices. The first never runs while audio
+        // runs, and the second runs with the audio stopped or on the rendering
+        // thread itself. The lock is never contended, and the checker still
+        // reports it if it is found held.
+        RealtimeChecker::ScopedAllowLock synthLock (synth.getLock());
+        synth.renderNextBlock (buffer, microBlockMidi, start, length);
+    }
+
+    sampleMap.finishedReading();
+    modulation.finishedReading();
+    wavetable.finishedReading();
+
+    if (! effectsBypassed)
+    {
+        effects.process (buffer);
+    }
+}
+
+// Renders just enough samples at the engine rate to upsample into the host's
+// block, with blockMidi's events moved to the engine samples they fall in.
+//
+// @param buffer: The host's buffer, replaced with the upsampled output.
+void SubsynthAudioProcessor::renderUpsampled (juce::AudioBuffer<float>& buffer)
+{
+    const int numSamples = buffer.getNumSamples();
+    const int numEngineSamples = upsampler.getNumInputSamplesNeeded (numSamples);
+
+    // A block short enough to be served from the last engine sample renders
+    // nothing, and its events wait in engineMidi for the next engine sample
+    for (const auto metadata : blockMidi)
+    {
+        engineMidi.addEvent (metadata.data, metadata.numBytes, upsampler.getInputPosition (metadata.samplePosition, numEngineSamples));
+    }
 
-    wfVisualiser.pushBuffer (buffer);
+    if (numEngineSamples > 0)
+    {
+        engineBuffer.setSize (buffer.getNumChannels(), numEngineSamples, false, false, true);
+        engineBuffer.clear();
+        renderEngine (engineBuffer, engineMidi);
+        engineMidi.clear();
+    }
+
+    upsampler.process (engineBuffer, numEngineSamples, buffer, numSamples);
 }
 
 //==============================================================================
@@ -202,6 +434,19 @@ juce::AudioProcessorEditor* SubsynthAudioProcessor::createEditor()
     return new SubsynthAudioProcessorEditor (*this);
 }
 
+// Returns the waveform visualiser, creating it on the first call. Message
+// thread only.
+WaveformVisualiser& SubsynthAudioProcessor::getVisualiser()
+{
+    if (visualiser == nullptr)
+    {
+        visualiser = std::make_unique<WaveformVisualiser>();
+        visualiserForAudio = visualiser.get();
+    }
+
+    return *visualiser;
+}
+
 //============================= UI Callbacks ========================================
 
 // Calls the setADSR CustomVoice method to change the attack, decay, sustain, release
@@ -215,19 +460,25 @@ void SubsynthAudioProcessor::changeADSREnv (juce::ADSR::Parameters params)
     {
         dynamic_cast<CustomVoice*> (synth.getVoice (i))->setADSR (params);
     }
+
+    flightRecorder.recordParameter ("envelope", { params.attack, params.decay, params.sustain, params.release });
+    ++patchVersion;
 }
 
 // Calls the setWave CustomVoice method to change the waveform being produced by
 // the oscillator in each voice of the synth data member.
 //
-// @param waveformNum: An integer representation for sine, square, saw, and triangle
-// waveforms.
+// @param waveformNum: An integer representation for sine, square, saw, triangle,
+// sample playback, custom wavetable, FM, and granular waveforms.
 void SubsynthAudioProcessor::changeWaveform (int waveformNum)
 {
     for (int i = 0; i < synth.getNumVoices(); i++)
     {
         dynamic_cast<CustomVoice*> (synth.getVoice (i))->setWave (waveformNum);
     }
+
+    flightRecorder.recordParameter ("waveform", { (float) waveformNum });
+    ++patchVersion;
 }
 
 // Calls the setGain CustomVoice method to change the gain being applied to
@@ -240,13 +491,16 @@ void SubsynthAudioProcessor::changeVolume (double gain)
     {
         dynamic_cast<CustomVoice*> (synth.getVoice (i))->setGain (gain);
     }
+
+    flightRecorder.recordParameter ("volume", { (float) gain });
+    ++patchVersion;
 }
 
 // Calls the setFilter CustomVoice method to change the filter type, cutoff frequency,
 // and resonance of the state variable filter of each voice in the synth data member
 //
 // @param filterNum: An integer representation of the filter type to be set; options
-// include low pass, band pass, and high pass.
+// include low pass, band pass, high pass, and ladder.
 // @param cutoff: The cutoff frequency for the state variable filter in Hz.
 // @param resonance: The amount of resonance to be applied by the state variable filter
 void SubsynthAudioProcessor::changeFilter (int filterNum, double cutoff, double resonance)
@@ -255,14 +509,799 @@ void SubsynthAudioProcessor::changeFilter (int filterNum, double cutoff, double
     {
         dynamic_cast<CustomVoice*> (synth.getVoice (i))->setFilter (filterNum, cutoff, resonance);
     }
+
+    flightRecorder.recordParameter ("filter", { (float) filterNum, (float) cutoff, (float) resonance });
+    ++patchVersion;
+}
+
+// Loads a set of WAV/AIFF files as the multisample played by the "Sample"
+// waveform and publishes it to the voices without interrupting playback.
+// Files are memory mapped; only the first 250 ms of each is decoded up front.
+//
+// @param files: The sample files, named with their root note and optional
+// velocity layer (see SampleMap::loadFiles).
+// @return True if at least one file was loaded.
+bool SubsynthAudioProcessor::loadSamples (const juce::Array<juce::File>& files)
+{
+    auto newMap = SampleMap::loadFiles (files, 0.25);
+
+    if (newMap == nullptr)
+    {
+        return false;
+    }
+
+    sampleMap.publish (std::move (newMap));
+    return true;
+}
+
+// Defines the custom waveform by the amplitudes of its harmonics. The
+// band-limited wavetable is built on the background thread and swapped into
+// the voices when ready; this returns immediately.
+//
+// @param amplitudes: The amplitude of harmonic 1 (the fundamental), 2, 3 and so on.
+void SubsynthAudioProcessor::setCustomWaveHarmonics (const std::vector<float>& amplitudes)
+{
+    wavetableBuilder.requestHarmonics (amplitudes);
+}
+
+// Defines the custom waveform by one drawn cycle. The band-limited wavetable
+// is built on the background thread and swapped into the voices when ready;
+// this returns immediately.
+//
+// @param cycle: Evenly spaced points (-1 to 1) across one period.
+void SubsynthAudioProcessor::setCustomWaveCycle (const std::vector<float>& cycle)
+{
+    wavetableBuilder.requestCycle (cycle);
+}
+
+// Calls the setModEnvelope CustomVoice method to change the attack, decay,
+// sustain, release values of the modulation envelope on each voice.
+//
+// @param params: The envelope settings.
+void SubsynthAudioProcessor::changeModEnvelope (juce::ADSR::Parameters params)
+{
+    for (int i = 0; i < synth.getNumVoices(); i++)
+    {
+        dynamic_cast<CustomVoice*> (synth.getVoice (i))->setModEnvelope (params);
+    }
+
+    flightRecorder.recordParameter ("mod envelope", { params.attack, params.decay, params.sustain, params.release });
+    ++patchVersion;
+}
+
+// Replaces the modulation matrix routing. The routes are compiled here, on
+// the calling thread, and the result is swapped into the voices.
+//
+// @param routes: The new set of source to destination connections.
+void SubsynthAudioProcessor::setModulationRoutes (const std::vector<ModRoute>& routes)
+{
+    modRoutes = routes;
+    compileModulation();
+}
+
+// Sets the rate of one of the modulation LFOs.
+//
+// @param lfo: 0 for LFO 1, 1 for LFO 2.
+// @param rateHz: The LFO rate in Hz.
+void SubsynthAudioProcessor::setLfoRate (int lfo, float rateHz)
+{
+    lfoRates[juce::jlimit (0, 1, lfo)] = rateHz;
+    compileModulation();
+}
+
+// Calls the setControlInterval CustomVoice method to change how many samples
+// each voice renders between modulation and coefficient updates.
+//
+// @param samplesPerTick: The control interval in samples, e.g. 16, 32 or 64.
+void SubsynthAudioProcessor::changeControlInterval (int samplesPerTick)
+{
+    for (int i = 0; i < synth.getNumVoices(); i++)
+    {
+        dynamic_cast<CustomVoice*> (synth.getVoice (i))->setControlInterval (samplesPerTick);
+    }
+
+    flightRecorder.recordParameter ("control interval", { (float) samplesPerTick });
+    ++patchVersion;
+}
+
+// Calls the setSubOscillator CustomVoice method to change the level and
+// octave of the sub-oscillator on each voice.
+//
+// @param level: The sub-oscillator's amplitude, 0 (off) to 1.
+// @param octaves: 1 or 2 octaves below the main oscillator.
+void SubsynthAudioProcessor::changeSubOscillator (float level, int octaves)
+{
+    for (int i = 0; i < synth.getNumVoices(); i++)
+    {
+        dynamic_cast<CustomVoice*> (synth.getVoice (i))->setSubOscillator (level, octaves);
+    }
+
+    flightRecorder.recordParameter ("sub oscillator", { level, (float) octaves });
+    ++patchVersion;
+}
+
+// Calls the setNoise CustomVoice method to change the level and colour of
+// the noise source on each voice.
+//
+// @param level: The noise amplitude, 0 (off) to 1.
+// @param colour: White or pink noise.
+void SubsynthAudioProcessor::changeNoise (float level, NoiseGenerator::Colour colour)
+{
+    for (int i = 0; i < synth.getNumVoices(); i++)
+    {
+        dynamic_cast<CustomVoice*> (synth.getVoice (i))->setNoise (level, colour);
+    }
+
+    flightRecorder.recordParameter ("noise", { level, (float) colour });
+    ++patchVersion;
+}
+
+// Calls the setFM CustomVoice method to change the modulator of the FM
+// waveform on each voice.
+//
+// @param ratio: The modulator frequency as a multiple of the note's, 0.25 to 16.
+// @param index: The modulation index, the peak phase deviation in radians, 0 to 10.
+// @param mode: Whether the modulator drives the carrier's phase or its frequency.
+void SubsynthAudioProcessor::changeFM (float ratio, float index, FMOscillator::Mode mode)
+{
+    for (int i = 0; i < synth.getNumVoices(); i++)
+    {
+        dynamic_cast<CustomVoice*> (synth.getVoice (i))->setFM (ratio, index, mode);
+    }
+
+    flightRecorder.recordParameter ("fm", { ratio, index, (float) mode });
+    ++patchVersion;
+}
+
+// Calls the setGranular CustomVoice method to change how the granular
+// waveform spawns its grains on each voice.
+//
+// @param parameters: The grains' position, pitch, density, size, spray and source.
+void SubsynthAudioProcessor::changeGranular (const GranularOscillator::Parameters& parameters)
+{
+    for (int i = 0; i < synth.getNumVoices(); i++)
+    {
+        dynamic_cast<CustomVoice*> (synth.getVoice (i))->setGranular (parameters);
+    }
+
+    flightRecorder.recordParameter ("granular", { parameters.position, parameters.pitch, parameters.density, parameters.spray });
+    flightRecorder.recordParameter ("grain size", { parameters.size, (float) parameters.source });
+    ++patchVersion;
+}
+
+// Changes the chorus, delay and reverb settings of the effects bus.
+//
+// @param parameters: The new settings; an effect with zero mix is bypassed.
+void SubsynthAudioProcessor::changeEffects (const EffectsBus::Parameters& parameters)
+{
+    effects.setParameters (parameters);
+}
+
+// Queues a MIDI event from a source other than the host, to be played at
+// the start of the next block. Call only from the message thread, the
+// queue's single producer.
+//
+// @param message: A short (up to three byte) MIDI message.
+void SubsynthAudioProcessor::addMidiEvent (const juce::MidiMessage& message)
+{
+    midiInjector.addEvent (message);
+}
+
+// Turns adaptive quality on or off. When on, a processor short of CPU time
+// drops to cheaper voice rendering and then to fewer voices, and recovers
+// once the load has been low for a while. Takes effect at the next prepareToPlay.
+//
+// @param shouldAdapt: True to adapt to the render load.
+void SubsynthAudioProcessor::setAdaptiveQuality (bool shouldAdapt)
+{
+    adaptiveQualityEnabled = shouldAdapt;
+}
+
+// Chooses whether the voices and effects run at the host's rate, or at a
+// fixed internal rate of 44.1 kHz or more upsampled to the host's rate.
+// Takes effect from the next prepareToPlay, which also reports the
+// upsampler's latency to the host.
+//
+// @param shouldUseFixedRate: True to run the engine at the internal rate.
+void SubsynthAudioProcessor::setFixedInternalRate (bool shouldUseFixedRate)
+{
+    fixedInternalRateEnabled = shouldUseFixedRate;
+}
+
+// Turns the attack cache on or off. When on, notes started from silence
+// with a patch that plays the same every time stream their first 10 ms from
+// memory once each key and velocity has been heard. Takes effect at the next
+// prepareToPlay.
+//
+// @param shouldCache: True to memoise note attacks.
+void SubsynthAudioProcessor::setAttackCache (bool shouldCache)
+{
+    attackCacheEnabled = shouldCache;
+}
+
+// Turns the flight recorder on or off. It is on by default, and costs one
+// small copy per recorded event on the audio thread.
+//
+// @param shouldRecord: True to record and dump overruns.
+void SubsynthAudioProcessor::setFlightRecorder (bool shouldRecord)
+{
+    flightRecorder.setEnabled (shouldRecord);
+}
+
+// Sets the folder the flight recorder writes its dumps to.
+//
+// @param directory: The folder, created with the first dump.
+void SubsynthAudioProcessor::setFlightRecorderDirectory (const juce::File& directory)
+{
+    flightRecorder.setDumpDirectory (directory);
+}
+
+// Lists the engine's running state for a checkpoint: the controllers and
+// pitch wheel, the sustain pedals, the voice allocation and every voice,
+// with the values of its mapped parameters. The patch itself is not included: a
+// checkpoint restores into a processor set up with the same patch.
+//
+// @param visit: A CheckpointWriter or CheckpointReader.
+template <typename Visitor>
+void SubsynthAudioProcessor::visitState (Visitor& visit)
+{
+    visit (midiControllers);
+
+    midiMapping.visitState (visit);
+    synth.visitState (visit);
+}
+
+// Whether the engine's state can be checkpointed as it is set up now. The
+// effects, the fixed internal rate's upsampler, sample playback, granular
+// grains of the samples and the attack cache are not in checkpoints, so
+// only the first may be in use.
+//
+// @return True if createCheckpoint will capture everything the voices need.
+bool SubsynthAudioProcessor::canCheckpoint() const
+{
+    const auto* voice = dynamic_cast<CustomVoice*> (synth.getVoice (0));
+    const int wave = voice->getWave();
+    const bool granularSamples = wave == CustomVoice::granularWave && voice->getGranular().source == GranularOscillator::Source::sample;
+
+    return ! attackCacheEnabled && upsampler.getFactor() == 1 && wave != CustomVoice::sampleWave && ! granularSamples;
+}
+
+// Saves the state of the voices between blocks, for restoring into this or
+// another processor with the same patch, which then renders on exactly as
+// this one would have. Two checkpoints of the same state are equal, byte
+// for byte. Call between blocks, never during one.
+//
+// @return The checkpoint, or an empty block if canCheckpoint is false.
+juce::MemoryBlock SubsynthAudioProcessor::createCheckpoint()
+{
+    juce::MemoryBlock checkpoint;
+
+    if (canCheckpoint())
+    {
+        CheckpointWriter writer (checkpoint);
+        visitState (writer);
+    }
+
+    return checkpoint;
+}
+
+// Puts the voices back where a checkpoint found them. Not real-time safe:
+// call between blocks, with the audio stopped or on the rendering thread.
+//
+// @param checkpoint: From createCheckpoint, on a processor with the same patch.
+// @return False if the checkpoint is empty or does not fit this processor.
+bool SubsynthAudioProcessor::restoreCheckpoint (const juce::MemoryBlock& checkpoint)
+{
+    if (checkpoint.isEmpty() || ! canCheckpoint())
+    {
+        return false;
+    }
+
+    CheckpointReader reader (checkpoint);
+    visitState (reader);
+    jassert (reader.isComplete());
+    return reader.isComplete();
+}
+
+// Renders the voices alone, without the effects, until turned off again.
+//
+// @param shouldBypass: True to leave the effects out of processBlock.
+void SubsynthAudioProcessor::setEffectsBypassed (bool shouldBypass)
+{
+    effectsBypassed = shouldBypass;
+}
+
+// Runs the effects over the voices' output, exactly as processBlock would
+// have, for a render whose voices ran with the effects bypassed. Call with
+// the same blocks, in order, that the voices were rendered in.
+//
+// @param buffer: The voices' output for one block, replaced with the effects'.
+void SubsynthAudioProcessor::applyEffects (juce::AudioBuffer<float>& buffer)
+{
+    juce::ScopedNoDenormals noDenormals;
+    effects.process (buffer);
+}
+
+// Routes the next MIDI controller that moves to a parameter. The controller
+// keeps that route until it is mapped again or the parameter is cleared.
+//
+// @param parameter: The parameter to learn, or MidiMapping::Parameter::none to cancel.
+void SubsynthAudioProcessor::startMidiLearn (MidiMapping::Parameter parameter)
+{
+    midiMapping.startLearning (parameter);
+}
+
+// Routes a MIDI controller to a parameter without learning it.
+//
+// @param channel: The MIDI channel, 1 to 16.
+// @param controller: The controller number, 0 to 119.
+// @param parameter: The parameter, or MidiMapping::Parameter::none to remove the route.
+void SubsynthAudioProcessor::mapController (int channel, int controller, MidiMapping::Parameter parameter)
+{
+    midiMapping.map (channel, controller, parameter);
+}
+
+// Removes every controller route to a parameter.
+//
+// @param parameter: The parameter to stop controlling.
+void SubsynthAudioProcessor::clearMidiMapping (MidiMapping::Parameter parameter)
+{
+    midiMapping.unmap (parameter);
+}
+
+// Sets a parameter from a mapped MIDI controller. Called on the audio
+// thread, so it goes to the voices' own mapped values rather than through
+// the change methods the editor uses: it neither races them nor counts as
+// a change to the patch. Allocation free.
+//
+// @param parameter: The parameter to set.
+// @param value: The smoothed controller value, 0 to 1.
+void SubsynthAudioProcessor::applyMappedParameter (MidiMapping::Parameter parameter, float value)
+{
+    const double scaled = MidiMapping::toParameterValue (parameter, value);
+
+    for (int i = 0; i < synth.getNumVoices(); i++)
+    {
+        dynamic_cast<CustomVoice*> (synth.getVoice (i))->setMappedParameter (parameter, scaled);
+    }
+}
+
+// Passes the current quality tier's voice quality on to every voice.
+void SubsynthAudioProcessor::applyQualityTier()
+{
+    for (int i = 0; i < synth.getNumVoices(); i++)
+    {
+        dynamic_cast<CustomVoice*> (synth.getVoice (i))->setReducedQuality (quality.getTier().reducedQuality);
+    }
+
+    flightRecorder.recordParameter ("quality tier", { (float) quality.getTierIndex() });
+    ++patchVersion;
+}
+
+// Caps the voices new notes may take, and steals the quietest sounding
+// voices until no more than maxVoices remain. Voices still in their attack
+// are left alone, so a new note is never cut off as it starts; they are
+// stolen, if still over the limit, once it ends. Stolen voices fade out
+// over a few milliseconds.
+//
+// @param maxVoices: The number of voices allowed to keep sounding.
+void SubsynthAudioProcessor::limitPolyphony (int maxVoices)
+{
+    synth.setMaxVoices (maxVoices);
+
+    int numSounding = 0;
+
+    for (int i = 0; i < synth.getNumVoices(); i++)
+    {
+        auto* voice = dynamic_cast<CustomVoice*> (synth.getVoice (i));
+
+        if (voice->isVoiceActive() && ! voice->isBeingStolen())
+        {
+            ++numSounding;
+        }
+    }
+
+    for (; numSounding > maxVoices; --numSounding)
+    {
+        CustomVoice* quietest = nullptr;
+
+        for (int i = 0; i < synth.getNumVoices(); i++)
+        {
+            auto* voice = dynamic_cast<CustomVoice*> (synth.getVoice (i));
+
+            if (voice->isVoiceActive() && ! voice->isBeingStolen() && ! voice->isInAttack()
+                && (quietest == nullptr || voice->getLevel() < quietest->getLevel()))
+            {
+                quietest = voice;
+            }
+        }
+
+        if (quietest == nullptr)
+        {
+            break;
+        }
+
+        quietest->steal();
+    }
+}
+
+// Starts the sample streaming and wavetable thread and the reverb tail
+// thread, if they are not already running.
+void SubsynthAudioProcessor::startBackgroundThreads()
+{
+    if (! backgroundThread.isThreadRunning())
+    {
+        backgroundThread.startThread();
+    }
+
+    // Above normal priority: every tail block has a deadline one tail partition away
+    if (! effectsThread.isThreadRunning())
+    {
+        effectsThread.startThread (8);
+    }
+}
+
+// Compiles the current routes and LFO rates and publishes the result to the
+// voices, freeing any compiled matrices the audio thread has finished with.
+void SubsynthAudioProcessor::compileModulation()
+{
+    modulation.reclaim();
+    modulation.publish (CompiledModMatrix::compile (modRoutes, lfoRates));
+    flightRecorder.recordParameter ("modulation", { (float) modRoutes.size(), lfoRates[0], lfoRates[1] });
+    ++patchVersion;
 }
 
 // Runs a set of unit-style tests related to methods changing DSP
-// component parameters. Must attach a debugger for proper function.
+// component parameters. Must attach a debugger for proper function. Run by
+// the standalone's --run-tests option.
 void SubsynthAudioProcessor::runTests()
 {
     CustomVoice testVoice;
     testVoice.voiceTests();
+
+    // Test shared resources: a key is built once while it is in use, and
+    // forgotten when the last user lets go
+    juce::SharedResourcePointer<SharedResources> testResources;
+    int numBuilds = 0;
+    auto build = [&numBuilds] { ++numBuilds; return std::make_shared<int> (7); };
+
+    auto first = testResources->getOrCreate<int> ("test resource", build);
+    auto second = testResources->getOrCreate<int> ("test resource", build);
+    jassert (first == second && numBuilds == 1);
+
+    first.reset();
+    second.reset();
+    testResources->getOrCreate<int> ("test resource", build);
+    jassert (numBuilds == 2);
+
+    // Test MIDI queue: events come out in order, and a full queue drops
+    // rather than blocks
+    MidiEventQueue testQueue;
+    jassert (testQueue.push (juce::MidiMessage::noteOn (1, 60, (juce::uint8) 100), 1.0));
+    jassert (testQueue.push (juce::MidiMessage::noteOff (1, 60), 2.0));
+
+    MidiEventQueue::Event event;
+    jassert (testQueue.pop (event) && event.numBytes == 3 && event.data[1] == 60 && event.timeMs == 1.0);
+    jassert (testQueue.pop (event) && (event.data[0] & 0xf0) == 0x80);
+    jassert (! testQueue.pop (event));
+
+    while (testQueue.push (juce::MidiMessage::controllerEvent (1, 1, 0), 0.0))
+    {
+    }
+
+    jassert (testQueue.getNumReady() == MidiEventQueue::capacity - 1);
+
+    // Test MIDI mapping: learning routes the next controller moved, routes
+    // are per channel, the first value is taken at once and later ones are
+    // smoothed, and channel mode messages are never routed
+    MidiMapping testMapping;
+    testMapping.prepare (48000.0);
+    testMapping.startLearning (MidiMapping::Parameter::cutoff);
+    jassert (testMapping.handleController (1, 74, 1.0f));
+    jassert (! testMapping.isLearning() && testMapping.getMapping (1, 74) == MidiMapping::Parameter::cutoff);
+    jassert (! testMapping.handleController (2, 74, 1.0f));
+    jassert (! testMapping.handleController (1, 123, 1.0f));
+
+    float mappedValue = 0.0f;
+    jassert (testMapping.getNextValue (MidiMapping::Parameter::cutoff, 64, mappedValue) && mappedValue == 1.0f);
+    jassert (! testMapping.getNextValue (MidiMapping::Parameter::cutoff, 64, mappedValue));
+    testMapping.handleController (1, 74, 0.0f);
+    jassert (testMapping.getNextValue (MidiMapping::Parameter::cutoff, 64, mappedValue) && mappedValue > 0.0f && mappedValue < 1.0f);
+    jassert (std::abs (MidiMapping::toParameterValue (MidiMapping::Parameter::cutoff, 1.0f) - 20000.0) < 0.01);
+
+    testMapping.unmap (MidiMapping::Parameter::cutoff);
+    jassert (testMapping.getMapping (1, 74) == MidiMapping::Parameter::none);
+    jassert (testMapping.takeUnmapped() == 1u << (int) MidiMapping::Parameter::cutoff);
+    jassert (testMapping.takeUnmapped() == 0);
+
+    // Learning a controller that is already routed releases its old parameter
+    testMapping.map (1, 74, MidiMapping::Parameter::resonance);
+    testMapping.startLearning (MidiMapping::Parameter::volume);
+    jassert (testMapping.handleController (1, 74, 0.5f));
+    jassert (testMapping.getMapping (1, 74) == MidiMapping::Parameter::volume);
+    jassert (testMapping.takeUnmapped() == 1u << (int) MidiMapping::Parameter::resonance);
+
+    // Test the upsampler: 96 and 192 kHz hosts run the engine at 48 kHz, DC
+    // comes through at unity gain once the filter has filled, and an output
+    // sample left over from one block starts the next
+    jassert (PolyphaseUpsampler::chooseFactor (48000.0, minimumInternalRate) == 1);
+    jassert (PolyphaseUpsampler::chooseFactor (96000.0, minimumInternalRate) == 2);
+    jassert (PolyphaseUpsampler::chooseFactor (192000.0, minimumInternalRate) == 4);
+
+    PolyphaseUpsampler testUpsampler;
+    testUpsampler.prepare (2, 1);
+    jassert (testUpsampler.getLatencyInSamples() == PolyphaseUpsampler::tapsPerPhase);
+
+    juce::AudioBuffer<float> upsamplerInput (1, 64), upsamplerOutput (1, 127);
+    juce::FloatVectorOperations::fill (upsamplerInput.getWritePointer (0), 1.0f, 64);
+    jassert (testUpsampler.getNumInputSamplesNeeded (127) == 64);
+    testUpsampler.process (upsamplerInput, 64, upsamplerOutput, 127);
+    jassert (std::abs (upsamplerOutput.getSample (0, 126) - 1.0f) < 1.0e-4f);
+    jassert (testUpsampler.getNumInputSamplesNeeded (1) == 0);
+
+    // Test adaptive quality: sustained overload steps down one tier at a
+    // time, and a sustained low load steps back up
+    AdaptiveQuality testQuality;
+    testQuality.prepare (48000.0, 6);
+    const double blockSeconds = 480.0 / 48000.0;
+
+    for (int i = 0; i < 100; ++i)
+    {
+        testQuality.update (blockSeconds, 480);
+    }
+
+    jassert (testQuality.getTierIndex() == AdaptiveQuality::numTiers - 1);
+    jassert (testQuality.getTier().maxVoices == 2);
+    jassert (testQuality.getTier().reducedQuality);
+
+    for (int i = 0; i < 500; ++i)
+    {
+        testQuality.update (0.1 * blockSeconds, 480);
+    }
+
+    jassert (testQuality.getTierIndex() == AdaptiveQuality::numTiers - 3);
+
+    testQuality.setEnabled (false);
+    jassert (testQuality.getTierIndex() == 0);
+    jassert (testQuality.getTier().maxVoices == 6);
+
+    // Test reverb: an impulse must come back as the impulse response, across
+    // the direct, head and tail partitions, with the tail rendered inline
+    ConvolutionReverb testReverb;
+    testReverb.prepare ({ 48000.0, 100, 1 }, 0.1);
+    testReverb.setSynchronousTail (true);
+
+    juce::AudioBuffer<float> response (1, 3000);
+    juce::Random random (1);
+
+    for (int i = 0; i < response.getNumSamples(); ++i)
+    {
+        response.setSample (0, i, random.nextFloat() - 0.5f);
+    }
+
+    testReverb.setImpulseResponse (response);
+
+    juce::AudioBuffer<float> impulse (1, 3200);
+    impulse.clear();
+    impulse.setSample (0, 0, 1.0f);
+
+    for (int start = 0; start < impulse.getNumSamples(); start += 100)
+    {
+        testReverb.process (juce::dsp::AudioBlock<float> (impulse).getSubBlock ((size_t) start, 100), 1.0f);
+    }
+
+    for (int i = 1; i < impulse.getNumSamples(); ++i)
+    {
+        const float expected = i < response.getNumSamples() ? response.getSample (0, i) : 0.0f;
+        jassert (std::abs (impulse.getSample (0, i) - expected) < 1.0e-4f);
+    }
+
+    // Test reverb restart: nothing played before a restart is heard after
+    // it, though the tail blocks of the impulse were already rendered
+    testReverb.prepare ({ 48000.0, 100, 1 }, 0.1);
+    testReverb.setImpulseResponse (response);
+    impulse.clear();
+    impulse.setSample (0, 0, 1.0f);
+
+    for (int start = 0; start < impulse.getNumSamples(); start += 100)
+    {
+        if (start == 2200)
+        {
+            testReverb.restart();
+        }
+
+        testReverb.process (juce::dsp::AudioBlock<float> (impulse).getSubBlock ((size_t) start, 100), 1.0f);
+    }
+
+    jassert (impulse.getMagnitude (0, 2100, 100) > 0.0f);
+    jassert (impulse.getMagnitude (0, 2200, 1000) == 0.0f);
+
+    // Test flight recorder: an overrun dumps the events before it, and a
+    // second overrun straight after is not dumped again
+    const auto dumpFolder = juce::File::getSpecialLocation (juce::File::tempDirectory).getChildFile ("Subsynth flight recorder test");
+    FlightRecorder testRecorder;
+    testRecorder.setDumpDirectory (dumpFolder);
+    testRecorder.prepare (48000.0, true);
+
+    const juce::uint8 noteOn[] { 0x90, 60, 100 };
+    testRecorder.recordMidi (noteOn, 3, 10);
+    testRecorder.recordParameter ("filter", { 1.0f, 800.0f, 2.0f });
+    testRecorder.recordBlock (480, 1.0);
+    testRecorder.useTimeSlice();
+    jassert (testRecorder.getNumDumps() == 0);
+
+    testRecorder.recordBlock (480, 20.0);
+    testRecorder.recordBlock (480, 20.0);
+    testRecorder.useTimeSlice();
+    testRecorder.recordBlock (480, 20.0);
+    testRecorder.useTimeSlice();
+    jassert (testRecorder.getNumDumps() == 1);
+
+    const auto dump = testRecorder.getLastDump().loadFileAsString();
+    jassert (dump.contains ("Note on C3") && dump.contains ("filter = 1.000, 800.000, 2.000") && dump.contains ("OVERRUN"));
+    dumpFolder.deleteRecursively();
+
+    // Test checkpoints: a processor restored from a checkpoint taken mid-note
+    // renders on exactly as the one it was taken from
+    auto isSame = [] (const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b) {
+        for (int channel = 0; channel < a.getNumChannels(); ++channel)
+        {
+            if (std::memcmp (a.getReadPointer (channel), b.getReadPointer (channel), sizeof (float) * (size_t) a.getNumSamples()) != 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    SubsynthAudioProcessor original, restored;
+
+    for (auto* testProcessor : { &original, &restored })
+    {
+        testProcessor->setNonRealtime (true);
+        testProcessor->setEffectsBypassed (true);
+        testProcessor->prepareToPlay (48000.0, 480);
+    }
+
+    juce::AudioBuffer<float> originalBlock (original.getTotalNumOutputChannels(), 480);
+    juce::AudioBuffer<float> restoredBlock (restored.getTotalNumOutputChannels(), 480);
+    juce::MidiBuffer testMidi;
+    testMidi.addEvent (juce::MidiMessage::noteOn (1, 60, 0.9f), 10);
+    testMidi.addEvent (juce::MidiMessage::noteOn (1, 67, 0.5f), 200);
+
+    for (int block = 0; block < 10; ++block)
+    {
+        originalBlock.clear();
+        original.processBlock (originalBlock, testMidi);
+        testMidi.clear();
+    }
+
+    const auto checkpoint = original.createCheckpoint();
+    jassert (restored.restoreCheckpoint (checkpoint));
+    jassert (restored.createCheckpoint() == checkpoint);
+
+    for (int block = 0; block < 30; ++block)
+    {
+        juce::MidiBuffer originalMidi, restoredMidi;
+
+        if (block == 5)
+        {
+            originalMidi.addEvent (juce::MidiMessage::noteOff (1, 60), 100);
+            restoredMidi.addEvent (juce::MidiMessage::noteOff (1, 60), 100);
+        }
+
+        originalBlock.clear();
+        restoredBlock.clear();
+        original.processBlock (originalBlock, originalMidi);
+        restored.processBlock (restoredBlock, restoredMidi);
+        jassert (isSame (originalBlock, restoredBlock));
+    }
+
+    // Test micro-blocks: a note part way through a host block starts on its
+    // own sample, not at the end of the first micro-block
+    SubsynthAudioProcessor microBlockTest;
+    microBlockTest.setNonRealtime (true);
+    microBlockTest.setEffectsBypassed (true);
+    microBlockTest.prepareToPlay (48000.0, 512);
+
+    juce::AudioBuffer<float> microBlockOutput (microBlockTest.getTotalNumOutputChannels(), 512);
+    juce::MidiBuffer microBlockNote;
+    microBlockNote.addEvent (juce::MidiMessage::noteOn (1, 60, 0.9f), 300);
+    microBlockOutput.clear();
+    microBlockTest.processBlock (microBlockOutput, microBlockNote);
+
+    jassert (microBlockOutput.getMagnitude (0, 0, 300) == 0.0f);
+    jassert (microBlockOutput.getMagnitude (0, 300, 16) > 0.0f);
+
+    // Test sample streaming: a sample note cut off by a change of waveform
+    // lets go of its zone, so reloading the samples can free the old map
+    const auto sampleFolder = juce::File::getSpecialLocation (juce::File::tempDirectory).getChildFile ("Subsynth sample test");
+    const auto sampleFile = sampleFolder.getChildFile ("C4.wav");
+    sampleFolder.createDirectory();
+    sampleFile.deleteFile();
+
+    {
+        juce::AudioBuffer<float> tone (1, 48000);
+
+        for (int i = 0; i < tone.getNumSamples(); ++i)
+        {
+            tone.setSample (0, i, 0.5f * std::sin (juce::MathConstants<float>::twoPi * 261.63f * (float) i / 48000.0f));
+        }
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer (wav.createWriterFor (new juce::FileOutputStream (sampleFile), 48000.0, 1, 16, {}, 0));
+        jassert (writer != nullptr);
+        writer->writeFromAudioSampleBuffer (tone, 0, tone.getNumSamples());
+    }
+
+    {
+        SubsynthAudioProcessor sampleTest;
+        sampleTest.setNonRealtime (true);
+        sampleTest.setEffectsBypassed (true);
+        sampleTest.prepareToPlay (48000.0, 512);
+        jassert (sampleTest.loadSamples ({ sampleFile }));
+        sampleTest.changeWaveform (CustomVoice::sampleWave);
+
+        auto isStreaming = [&sampleTest] {
+            for (auto* playhead : sampleTest.samplePlayheads)
+            {
+                if (playhead->zone.load() != nullptr)
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        };
+
+        juce::AudioBuffer<float> sampleOutput (sampleTest.getTotalNumOutputChannels(), 512);
+        juce::MidiBuffer sampleNote;
+        sampleNote.addEvent (juce::MidiMessage::noteOn (1, 60, 0.9f), 0);
+        sampleTest.processBlock (sampleOutput, sampleNote);
+        jassert (isStreaming());
+
+        sampleTest.changeWaveform (1);
+        sampleNote.clear();
+        sampleTest.processBlock (sampleOutput, sampleNote);
+        jassert (! isStreaming());
+
+        jassert (sampleTest.loadSamples ({ sampleFile }));
+        sampleTest.processBlock (sampleOutput, sampleNote);
+        sampleTest.sampleStreamer.useTimeSlice();
+        jassert (! isStreaming());
+
+        sampleTest.releaseResources();
+    }
+
+    sampleFolder.deleteRecursively();
+
+    // Test parallel rendering: split at the gaps between notes, the render
+    // matches one from the top sample for sample
+    juce::MidiMessageSequence testSequence;
+
+    for (int note = 0; note < 6; ++note)
+    {
+        testSequence.addEvent (juce::MidiMessage::noteOn (1, 48 + 5 * note, 0.8f), 28800.0 * note + 100.0);
+        testSequence.addEvent (juce::MidiMessage::noteOff (1, 48 + 5 * note), 28800.0 * note + 9000.0);
+    }
+
+    testSequence.addEvent (juce::MidiMessage::pitchWheel (1, 10000), 40000.0);
+    testSequence.updateMatchedPairs();
+
+    ParallelRender::Settings renderSettings;
+    renderSettings.blockSize = 480;
+    renderSettings.numThreads = 2;
+    renderSettings.minSegmentSeconds = 0.5;
+    renderSettings.quietSeconds = 0.2;
+
+    juce::AudioBuffer<float> sequentialRender, parallelRender;
+    ParallelRender::renderSequential (testSequence, 4 * 48000, sequentialRender, renderSettings);
+    const auto renderReport = ParallelRender::render (testSequence, 4 * 48000, parallelRender, renderSettings);
+
+    jassert (renderReport.checkpointed && renderReport.numSegments > 1);
+    jassert (renderReport.numVerified + renderReport.numRerendered == renderReport.numSegments - 1);
+    jassert (isSame (sequentialRender, parallelRender));
 }
 //==============================================================================
 // This creates new instances of the plugin..
@@ -23,7 +23,18 @@
 
 #pragma once
 
+#include "AdaptiveQuality.h"
+#include "AttackCache.h"
+#include "Checkpoint.h"
+#include "CustomSynthesiser.h"
 #include "CustomVoice.h"
+#include "EffectsBus.h"
+#include "FlightRecorder.h"
+#include "LowLatencyMode.h"
+#include "MidiEventQueue.h"
+#include "MidiMapping.h"
+#include "PolyphaseUpsampler.h"
+#include "RealtimeChecker.h"
 #include "WfVisualiser.h"
 #include <JuceHeader.h>
 
@@ -75,19 +86,145 @@ public:
     void changeWaveform (int);
     void changeVolume (double);
     void changeFilter (int, double, double);
+    bool loadSamples (const juce::Array<juce::File>&);
+    void setCustomWaveHarmonics (const std::vector<float>&);
+    void setCustomWaveCycle (const std::vector<float>&);
+    void changeModEnvelope (juce::ADSR::Parameters);
+    void setModulationRoutes (const std::vector<ModRoute>&);
+    const std::vector<ModRoute>& getModulationRoutes() const { return modRoutes; }
+    void setLfoRate (int, float);
+    void changeControlInterval (int);
+    void changeSubOscillator (float, int);
+    void changeNoise (float, NoiseGenerator::Colour);
+    void changeFM (float, float, FMOscillator::Mode);
+    void changeGranular (const GranularOscillator::Parameters&);
+    void changeEffects (const EffectsBus::Parameters&);
+    const EffectsBus::Parameters& getEffects() const { return effects.getParameters(); }
+    void addMidiEvent (const juce::MidiMessage&);
+    void setAdaptiveQuality (bool);
+    int getQualityTier() const { return quality.getTierIndex(); }
+    float getRenderLoad() const { return quality.getLoad(); }
+    void setFixedInternalRate (bool);
+    double getEngineSampleRate() const { return engineSampleRate; }
+    void setAttackCache (bool);
+    void startMidiLearn (MidiMapping::Parameter);
+    void mapController (int, int, MidiMapping::Parameter);
+    void clearMidiMapping (MidiMapping::Parameter);
+    const MidiMapping& getMidiMapping() const { return midiMapping; }
+    void setFlightRecorder (bool);
+    void setFlightRecorderDirectory (const juce::File&);
+    const FlightRecorder& getFlightRecorder() const { return flightRecorder; }
+    bool canCheckpoint() const;
+    juce::MemoryBlock createCheckpoint();
+    bool restoreCheckpoint (const juce::MemoryBlock&);
+    void setEffectsBypassed (bool);
+    void applyEffects (juce::AudioBuffer<float>&);
+
+    // The lowest rate the engine runs at when the fixed internal rate is on
+    static constexpr double minimumInternalRate = 44100.0;
+
+    // The most samples the voices render at once, whatever the host's block size
+    static constexpr int microBlockSize = 64;
+
+    WaveformVisualiser& getVisualiser();
 
     void runTests();
     //==============================================================================
     // Public vars
     juce::MidiKeyboardState keyState;
 
-    // Waveform Visualizer
-    WaveformVisualiser wfVisualiser;
-
 private:
+    void compileModulation();
+    void applyQualityTier();
+    void limitPolyphony (int);
+    void startBackgroundThreads();
+    void renderEngine (juce::AudioBuffer<float>&, juce::MidiBuffer&);
+    void renderUpsampled (juce::AudioBuffer<float>&);
+    void applyMappedParameter (MidiMapping::Parameter, float);
+
+    template <typename Visitor>
+    void visitState (Visitor&);
+
     //==============================================================================
-    juce::Synthesiser synth;
+    CustomSynthesiser synth;
     int numVoices = 6;
 
+    // Non-host MIDI, such as the on-screen keyboard, reaches the audio thread
+    // through midiInjector's lock-free queue and is merged with the host's
+    // events into blockMidi. microBlockMidi holds the events of the micro-block
+    // being rendered. The storage of both is reserved in prepareToPlay.
+    MidiInjector midiInjector { keyState };
+    juce::MidiBuffer blockMidi;
+    juce::MidiBuffer microBlockMidi;
+
+    // Sample playback: the published multisample, one streaming playhead per
+    // voice, and the client keeping the played pages resident
+    RcuPointer<SampleMap> sampleMap;
+    juce::OwnedArray<SampleOscillator::Playhead> samplePlayheads;
+    SampleStreamer sampleStreamer { sampleMap, samplePlayheads };
+
+    // Custom waveform: the published wavetable and the client building it
+    RcuPointer<Wavetable> wavetable;
+    WavetableBuilder wavetableBuilder { wavetable };
+
+    // The last few seconds of the audio thread's input and block times,
+    // dumped to disk when a block misses its deadline
+    FlightRecorder flightRecorder;
+
+    // Runs the sample streamer, the wavetable builder and the flight
+    // recorder's dumps
+    juce::TimeSliceThread backgroundThread { "Subsynth background" };
+
+    // Modulation matrix: the routes as edited, and their compiled form as
+    // published to the voices. midiControllers holds the latest value of
+    // each MIDI CC for the matrix's CC sources.
+    std::vector<ModRoute> modRoutes;
+    float lfoRates[2] { 1.0f, 0.25f };
+    RcuPointer<CompiledModMatrix> modulation;
+    float midiControllers[128] {};
+
+    // Hardware controllers routed to parameters. Their values go to the
+    // voices' mapped parameters, on the audio thread only.
+    MidiMapping midiMapping;
+
+    // Chorus, delay and reverb on the summed voices, and the thread that
+    // renders the reverb's long tail partitions
+    EffectsBus effects;
+    juce::TimeSliceThread effectsThread { "Subsynth reverb tail" };
+
+    // Set while a parallel render runs the voices on their own, to apply
+    // the effects to their output afterwards with applyEffects
+    bool effectsBypassed = false;
+
+    // Render time against the block deadline, and the tier of polyphony and
+    // voice quality it allows. Held at full quality for offline rendering.
+    AdaptiveQuality quality;
+    bool adaptiveQualityEnabled = true;
+
+    // Fixed internal rate: at high host rates the voices and effects run at
+    // a whole fraction of the host rate, into engineBuffer, and the upsampler
+    // converts their output at the bus. Off for offline rendering.
+    PolyphaseUpsampler upsampler;
+    juce::AudioBuffer<float> engineBuffer;
+    juce::MidiBuffer engineMidi;
+    double engineSampleRate = 44100.0;
+    bool fixedInternalRateEnabled = false;
+
+    // Attack cache: the opening of notes memoised while the patch is
+    // unchanged. patchVersion counts changes to the voices' settings, and
+    // the cache forgets everything when it moves on.
+    AttackCache attackCache;
+    bool attackCacheEnabled = false;
+    std::atomic<juce::uint32> patchVersion { 0 };
+
+    // Waveform visualiser, created with the first editor. The audio thread
+    // feeds it through visualiserForAudio once it exists.
+    std::unique_ptr<WaveformVisualiser> visualiser;
+    std::atomic<WaveformVisualiser*> visualiserForAudio { nullptr };
+
+    // Set in prepareToPlay when the low-latency mode should move the next
+    // audio callback's thread into the real-time scheduling class
+    std::atomic<bool> promoteAudioThread { false };
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SubsynthAudioProcessor)
 };
@@ -0,0 +1,201 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for a polyphase
+    upsampler that converts the synth engine's fixed internal rate to a
+    whole multiple of it used by the host.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "PolyphaseUpsampler.h"
+
+// Picks the largest factor that keeps the internal rate at or above a minimum.
+//
+// @param hostRate: The sample rate the host runs at.
+// @param minimumInternalRate: The lowest rate the engine may run at, e.g. 44100.
+// @return The factor, 1 if the host rate is already low enough.
+int PolyphaseUpsampler::chooseFactor (double hostRate, double minimumInternalRate) noexcept
+{
+    for (int candidate = maxFactor; candidate > 1; --candidate)
+    {
+        if (hostRate / candidate >= minimumInternalRate - 1.0)
+        {
+            return candidate;
+        }
+    }
+
+    return 1;
+}
+
+// Designs the filter and clears the history. Allocates, so call before playback.
+//
+// @param newFactor: The number of output samples per input sample, 1 to maxFactor.
+// @param newNumChannels: The number of channels to convert.
+void PolyphaseUpsampler::prepare (int newFactor, int newNumChannels)
+{
+    factor = juce::jlimit (1, maxFactor, newFactor);
+    numChannels = juce::jmax (0, newNumChannels);
+
+    // A sinc cut off at the input's Nyquist frequency, centred on sample
+    // length / 2. Its first sample falls on a zero of the sinc, so the
+    // filter is symmetric and the latency is exactly length / 2 samples.
+    const int length = tapsPerPhase * factor;
+    std::vector<float> window ((size_t) length + 1);
+    juce::dsp::WindowingFunction<float>::fillWindowingTables (window.data(), window.size(), juce::dsp::WindowingFunction<float>::kaiser, false, 8.0f);
+
+    std::vector<float> impulse ((size_t) length);
+
+    for (int n = 0; n < length; ++n)
+    {
+        const double x = juce::MathConstants<double>::pi * (n - length / 2) / factor;
+        impulse[(size_t) n] = (float) (n == length / 2 ? 1.0 : std::sin (x) / x) * window[(size_t) n];
+    }
+
+    coefficients.assign ((size_t) (tapsPerPhase * maxFactor), 0.0f);
+
+    for (int phase = 0; phase < factor; ++phase)
+    {
+        // Each phase passes DC at unity gain, so no image of DC is left at
+        // the input rate
+        float sum = 0.0f;
+
+        for (int k = 0; k < tapsPerPhase; ++k)
+        {
+            sum += impulse[(size_t) (phase + k * factor)];
+        }
+
+        for (int k = 0; k < tapsPerPhase; ++k)
+        {
+            const int tap = tapsPerPhase - 1 - k;
+            coefficients[(size_t) (tap * maxFactor + phase)] = impulse[(size_t) (phase + k * factor)] / sum;
+        }
+    }
+
+    history.assign ((size_t) (numChannels * 2 * tapsPerPhase), 0.0f);
+    pending.assign ((size_t) (numChannels * maxFactor), 0.0f);
+    reset();
+}
+
+// Clears the history, e.g. when playback restarts.
+void PolyphaseUpsampler::reset() noexcept
+{
+    std::fill (history.begin(), history.end(), 0.0f);
+    std::fill (pending.begin(), pending.end(), 0.0f);
+    historyIndex = 0;
+    nextPhase = factor;
+}
+
+// Returns how many input samples the next call to process will consume.
+//
+// @param numOutputSamples: The size of the next output block.
+// @return The number of input samples to render, which may be 0 for an
+// output block shorter than the factor.
+int PolyphaseUpsampler::getNumInputSamplesNeeded (int numOutputSamples) const noexcept
+{
+    const int available = factor - nextPhase;
+    return juce::jmax (0, (numOutputSamples - available + factor - 1) / factor);
+}
+
+// Maps a position in the next output block to the input sample it will be
+// computed from, e.g. to place MIDI events.
+//
+// @param outputSample: The position in the next output block.
+// @param numInputSamples: The value getNumInputSamplesNeeded returned.
+// @return The position in the next input block.
+int PolyphaseUpsampler::getInputPosition (int outputSample, int numInputSamples) const noexcept
+{
+    const int available = factor - nextPhase;
+
+    if (outputSample < available)
+    {
+        return 0;
+    }
+
+    return juce::jlimit (0, juce::jmax (0, numInputSamples - 1), (outputSample - available) / factor);
+}
+
+// Converts a block. Allocation free.
+//
+// @param input: The input samples, at least getNumInputSamplesNeeded (numOutputSamples).
+// @param numInputSamples: The number of input samples.
+// @param output: The buffer to replace.
+// @param numOutputSamples: The number of output samples to produce.
+void PolyphaseUpsampler::process (const juce::AudioBuffer<float>& input, int numInputSamples, juce::AudioBuffer<float>& output, int numOutputSamples) noexcept
+{
+    const int channels = juce::jmin (numChannels, input.getNumChannels(), output.getNumChannels());
+
+    if (factor == 1)
+    {
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            output.copyFrom (channel, 0, input, channel, 0, juce::jmin (numInputSamples, numOutputSamples));
+        }
+
+        return;
+    }
+
+    int inputSample = 0;
+
+    for (int n = 0; n < numOutputSamples;)
+    {
+        if (nextPhase == factor)
+        {
+            jassert (inputSample < numInputSamples);
+
+            const int writeIndex = historyIndex;
+            historyIndex = (historyIndex + 1) % tapsPerPhase;
+
+            for (int channel = 0; channel < channels; ++channel)
+            {
+                auto* channelHistory = history.data() + channel * 2 * tapsPerPhase;
+                const float x = inputSample < numInputSamples ? input.getSample (channel, inputSample) : 0.0f;
+
+                channelHistory[writeIndex] = x;
+                channelHistory[writeIndex + tapsPerPhase] = x;
+
+                // Every phase at once, the newest tapsPerPhase samples oldest first
+                const float* window = channelHistory + historyIndex;
+                float sums[maxFactor] {};
+
+                for (int tap = 0; tap < tapsPerPhase; ++tap)
+                {
+                    for (int phase = 0; phase < maxFactor; ++phase)
+                    {
+                        sums[phase] += coefficients[(size_t) (tap * maxFactor + phase)] * window[tap];
+                    }
+                }
+
+                std::copy (std::begin (sums), std::end (sums), pending.begin() + channel * maxFactor);
+            }
+
+            ++inputSample;
+            nextPhase = 0;
+        }
+
+        const int count = juce::jmin (factor - nextPhase, numOutputSamples - n);
+
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            juce::FloatVectorOperations::copy (output.getWritePointer (channel, n), pending.data() + channel * maxFactor + nextPhase, count);
+        }
+
+        n += count;
+        nextPhase += count;
+    }
+}
@@ -0,0 +1,73 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for a polyphase upsampler
+    that converts the synth engine's fixed internal rate to a whole
+    multiple of it used by the host.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// Upsamples by a whole factor of 1 to maxFactor with a linear phase,
+// Kaiser windowed sinc low pass cut off at the input's Nyquist frequency.
+// The filter is split into one short phase per output sample, so each input
+// sample costs tapsPerPhase multiply-adds per output sample, and all the
+// phases of an input sample are computed together, maxFactor lanes wide.
+//
+// Output blocks need not be whole multiples of the factor: output computed
+// beyond the end of one block is kept for the start of the next.
+class PolyphaseUpsampler
+{
+public:
+    static constexpr int maxFactor = 4;
+    static constexpr int tapsPerPhase = 32;
+
+    static int chooseFactor (double, double) noexcept;
+
+    void prepare (int, int);
+    void reset() noexcept;
+
+    int getFactor() const noexcept { return factor; }
+    int getLatencyInSamples() const noexcept { return factor > 1 ? factor * tapsPerPhase / 2 : 0; }
+
+    int getNumInputSamplesNeeded (int) const noexcept;
+    int getInputPosition (int, int) const noexcept;
+    void process (const juce::AudioBuffer<float>&, int, juce::AudioBuffer<float>&, int) noexcept;
+
+private:
+    int factor = 1;
+    int numChannels = 0;
+
+    // coefficients[tap * maxFactor + phase], with the taps in time order so
+    // they line up with a channel's history, oldest sample first
+    std::vector<float> coefficients;
+
+    // Each channel's last tapsPerPhase input samples, written twice so the
+    // newest tapsPerPhase are always contiguous
+    std::vector<float> history;
+    int historyIndex = 0;
+
+    // Every phase of the latest input sample, per channel; those from
+    // nextPhase on have not been output yet
+    std::vector<float> pending;
+    int nextPhase = 0;
+};
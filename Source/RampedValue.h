@@ -0,0 +1,140 @@
+/*
+  ==============================================================================
+
+    This file contains the header and implementation information for a
+    linearly smoothed value whose ramp can be checkpointed.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// The same linear ramp as juce::SmoothedValue<float>, step for step, with
+// the ramp in progress visible to checkpoints, which juce::SmoothedValue
+// keeps private. Only the calls the oscillators and MIDI mapping use, and
+// rampTo, a ramp of a given length, for modulation at control rate.
+class RampedValue
+{
+public:
+    RampedValue() = default;
+    explicit RampedValue (float initialValue) noexcept : current (initialValue), target (initialValue) {}
+
+    // Sets the ramp length and jumps to the target
+    //
+    // @param sampleRate: Steps per second.
+    // @param rampLengthInSeconds: Time a change of target takes.
+    void reset (double sampleRate, double rampLengthInSeconds) noexcept
+    {
+        jassert (sampleRate > 0.0 && rampLengthInSeconds >= 0.0);
+        stepsToTarget = (int) std::floor (rampLengthInSeconds * sampleRate);
+        setCurrentAndTargetValue (target);
+    }
+
+    void setCurrentAndTargetValue (float newValue) noexcept
+    {
+        target = current = newValue;
+        countdown = 0;
+    }
+
+    void setTargetValue (float newValue) noexcept
+    {
+        if (newValue == target)
+        {
+            return;
+        }
+
+        if (stepsToTarget <= 0)
+        {
+            setCurrentAndTargetValue (newValue);
+            return;
+        }
+
+        target = newValue;
+        countdown = stepsToTarget;
+        step = (target - current) / (float) countdown;
+    }
+
+    // Ramps linearly to a value over exactly numSteps steps, whatever the
+    // ramp length set by reset
+    void rampTo (float newValue, int numSteps) noexcept
+    {
+        if (numSteps <= 0)
+        {
+            setCurrentAndTargetValue (newValue);
+            return;
+        }
+
+        target = newValue;
+        countdown = numSteps;
+        step = (target - current) / (float) countdown;
+    }
+
+    float getNextValue() noexcept
+    {
+        if (! isSmoothing())
+        {
+            return target;
+        }
+
+        --countdown;
+        current = isSmoothing() ? current + step : target;
+        return current;
+    }
+
+    // Advances numSamples steps at once
+    //
+    // @return The value after the last of them.
+    float skip (int numSamples) noexcept
+    {
+        if (numSamples >= countdown)
+        {
+            setCurrentAndTargetValue (target);
+            return target;
+        }
+
+        current += step * (float) numSamples;
+        countdown -= numSamples;
+        return current;
+    }
+
+    bool isSmoothing() const noexcept { return countdown > 0; }
+    float getCurrentValue() const noexcept { return current; }
+    float getTargetValue() const noexcept { return target; }
+
+    // The step of a finished ramp is never read again, so it is left out,
+    // and a ramp that has settled checkpoints the same however it got there
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        visit (current, target, countdown, stepsToTarget);
+
+        if (countdown > 0)
+        {
+            visit (step);
+        }
+    }
+
+private:
+    float current = 0.0f;
+    float target = 0.0f;
+    float step = 0.0f;
+    int countdown = 0;
+    int stepsToTarget = 0;
+};
@@ -0,0 +1,107 @@
+/*
+  ==============================================================================
+
+    This file contains the header and implementation information for an
+    atomically published pointer with deferred reclamation, used to hand
+    objects built off the audio thread to the audio thread without locks.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// Read-copy-update pointer with a single reader, the audio thread.
+//
+// The audio thread calls get() as often as it likes during a block and
+// finishedReading() once at the end of every block. Any other thread can
+// publish() a replacement; the old object is kept until the audio thread has
+// finished a block that started after the swap, and is then deleted by
+// reclaim() on a background thread.
+template <typename ObjectType>
+class RcuPointer
+{
+public:
+    RcuPointer() = default;
+
+    ~RcuPointer()
+    {
+        delete current.exchange (nullptr);
+    }
+
+    // Audio thread: returns the current object (may be nullptr). The pointer
+    // stays valid until the next call to finishedReading.
+    ObjectType* get() const noexcept
+    {
+        return current.load();
+    }
+
+    // Audio thread: marks the end of a block in which get() may have been used.
+    void finishedReading() noexcept
+    {
+        ++epoch;
+    }
+
+    // Makes newObject the current object. The previous one is retired, not deleted.
+    //
+    // @param newObject: The replacement object, may be nullptr.
+    void publish (std::unique_ptr<ObjectType> newObject)
+    {
+        const juce::ScopedLock sl (writerLock);
+
+        std::unique_ptr<ObjectType> old (current.exchange (newObject.release()));
+
+        if (old != nullptr)
+        {
+            retired.push_back ({ std::move (old), epoch.load() });
+        }
+    }
+
+    // Deletes the retired objects the audio thread can no longer be using.
+    void reclaim()
+    {
+        const juce::ScopedLock sl (writerLock);
+        const auto now = epoch.load();
+
+        retired.erase (std::remove_if (retired.begin(), retired.end(), [now] (const Retired& r) { return now > r.retiredAt; }),
+                       retired.end());
+    }
+
+    // Deletes every retired object. Only safe while the audio thread is stopped.
+    void reclaimAll()
+    {
+        const juce::ScopedLock sl (writerLock);
+        retired.clear();
+    }
+
+private:
+    struct Retired
+    {
+        std::unique_ptr<ObjectType> object;
+        juce::uint64 retiredAt;
+    };
+
+    std::atomic<ObjectType*> current { nullptr };
+    std::atomic<juce::uint64> epoch { 0 };
+
+    juce::CriticalSection writerLock;
+    std::vector<Retired> retired;
+
+    JUCE_DECLARE_NON_COPYABLE (RcuPointer)
+};
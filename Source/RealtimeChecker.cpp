@@ -0,0 +1,406 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the real-time
+    safety checker, a debug build mode that reports allocations, lock
+    acquisitions and blocking system calls made on the audio thread.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "RealtimeChecker.h"
+
+#if SUBSYNTH_RT_CHECKS
+
+#if JUCE_LINUX
+ #include <dlfcn.h>
+ #include <pthread.h>
+ #include <time.h>
+ #include <unistd.h>
+
+// initial-exec keeps the first access on a new thread from calling malloc
+ #define SUBSYNTH_RT_THREAD_LOCAL static thread_local __attribute__ ((tls_model ("initial-exec")))
+#else
+ #define SUBSYNTH_RT_THREAD_LOCAL static thread_local
+#endif
+
+// Per-thread checker state. Plain ints so that no TLS initialiser runs.
+SUBSYNTH_RT_THREAD_LOCAL int audioThreadDepth = 0;
+SUBSYNTH_RT_THREAD_LOCAL int reportDepth = 0;
+
+// The one lock this thread may acquire unreported, or nullptr
+SUBSYNTH_RT_THREAD_LOCAL const void* allowedLock = nullptr;
+
+static std::atomic<int> numViolations { 0 };
+static std::atomic<bool> firstReportReady { false };
+static juce::String firstReport;
+
+// Only the first few violations get a logged stack trace, the rest are counted
+static constexpr int maxLoggedViolations = 16;
+
+static inline bool isCheckingThisThread() noexcept
+{
+    return audioThreadDepth > 0 && reportDepth == 0;
+}
+
+static const char* getViolationName (RealtimeChecker::Violation violation)
+{
+    switch (violation)
+    {
+        case RealtimeChecker::Violation::allocation:
+            return "Allocation";
+        case RealtimeChecker::Violation::deallocation:
+            return "Deallocation";
+        case RealtimeChecker::Violation::lock:
+            return "Lock acquisition";
+        case RealtimeChecker::Violation::systemCall:
+            return "System call";
+    }
+
+    return "Violation";
+}
+
+RealtimeChecker::ScopedAudioThread::ScopedAudioThread()
+{
+    ++audioThreadDepth;
+}
+
+RealtimeChecker::ScopedAudioThread::~ScopedAudioThread()
+{
+    --audioThreadDepth;
+}
+
+RealtimeChecker::ScopedAllowLock::ScopedAllowLock (const juce::CriticalSection& lock)
+    : previous (allowedLock)
+{
+    allowedLock = &lock;
+}
+
+RealtimeChecker::ScopedAllowLock::~ScopedAllowLock()
+{
+    allowedLock = previous;
+}
+
+// Returns the number of violations seen since the last reset.
+int RealtimeChecker::getNumViolations()
+{
+    return numViolations;
+}
+
+// Returns the message and stack trace of the first violation since the last
+// reset, or an empty string if there has not been one.
+juce::String RealtimeChecker::getFirstViolationReport()
+{
+    return firstReportReady ? firstReport : juce::String();
+}
+
+// Clears the violation count. Must not be called while audio is running.
+void RealtimeChecker::resetViolations()
+{
+    firstReportReady = false;
+    firstReport.clear();
+    numViolations = 0;
+}
+
+// Records a violation if the calling thread is inside a ScopedAudioThread,
+// logging the call stack for the first few.
+//
+// @param violation: The kind of operation that was intercepted.
+// @param function: The name of the intercepted function.
+void RealtimeChecker::reportViolation (Violation violation, const char* function)
+{
+    if (! isCheckingThisThread())
+    {
+        return;
+    }
+
+    // Building the report allocates and writes, so stop checking until done
+    ++reportDepth;
+
+    const int count = ++numViolations;
+
+    if (count <= maxLoggedViolations)
+    {
+        const juce::String report = juce::String (getViolationName (violation)) + " on the audio thread in "
+                                    + function + "()\n" + juce::SystemStats::getStackBacktrace();
+
+        if (count == 1)
+        {
+            firstReport = report;
+            firstReportReady = true;
+        }
+
+        juce::Logger::writeToLog (report);
+    }
+
+    --reportDepth;
+}
+
+//============================= Interception ========================================
+
+#if JUCE_LINUX
+// glibc's own entry points, used so the replacements never recurse into themselves
+extern "C" void* __libc_malloc (size_t);
+extern "C" void* __libc_calloc (size_t, size_t);
+extern "C" void* __libc_realloc (void*, size_t);
+extern "C" void* __libc_memalign (size_t, size_t);
+extern "C" void __libc_free (void*);
+
+// A CriticalSection is a single pthread mutex here, so the address a
+// ScopedAllowLock is given is the one pthread_mutex_lock is passed
+static_assert (sizeof (juce::CriticalSection) == sizeof (pthread_mutex_t), "CriticalSection is not a bare pthread mutex");
+
+// Looks up the next definition of an intercepted function.
+template <typename FunctionType>
+static FunctionType findNextSymbol (const char* name)
+{
+    return reinterpret_cast<FunctionType> (dlsym (RTLD_NEXT, name));
+}
+
+using MutexLockFunction = int (*) (pthread_mutex_t*);
+using ReadFunction = ssize_t (*) (int, void*, size_t);
+using WriteFunction = ssize_t (*) (int, const void*, size_t);
+using NanosleepFunction = int (*) (const struct timespec*, struct timespec*);
+using UsleepFunction = int (*) (useconds_t);
+
+// Resolved during static initialisation so the audio thread never calls dlsym
+static MutexLockFunction nextMutexLock = findNextSymbol<MutexLockFunction> ("pthread_mutex_lock");
+static ReadFunction nextRead = findNextSymbol<ReadFunction> ("read");
+static WriteFunction nextWrite = findNextSymbol<WriteFunction> ("write");
+static NanosleepFunction nextNanosleep = findNextSymbol<NanosleepFunction> ("nanosleep");
+static UsleepFunction nextUsleep = findNextSymbol<UsleepFunction> ("usleep");
+
+extern "C"
+{
+    void* malloc (size_t size) noexcept
+    {
+        if (isCheckingThisThread())
+        {
+            RealtimeChecker::reportViolation (RealtimeChecker::Violation::allocation, "malloc");
+        }
+
+        return __libc_malloc (size);
+    }
+
+    void* calloc (size_t count, size_t size) noexcept
+    {
+        if (isCheckingThisThread())
+        {
+            RealtimeChecker::reportViolation (RealtimeChecker::Violation::allocation, "calloc");
+        }
+
+        return __libc_calloc (count, size);
+    }
+
+    void* realloc (void* ptr, size_t size) noexcept
+    {
+        if (isCheckingThisThread())
+        {
+            RealtimeChecker::reportViolation (RealtimeChecker::Violation::allocation, "realloc");
+        }
+
+        return __libc_realloc (ptr, size);
+    }
+
+    void* memalign (size_t alignment, size_t size) noexcept
+    {
+        if (isCheckingThisThread())
+        {
+            RealtimeChecker::reportViolation (RealtimeChecker::Violation::allocation, "memalign");
+        }
+
+        return __libc_memalign (alignment, size);
+    }
+
+    void free (void* ptr) noexcept
+    {
+        if (ptr != nullptr && isCheckingThisThread())
+        {
+            RealtimeChecker::reportViolation (RealtimeChecker::Violation::deallocation, "free");
+        }
+
+        __libc_free (ptr);
+    }
+
+    int pthread_mutex_lock (pthread_mutex_t* mutex) noexcept
+    {
+        // The allowed lock is reported only if another thread holds it, so
+        // allowing it never hides contention
+        if (isCheckingThisThread() && mutex == allowedLock && pthread_mutex_trylock (mutex) == 0)
+        {
+            return 0;
+        }
+
+        if (isCheckingThisThread())
+        {
+            RealtimeChecker::reportViolation (RealtimeChecker::Violation::lock, "pthread_mutex_lock");
+        }
+
+        if (nextMutexLock == nullptr)
+        {
+            nextMutexLock = findNextSymbol<MutexLockFunction> ("pthread_mutex_lock");
+        }
+
+        return nextMutexLock (mutex);
+    }
+
+    ssize_t read (int fd, void* buffer, size_t numBytes)
+    {
+        if (isCheckingThisThread())
+        {
+            RealtimeChecker::reportViolation (RealtimeChecker::Violation::systemCall, "read");
+        }
+
+        if (nextRead == nullptr)
+        {
+            nextRead = findNextSymbol<ReadFunction> ("read");
+        }
+
+        return nextRead (fd, buffer, numBytes);
+    }
+
+    ssize_t write (int fd, const void* buffer, size_t numBytes)
+    {
+        if (isCheckingThisThread())
+        {
+            RealtimeChecker::reportViolation (RealtimeChecker::Violation::systemCall, "write");
+        }
+
+        if (nextWrite == nullptr)
+        {
+            nextWrite = findNextSymbol<WriteFunction> ("write");
+        }
+
+        return nextWrite (fd, buffer, numBytes);
+    }
+
+    int nanosleep (const struct timespec* requested, struct timespec* remaining)
+    {
+        if (isCheckingThisThread())
+        {
+            RealtimeChecker::reportViolation (RealtimeChecker::Violation::systemCall, "nanosleep");
+        }
+
+        if (nextNanosleep == nullptr)
+        {
+            nextNanosleep = findNextSymbol<NanosleepFunction> ("nanosleep");
+        }
+
+        return nextNanosleep (requested, remaining);
+    }
+
+    int usleep (useconds_t microseconds)
+    {
+        if (isCheckingThisThread())
+        {
+            RealtimeChecker::reportViolation (RealtimeChecker::Violation::systemCall, "usleep");
+        }
+
+        if (nextUsleep == nullptr)
+        {
+            nextUsleep = findNextSymbol<UsleepFunction> ("usleep");
+        }
+
+        return nextUsleep (microseconds);
+    }
+}
+
+#else
+// Elsewhere only C++ allocations can be intercepted portably
+void* operator new (size_t size)
+{
+    if (isCheckingThisThread())
+    {
+        RealtimeChecker::reportViolation (RealtimeChecker::Violation::allocation, "operator new");
+    }
+
+    if (auto* ptr = std::malloc (size))
+    {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (size_t size)
+{
+    return operator new (size);
+}
+
+void* operator new (size_t size, const std::nothrow_t&) noexcept
+{
+    if (isCheckingThisThread())
+    {
+        RealtimeChecker::reportViolation (RealtimeChecker::Violation::allocation, "operator new");
+    }
+
+    return std::malloc (size);
+}
+
+void* operator new[] (size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new (size, tag);
+}
+
+void operator delete (void* ptr) noexcept
+{
+    if (ptr != nullptr && isCheckingThisThread())
+    {
+        RealtimeChecker::reportViolation (RealtimeChecker::Violation::deallocation, "operator delete");
+    }
+
+    std::free (ptr);
+}
+
+void operator delete[] (void* ptr) noexcept
+{
+    operator delete (ptr);
+}
+
+void operator delete (void* ptr, size_t) noexcept
+{
+    operator delete (ptr);
+}
+
+void operator delete[] (void* ptr, size_t) noexcept
+{
+    operator delete (ptr);
+}
+#endif
+
+#else
+
+int RealtimeChecker::getNumViolations()
+{
+    return 0;
+}
+
+juce::String RealtimeChecker::getFirstViolationReport()
+{
+    return {};
+}
+
+void RealtimeChecker::resetViolations()
+{
+}
+
+void RealtimeChecker::reportViolation (Violation, const char*)
+{
+}
+
+#endif
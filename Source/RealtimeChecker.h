@@ -0,0 +1,88 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the real-time safety
+    checker, a debug build mode that reports allocations, lock acquisitions
+    and blocking system calls made on the audio thread.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// Set to 1 (the Debug configurations in Subsynth.jucer do) to intercept
+// malloc/free, mutex locks and blocking system calls while processBlock runs.
+#ifndef SUBSYNTH_RT_CHECKS
+ #define SUBSYNTH_RT_CHECKS 0
+#endif
+
+class RealtimeChecker
+{
+public:
+    enum class Violation
+    {
+        allocation,
+        deallocation,
+        lock,
+        systemCall
+    };
+
+    // Marks the current thread as the audio thread for the lifetime of the
+    // object. Anything intercepted while it exists is reported.
+    class ScopedAudioThread
+    {
+    public:
+#if SUBSYNTH_RT_CHECKS
+        ScopedAudioThread();
+        ~ScopedAudioThread();
+#else
+        ScopedAudioThread() {}
+#endif
+        JUCE_DECLARE_NON_COPYABLE (ScopedAudioThread)
+    };
+
+    // Lets the current thread acquire one lock unreported for the lifetime of
+    // the object, for a lock no other thread takes while audio runs, so that
+    // it never blocks. It is still reported if it is ever found held by
+    // another thread, and every other lock is reported as before.
+    class ScopedAllowLock
+    {
+    public:
+#if SUBSYNTH_RT_CHECKS
+        explicit ScopedAllowLock (const juce::CriticalSection&);
+        ~ScopedAllowLock();
+#else
+        explicit ScopedAllowLock (const juce::CriticalSection&) {}
+#endif
+        JUCE_DECLARE_NON_COPYABLE (ScopedAllowLock)
+
+    private:
+#if SUBSYNTH_RT_CHECKS
+        const void* previous;
+#endif
+    };
+
+    static bool isEnabled() { return SUBSYNTH_RT_CHECKS != 0; }
+    static int getNumViolations();
+    static juce::String getFirstViolationReport();
+    static void resetViolations();
+
+    static void reportViolation (Violation, const char*);
+};
@@ -0,0 +1,389 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the sample-playback
+    oscillator: a key/velocity multisample map over memory-mapped WAV/AIFF
+    files, the per-voice player, and the background page streamer.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "SampleOscillator.h"
+
+// Maps a set of WAV/AIFF files into a multisample. Each file's root note and
+// velocity layer are taken from its name, e.g. "Piano_C4_v80.wav" plays
+// around middle C for velocities up to 80. The keyboard is split halfway
+// between neighbouring root notes, and the loudest layer of each root
+// extends to velocity 127. A file without a note name is rooted at C4.
+//
+// @param files: The sample files to load. Unreadable files are skipped.
+// @param attackSeconds: How much of the start of each file to decode and keep resident.
+// @return The new map, or nullptr if none of the files could be loaded.
+std::unique_ptr<SampleMap> SampleMap::loadFiles (const juce::Array<juce::File>& files, double attackSeconds)
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    std::vector<std::unique_ptr<SampleZone>> loaded;
+
+    for (auto& file : files)
+    {
+        auto* format = formats.findFormatForFileExtension (file.getFileExtension());
+
+        if (format == nullptr)
+        {
+            continue;
+        }
+
+        // Only WAV and AIFF can be memory mapped; other formats return nullptr
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader (format->createMemoryMappedReader (file));
+
+        if (reader == nullptr || reader->numChannels > SampleZone::maxChannels || ! reader->mapEntireFile())
+        {
+            continue;
+        }
+
+        auto zone = std::make_unique<SampleZone>();
+        zone->file = file;
+        zone->sampleRate = reader->sampleRate;
+        zone->lengthInSamples = reader->lengthInSamples;
+        zone->numChannels = (int) reader->numChannels;
+
+        for (auto& token : juce::StringArray::fromTokens (file.getFileNameWithoutExtension(), "_- ", ""))
+        {
+            const int note = parseNoteName (token);
+
+            if (note >= 0)
+            {
+                zone->rootNote = note;
+            }
+            else if (token.length() > 1 && token.startsWithIgnoreCase ("v") && token.substring (1).containsOnly ("0123456789"))
+            {
+                zone->highVelocity = juce::jlimit (1, 127, token.substring (1).getIntValue());
+            }
+        }
+
+        const int attackLength = (int) juce::jmin (zone->lengthInSamples, (juce::int64) (attackSeconds * zone->sampleRate));
+        zone->attack.setSize (zone->numChannels, attackLength);
+        reader->read (&zone->attack, 0, attackLength, 0, true, true);
+
+        zone->reader = std::move (reader);
+        loaded.push_back (std::move (zone));
+    }
+
+    if (loaded.empty())
+    {
+        return nullptr;
+    }
+
+    std::sort (loaded.begin(), loaded.end(), [] (const std::unique_ptr<SampleZone>& a, const std::unique_ptr<SampleZone>& b) {
+        return a->rootNote != b->rootNote ? a->rootNote < b->rootNote : a->highVelocity < b->highVelocity;
+    });
+
+    juce::Array<int> roots;
+
+    for (auto& zone : loaded)
+    {
+        roots.addIfNotAlreadyThere (zone->rootNote);
+    }
+
+    auto map = std::make_unique<SampleMap>();
+
+    for (size_t i = 0; i < loaded.size(); ++i)
+    {
+        auto& zone = *loaded[i];
+        const int rootIndex = roots.indexOf (zone.rootNote);
+
+        zone.lowNote = rootIndex == 0 ? 0 : (roots[rootIndex - 1] + zone.rootNote) / 2 + 1;
+        zone.highNote = rootIndex == roots.size() - 1 ? 127 : (zone.rootNote + roots[rootIndex + 1]) / 2;
+
+        const bool firstLayer = i == 0 || loaded[i - 1]->rootNote != zone.rootNote;
+        const bool lastLayer = i == loaded.size() - 1 || loaded[i + 1]->rootNote != zone.rootNote;
+
+        zone.lowVelocity = firstLayer ? 1 : loaded[i - 1]->highVelocity + 1;
+        zone.highVelocity = lastLayer ? 127 : zone.highVelocity;
+    }
+
+    for (auto& zone : loaded)
+    {
+        map->zones.add (zone.release());
+    }
+
+    return map;
+}
+
+// Converts a note name such as "C4", "F#2" or "Bb1", or a plain MIDI number
+// such as "60", to a MIDI note number. C4 is middle C (60).
+//
+// @param token: The text to convert.
+// @return The MIDI note number, or -1 if token is not a note.
+int SampleMap::parseNoteName (const juce::String& token)
+{
+    if (token.isNotEmpty() && token.containsOnly ("0123456789"))
+    {
+        const int note = token.getIntValue();
+        return note <= 127 ? note : -1;
+    }
+
+    const auto letter = juce::CharacterFunctions::toUpperCase (token[0]);
+
+    if (letter < 'A' || letter > 'G')
+    {
+        return -1;
+    }
+
+    // Semitone offsets of the natural notes, indexed from C
+    int note = juce::String ("C-D-EF-G-A-B").indexOfChar (letter);
+    int octaveStart = 1;
+
+    if (token[1] == '#')
+    {
+        ++note;
+        ++octaveStart;
+    }
+    else if (token[1] == 'b')
+    {
+        --note;
+        ++octaveStart;
+    }
+
+    const auto octave = token.substring (octaveStart);
+    const auto digits = octave.startsWithChar ('-') ? octave.substring (1) : octave;
+
+    if (digits.isEmpty() || ! digits.containsOnly ("0123456789"))
+    {
+        return -1;
+    }
+
+    note += (octave.getIntValue() + 1) * 12;
+
+    return juce::isPositiveAndNotGreaterThan (note, 127) ? note : -1;
+}
+
+// Finds the zone that should play a note.
+//
+// @param midiNoteNumber: The note being played.
+// @param velocity: The MIDI velocity of the note, 1 to 127.
+// @return The matching zone, or nullptr if no zone covers the note.
+const SampleZone* SampleMap::findZone (int midiNoteNumber, int velocity) const noexcept
+{
+    for (auto* zone : zones)
+    {
+        if (midiNoteNumber >= zone->lowNote && midiNoteNumber <= zone->highNote
+            && velocity >= zone->lowVelocity && velocity <= zone->highVelocity)
+        {
+            return zone;
+        }
+    }
+
+    return nullptr;
+}
+
+//==============================================================================
+
+// Stores the playback sample rate.
+//
+// @param spec: The prep info of the owning voice.
+void SampleOscillator::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    sampleRate = spec.sampleRate;
+    stop();
+}
+
+// Connects the oscillator to the processor's sample map and gives it the
+// playhead slot the streaming thread watches for this voice.
+//
+// @param samples: The processor's published sample map.
+// @param streamingPlayhead: This voice's slot in the streamer.
+void SampleOscillator::setSource (RcuPointer<SampleMap>* samples, Playhead* streamingPlayhead)
+{
+    source = samples;
+    playhead = streamingPlayhead;
+}
+
+// Starts playing the zone that covers a note, from the start of the sample.
+//
+// @param midiNoteNumber: The note to be played.
+// @param velocity: The velocity of the note, 0 to 1.
+// @param frequency: The frequency of the note in Hz, used to repitch the zone.
+void SampleOscillator::noteOn (int midiNoteNumber, float velocity, double frequency) noexcept
+{
+    stop();
+
+    playingMap = source != nullptr ? source->get() : nullptr;
+
+    if (playingMap == nullptr)
+    {
+        return;
+    }
+
+    zone = playingMap->findZone (midiNoteNumber, juce::jlimit (1, 127, juce::roundToInt (velocity * 127.0f)));
+
+    if (zone == nullptr)
+    {
+        return;
+    }
+
+    position = 0.0;
+    frameAIndex = -1;
+    increment = frequency / juce::MidiMessage::getMidiNoteInHertz (zone->rootNote) * zone->sampleRate / sampleRate;
+
+    if (playhead != nullptr)
+    {
+        playhead->position = 0;
+        playhead->zone = zone;
+    }
+}
+
+// Stops playback and releases the voice's streaming playhead.
+void SampleOscillator::stop() noexcept
+{
+    zone = nullptr;
+    playingMap = nullptr;
+
+    if (playhead != nullptr)
+    {
+        playhead->zone = nullptr;
+    }
+}
+
+// Fills the context's block with the playing sample, linearly interpolated
+// to the note's pitch. Silence once the sample has ended.
+//
+// @param context: The block to be replaced.
+void SampleOscillator::process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept
+{
+    auto& outputBlock = context.getOutputBlock();
+    const auto numSamples = outputBlock.getNumSamples();
+    const auto numChannels = outputBlock.getNumChannels();
+
+    // The sample set was replaced mid-note, so the old zone may be reclaimed soon
+    if (zone != nullptr && (source == nullptr || source->get() != playingMap))
+    {
+        stop();
+    }
+
+    if (zone == nullptr)
+    {
+        outputBlock.clear();
+        return;
+    }
+
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        const auto index = (juce::int64) position;
+
+        if (index + 1 >= zone->lengthInSamples)
+        {
+            outputBlock.getSubBlock (i).clear();
+            stop();
+            return;
+        }
+
+        if (index != frameAIndex)
+        {
+            if (index == frameAIndex + 1)
+            {
+                std::copy (frameB, frameB + zone->numChannels, frameA);
+            }
+            else
+            {
+                readFrame (index, frameA);
+            }
+
+            readFrame (index + 1, frameB);
+            frameAIndex = index;
+        }
+
+        const auto fraction = (float) (position - (double) index);
+
+        for (size_t channel = 0; channel < numChannels; ++channel)
+        {
+            const int sourceChannel = juce::jmin ((int) channel, zone->numChannels - 1);
+            outputBlock.setSample ((int) channel, (int) i, frameA[sourceChannel] + fraction * (frameB[sourceChannel] - frameA[sourceChannel]));
+        }
+
+        position += increment;
+    }
+
+    if (playhead != nullptr)
+    {
+        playhead->position = (juce::int64) position;
+    }
+}
+
+// Reads one frame of the current zone, from the resident attack segment when
+// possible and from the memory-mapped file otherwise.
+//
+// @param index: The frame to read.
+// @param frame: Receives one sample per channel of the zone.
+void SampleOscillator::readFrame (juce::int64 index, float* frame) const noexcept
+{
+    if (index < zone->attack.getNumSamples())
+    {
+        for (int channel = 0; channel < zone->numChannels; ++channel)
+        {
+            frame[channel] = zone->attack.getSample (channel, (int) index);
+        }
+    }
+    else
+    {
+        zone->reader->getSample (index, frame);
+    }
+}
+
+//==============================================================================
+
+SampleStreamer::SampleStreamer (RcuPointer<SampleMap>& sampleMap, const juce::OwnedArray<SampleOscillator::Playhead>& voicePlayheads)
+    : samples (sampleMap), playheads (voicePlayheads)
+{
+}
+
+// Frees sample maps the voices no longer use, then touches one byte in every
+// page between each playhead and lookaheadSeconds past it.
+//
+// @return The number of milliseconds until the next call.
+int SampleStreamer::useTimeSlice()
+{
+    // Reclaiming here, before the playheads are read, means a zone is never
+    // freed while this thread is touching it
+    samples.reclaim();
+
+    for (auto* playhead : playheads)
+    {
+        const auto* zone = playhead->zone.load();
+
+        if (zone == nullptr)
+        {
+            continue;
+        }
+
+        const int bytesPerFrame = juce::jmax (1, zone->numChannels * (int) zone->reader->bitsPerSample / 8);
+        const int framesPerPage = juce::jmax (1, 4096 / bytesPerFrame);
+
+        const auto start = juce::jmax (playhead->position.load(), (juce::int64) zone->attack.getNumSamples());
+        const auto end = juce::jmin (zone->lengthInSamples, start + (juce::int64) (lookaheadSeconds * zone->sampleRate));
+
+        for (auto sample = start; sample < end; sample += framesPerPage)
+        {
+            zone->reader->touchSample (sample);
+        }
+    }
+
+    return 5;
+}
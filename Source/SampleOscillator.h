@@ -0,0 +1,124 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the sample-playback
+    oscillator: a key/velocity multisample map over memory-mapped WAV/AIFF
+    files, the per-voice player, and the background page streamer.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "RcuPointer.h"
+#include <JuceHeader.h>
+
+// A single sample file and the keys and velocities it plays for
+struct SampleZone
+{
+    static constexpr int maxChannels = 8;
+
+    juce::File file;
+    int rootNote = 60;
+    int lowNote = 0;
+    int highNote = 127;
+    int lowVelocity = 1;
+    int highVelocity = 127;
+
+    double sampleRate = 44100.0;
+    juce::int64 lengthInSamples = 0;
+    int numChannels = 0;
+
+    // The whole file, memory mapped. Pages are pulled in by SampleStreamer.
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader;
+
+    // The decoded opening of the file, kept resident so note-ons never wait on disk
+    juce::AudioBuffer<float> attack;
+};
+
+// An immutable set of zones. Built on the message thread and handed to the
+// voices through an RcuPointer.
+class SampleMap
+{
+public:
+    static std::unique_ptr<SampleMap> loadFiles (const juce::Array<juce::File>&, double);
+    static int parseNoteName (const juce::String&);
+
+    const SampleZone* findZone (int, int) const noexcept;
+    int getNumZones() const noexcept { return zones.size(); }
+    const SampleZone& getZone (int index) const noexcept { return *zones.getUnchecked (index); }
+
+private:
+    juce::OwnedArray<SampleZone> zones;
+};
+
+// Plays the zone of a SampleMap matching the current note, reading the
+// resident attack segment first and the memory-mapped file after it.
+class SampleOscillator
+{
+public:
+    // Where a voice is reading, shared with the streaming thread
+    struct Playhead
+    {
+        std::atomic<const SampleZone*> zone { nullptr };
+        std::atomic<juce::int64> position { 0 };
+    };
+
+    void prepare (const juce::dsp::ProcessSpec&);
+    void setSource (RcuPointer<SampleMap>*, Playhead*);
+    void noteOn (int, float, double) noexcept;
+    void stop() noexcept;
+    bool isPlaying() const noexcept { return zone != nullptr; }
+    void process (const juce::dsp::ProcessContextReplacing<float>&) noexcept;
+
+private:
+    void readFrame (juce::int64, float*) const noexcept;
+
+    RcuPointer<SampleMap>* source = nullptr;
+    Playhead* playhead = nullptr;
+
+    const SampleMap* playingMap = nullptr;
+    const SampleZone* zone = nullptr;
+
+    double sampleRate = 44100.0;
+    double position = 0.0;
+    double increment = 1.0;
+
+    // The two frames either side of the read position, for interpolation
+    float frameA[SampleZone::maxChannels] {};
+    float frameB[SampleZone::maxChannels] {};
+    juce::int64 frameAIndex = -1;
+};
+
+// Background client that touches the pages of each playing zone a little
+// ahead of its voice, so the audio thread reads memory that is already
+// resident. Also reclaims sample maps the voices have stopped using.
+class SampleStreamer : public juce::TimeSliceClient
+{
+public:
+    SampleStreamer (RcuPointer<SampleMap>&, const juce::OwnedArray<SampleOscillator::Playhead>&);
+
+    int useTimeSlice() override;
+
+    // Seconds of audio kept resident ahead of every playhead
+    static constexpr double lookaheadSeconds = 1.0;
+
+private:
+    RcuPointer<SampleMap>& samples;
+    const juce::OwnedArray<SampleOscillator::Playhead>& playheads;
+};
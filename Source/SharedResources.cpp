@@ -0,0 +1,44 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the process-wide
+    cache of read-only DSP resources, shared by every Subsynth instance in a
+    host.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "SharedResources.h"
+
+// Returns the number of resources currently in use by some instance.
+int SharedResources::getNumResources()
+{
+    const juce::ScopedLock sl (lock);
+    removeExpired();
+    return (int) entries.size();
+}
+
+// Forgets the entries whose resources no instance uses any more. Called
+// with the lock held.
+void SharedResources::removeExpired()
+{
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        it = it->second.expired() ? entries.erase (it) : std::next (it);
+    }
+}
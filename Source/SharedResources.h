@@ -0,0 +1,82 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the process-wide cache of
+    read-only DSP resources, shared by every Subsynth instance in a host.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <map>
+
+// Immutable resources (wavetables, reverb kernels) keyed by a description of
+// how they were made. Held through juce::SharedResourcePointer, so there is
+// one cache per process, created by the first instance and destroyed with
+// the last. The cache only holds weak references: a resource lives as long
+// as some instance uses it.
+//
+// Not for the audio thread; lookups lock and may build the resource.
+class SharedResources
+{
+public:
+    // Returns the resource stored under key, creating it first if no
+    // instance holds one.
+    //
+    // @param key: Describes the resource completely, parameters included.
+    // @param create: Builds the resource; called without the cache locked.
+    // @return The shared resource.
+    template <typename ObjectType, typename Factory>
+    std::shared_ptr<const ObjectType> getOrCreate (const juce::String& key, Factory&& create)
+    {
+        {
+            const juce::ScopedLock sl (lock);
+
+            if (auto existing = std::static_pointer_cast<const ObjectType> (entries[key].lock()))
+            {
+                return existing;
+            }
+        }
+
+        // Built unlocked so one slow build does not hold up other instances.
+        // If two instances race to build the same key, the first one stored wins.
+        std::shared_ptr<const ObjectType> created = create();
+
+        const juce::ScopedLock sl (lock);
+        auto& entry = entries[key];
+
+        if (auto existing = std::static_pointer_cast<const ObjectType> (entry.lock()))
+        {
+            return existing;
+        }
+
+        entry = created;
+        removeExpired();
+        return created;
+    }
+
+    int getNumResources();
+
+private:
+    void removeExpired();
+
+    juce::CriticalSection lock;
+    std::map<juce::String, std::weak_ptr<const void>> entries;
+};
@@ -0,0 +1,464 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the Subsynth
+    standalone application, which adds the Linux low-latency mode and a
+    headless null audio device to JUCE's standalone plugin wrapper.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "InstantiationBenchmark.h"
+#include "LatencyProbe.h"
+#include "LowLatencyMode.h"
+#include "ParallelRender.h"
+#include "RealtimeChecker.h"
+#include "StressTest.h"
+#include <JuceHeader.h>
+
+#if JucePlugin_Build_Standalone && JUCE_USE_CUSTOM_PLUGIN_STANDALONE_APP
+
+#include <juce_audio_plugin_client/Standalone/juce_StandaloneFilterWindow.h>
+
+// Structure adapted from JUCE's StandaloneFilterApp
+// (juce_audio_plugin_client/Standalone/juce_StandaloneFilterApp.cpp)
+//
+// Command line options:
+//   --no-low-latency          run without real-time scheduling or locked memory
+//   --null-device             run headless against a null audio device and exit
+//   --sample-rate <hz>        null device sample rate (default 48000)
+//   --block-size <samples>    null device block size (default 32)
+//   --seconds <seconds>       null device session length (default 10)
+//   --latency-probe           measure note-on to sound latency headless and exit
+//   --source <host|keyboard>  latency probe MIDI source (default host)
+//   --notes <count>           latency probe notes to play (default 40)
+//   --instantiation-benchmark time bringing up instances headless and exit
+//   --instances <count>       benchmark instances to create (default 32)
+//   --editor                  also time creating each instance's editor
+//   --stress-test             soak test with random MIDI storms headless and exit
+//   --seconds <seconds>       stress test session length in audio (default 300)
+//   --budget <ms>             stress test block budget (default the block's duration)
+//   --seed <number>           stress test random seed (default 1)
+//   --adaptive                keep adaptive quality on during the stress test
+//   --parallel-render <file>  render a MIDI file offline on every core and exit
+//   --output <file>           parallel render WAV file (default the MIDI file's, as .wav)
+//   --threads <count>         parallel render threads (default one per core)
+//   --sample-rate <hz>        parallel render sample rate (default 48000)
+//   --block-size <samples>    parallel render block size (default 512)
+//   --verify                  also render on one core and compare the two
+//   --run-tests               run the processor's assertion tests and exit
+class SubsynthStandaloneApp : public juce::JUCEApplication
+{
+public:
+    SubsynthStandaloneApp()
+    {
+        juce::PluginHostType::jucePlugInClientCurrentWrapperType = juce::AudioProcessor::wrapperType_Standalone;
+
+        juce::PropertiesFile::Options options;
+
+        options.applicationName = getApplicationName();
+        options.filenameSuffix = ".settings";
+        options.osxLibrarySubFolder = "Application Support";
+#if JUCE_LINUX
+        options.folderName = "~/.config";
+#else
+        options.folderName = "";
+#endif
+
+        appProperties.setStorageParameters (options);
+    }
+
+    const juce::String getApplicationName() override { return JucePlugin_Name; }
+    const juce::String getApplicationVersion() override { return JucePlugin_VersionString; }
+    bool moreThanOneInstanceAllowed() override { return true; }
+    void anotherInstanceStarted (const juce::String&) override {}
+
+    // Reads the command line, configures the low-latency mode, then either
+    // opens the normal standalone window or runs a headless null device session.
+    //
+    // @param commandLine: The arguments the application was launched with.
+    void initialise (const juce::String&) override
+    {
+        juce::ArgumentList args (getApplicationName(), getCommandLineParameterArray());
+
+        LowLatencyMode::setEnabled (! args.containsOption ("--no-low-latency"));
+
+        if (args.containsOption ("--null-device"))
+        {
+            runNullDevice (args);
+            return;
+        }
+
+        if (args.containsOption ("--latency-probe"))
+        {
+            runLatencyProbe (args);
+            return;
+        }
+
+        if (args.containsOption ("--instantiation-benchmark"))
+        {
+            runInstantiationBenchmark (args);
+            return;
+        }
+
+        if (args.containsOption ("--stress-test"))
+        {
+            runStressTest (args);
+            return;
+        }
+
+        if (args.containsOption ("--parallel-render"))
+        {
+            runParallelRender (args);
+            return;
+        }
+
+        if (args.containsOption ("--run-tests"))
+        {
+            SubsynthAudioProcessor().runTests();
+            juce::Logger::writeToLog ("Tests finished");
+            quit();
+            return;
+        }
+
+        mainWindow.reset (createWindow());
+        mainWindow->setVisible (true);
+    }
+
+    void shutdown() override
+    {
+        mainWindow = nullptr;
+        appProperties.saveIfNeeded();
+        LowLatencyMode::unlockProcessMemory();
+    }
+
+    void systemRequestedQuit() override
+    {
+        if (mainWindow != nullptr)
+        {
+            mainWindow->pluginHolder->savePluginState();
+        }
+
+        if (juce::ModalComponentManager::getInstance()->cancelAllModalComponents())
+        {
+            juce::Timer::callAfterDelay (100, [] {
+                if (auto app = juce::JUCEApplicationBase::getInstance())
+                {
+                    app->systemRequestedQuit();
+                }
+            });
+        }
+        else
+        {
+            quit();
+        }
+    }
+
+private:
+    // Creates the standalone window, asking for the smallest block size the
+    // low-latency mode supports when no saved device settings exist yet.
+    juce::StandaloneFilterWindow* createWindow()
+    {
+        juce::AudioDeviceManager::AudioDeviceSetup preferredSetup;
+
+        if (LowLatencyMode::isEnabled())
+        {
+            preferredSetup.bufferSize = LowLatencyMode::minimumBlockSize;
+        }
+
+        return new juce::StandaloneFilterWindow (getApplicationName(),
+                                                 juce::LookAndFeel::getDefaultLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId),
+                                                 appProperties.getUserSettings(),
+                                                 false,
+                                                 {},
+                                                 LowLatencyMode::isEnabled() ? &preferredSetup : nullptr);
+    }
+
+    // Runs the plugin against the null audio device, logs a report, and quits
+    // with a non-zero return value if any callback overran its deadline or, in
+    // builds with SUBSYNTH_RT_CHECKS, broke the real-time safety rules.
+    //
+    // @param args: The parsed command line.
+    void runNullDevice (const juce::ArgumentList& args)
+    {
+        auto getOption = [&args] (const juce::String& option, double defaultValue) {
+            return args.containsOption (option) ? args.getValueForOption (option).getDoubleValue() : defaultValue;
+        };
+
+        const double sampleRate = getOption ("--sample-rate", 48000.0);
+        const int blockSize = juce::jmax (1, (int) getOption ("--block-size", LowLatencyMode::minimumBlockSize));
+        const double seconds = getOption ("--seconds", 10.0);
+
+        std::unique_ptr<juce::AudioProcessor> processor (createPluginFilterOfType (juce::AudioProcessor::wrapperType_Standalone));
+        processor->enableAllBuses();
+
+        const auto report = LowLatencyMode::runOnNullDevice (*processor, sampleRate, blockSize, seconds);
+
+        juce::Logger::writeToLog ("Null device: " + juce::String (report.numBlocks) + " blocks of "
+                                  + juce::String (blockSize) + " samples at " + juce::String (sampleRate) + " Hz");
+        juce::Logger::writeToLog ("Real-time scheduling: " + juce::String (report.realtimeGranted ? "granted" : "denied")
+                                  + ", memory locked: " + juce::String (report.memoryLocked ? "yes" : "no"));
+        juce::Logger::writeToLog ("Deadline " + juce::String (report.deadlineMs, 3) + " ms, worst callback "
+                                  + juce::String (report.worstCallbackMs, 3) + " ms, overruns " + juce::String (report.numOverruns));
+
+        if (RealtimeChecker::isEnabled())
+        {
+            juce::Logger::writeToLog ("Real-time safety violations: " + juce::String (report.numRealtimeViolations));
+
+            if (report.numRealtimeViolations > 0)
+            {
+                juce::Logger::writeToLog (RealtimeChecker::getFirstViolationReport());
+            }
+        }
+
+        setApplicationReturnValue (report.numOverruns == 0 && report.numRealtimeViolations == 0 ? 0 : 1);
+        quit();
+    }
+
+    // Runs the latency probe, logs the latency distribution, and quits with a
+    // non-zero return value if any note went unheard or, in builds with
+    // SUBSYNTH_RT_CHECKS, the real-time safety rules were broken.
+    //
+    // @param args: The parsed command line.
+    void runLatencyProbe (const juce::ArgumentList& args)
+    {
+        auto getOption = [&args] (const juce::String& option, double defaultValue) {
+            return args.containsOption (option) ? args.getValueForOption (option).getDoubleValue() : defaultValue;
+        };
+
+        LatencyProbe::Settings settings;
+        settings.sampleRate = getOption ("--sample-rate", 48000.0);
+        settings.blockSize = juce::jmax (1, (int) getOption ("--block-size", LowLatencyMode::minimumBlockSize));
+        settings.numNotes = juce::jmax (1, (int) getOption ("--notes", 40.0));
+        settings.source = args.getValueForOption ("--source") == "keyboard" ? LatencyProbe::Source::keyboard : LatencyProbe::Source::host;
+
+        std::unique_ptr<juce::AudioProcessor> processor (createPluginFilterOfType (juce::AudioProcessor::wrapperType_Standalone));
+        processor->enableAllBuses();
+
+        const auto report = LatencyProbe::run (*dynamic_cast<SubsynthAudioProcessor*> (processor.get()), settings);
+
+        juce::Logger::writeToLog ("Latency probe: " + juce::String (settings.source == LatencyProbe::Source::keyboard ? "keyboard" : "host")
+                                  + " notes, " + juce::String (report.numDetected) + " of " + juce::String (report.numNotes) + " heard, blocks of "
+                                  + juce::String (settings.blockSize) + " samples (" + juce::String (report.deadlineMs, 3) + " ms)");
+        juce::Logger::writeToLog ("Latency min " + juce::String (report.minMs, 3) + " ms, median " + juce::String (report.medianMs, 3)
+                                  + " ms, p99 " + juce::String (report.p99Ms, 3) + " ms, max " + juce::String (report.maxMs, 3)
+                                  + " ms, jitter " + juce::String (report.jitterMs, 3) + " ms");
+        juce::Logger::writeToLog ("Callback mean " + juce::String (report.meanCallbackMs, 3) + " ms, with note on mean "
+                                  + juce::String (report.meanNoteOnCallbackMs, 3) + " ms, worst " + juce::String (report.worstNoteOnCallbackMs, 3) + " ms");
+
+        if (RealtimeChecker::isEnabled())
+        {
+            juce::Logger::writeToLog ("Real-time safety violations: " + juce::String (report.numRealtimeViolations));
+        }
+
+        setApplicationReturnValue (report.numDetected == report.numNotes && report.numRealtimeViolations == 0 ? 0 : 1);
+        quit();
+    }
+
+    // Runs the instantiation benchmark and logs how long each stage of
+    // bringing up an instance took.
+    //
+    // @param args: The parsed command line.
+    void runInstantiationBenchmark (const juce::ArgumentList& args)
+    {
+        auto getOption = [&args] (const juce::String& option, double defaultValue) {
+            return args.containsOption (option) ? args.getValueForOption (option).getDoubleValue() : defaultValue;
+        };
+
+        InstantiationBenchmark::Settings settings;
+        settings.sampleRate = getOption ("--sample-rate", 48000.0);
+        settings.blockSize = juce::jmax (1, (int) getOption ("--block-size", 256.0));
+        settings.numInstances = juce::jmax (1, (int) getOption ("--instances", 32.0));
+        settings.withEditor = args.containsOption ("--editor");
+
+        const auto report = InstantiationBenchmark::run (settings);
+
+        auto describe = [] (const juce::String& name, const InstantiationBenchmark::Stage& stage) {
+            juce::Logger::writeToLog (name + ": mean " + juce::String (stage.meanMs, 3) + " ms, worst " + juce::String (stage.worstMs, 3) + " ms");
+        };
+
+        juce::Logger::writeToLog ("Instantiation benchmark: " + juce::String (report.numInstances) + " instances in "
+                                  + juce::String (report.totalMs, 1) + " ms, first playable after "
+                                  + juce::String (report.firstInstancePlayableMs, 3) + " ms");
+        describe ("Construct", report.construct);
+        describe ("Prepare", report.prepare);
+        describe ("First sound", report.firstSound);
+        describe ("Time to playable", report.playable);
+
+        if (settings.withEditor)
+        {
+            describe ("Editor", report.editor);
+        }
+
+        quit();
+    }
+
+    // Runs the stress test, logs the tail of the block time distribution, and
+    // quits with a non-zero return value if any block went over budget or, in
+    // builds with SUBSYNTH_RT_CHECKS, broke the real-time safety rules.
+    //
+    // @param args: The parsed command line.
+    void runStressTest (const juce::ArgumentList& args)
+    {
+        auto getOption = [&args] (const juce::String& option, double defaultValue) {
+            return args.containsOption (option) ? args.getValueForOption (option).getDoubleValue() : defaultValue;
+        };
+
+        StressTest::Settings settings;
+        settings.sampleRate = getOption ("--sample-rate", 48000.0);
+        settings.blockSize = juce::jmax (1, (int) getOption ("--block-size", 128.0));
+        settings.seconds = getOption ("--seconds", 300.0);
+        settings.budgetMs = getOption ("--budget", 0.0);
+        settings.seed = (juce::int64) getOption ("--seed", 1.0);
+        settings.adaptiveQuality = args.containsOption ("--adaptive");
+
+        std::unique_ptr<juce::AudioProcessor> processor (createPluginFilterOfType (juce::AudioProcessor::wrapperType_Standalone));
+        processor->enableAllBuses();
+
+        const auto report = StressTest::run (*dynamic_cast<SubsynthAudioProcessor*> (processor.get()), settings);
+
+        juce::Logger::writeToLog ("Stress test: " + juce::String (report.numBlocks) + " blocks of " + juce::String (settings.blockSize)
+                                  + " samples, " + juce::String (report.numNoteOns) + " note ons, "
+                                  + juce::String (report.numParameterChanges) + " parameter changes, seed " + juce::String (settings.seed));
+        juce::Logger::writeToLog ("Block time p50 " + juce::String (report.p50Ms, 3) + " ms, p99 " + juce::String (report.p99Ms, 3)
+                                  + " ms, p99.9 " + juce::String (report.p999Ms, 3) + " ms, max " + juce::String (report.maxMs, 3)
+                                  + " ms (block " + juce::String (report.worstBlock) + ")");
+        juce::Logger::writeToLog ("Budget " + juce::String (report.budgetMs, 3) + " ms, blocks over budget " + juce::String (report.numOverBudget));
+
+        if (RealtimeChecker::isEnabled())
+        {
+            juce::Logger::writeToLog ("Real-time safety violations: " + juce::String (report.numRealtimeViolations));
+        }
+
+        setApplicationReturnValue (report.passed() ? 0 : 1);
+        quit();
+    }
+
+    // Renders a MIDI file offline with the default patch, across every core,
+    // and writes it to a WAV file. With --verify, renders it again on one
+    // core and quits with a non-zero return value unless the two match to
+    // the bit.
+    //
+    // @param args: The parsed command line.
+    void runParallelRender (const juce::ArgumentList& args)
+    {
+        auto getOption = [&args] (const juce::String& option, double defaultValue) {
+            return args.containsOption (option) ? args.getValueForOption (option).getDoubleValue() : defaultValue;
+        };
+
+        // An offline render has no deadline to lock memory for
+        LowLatencyMode::setEnabled (false);
+
+        ParallelRender::Settings settings;
+        settings.sampleRate = getOption ("--sample-rate", 48000.0);
+        settings.blockSize = juce::jmax (1, (int) getOption ("--block-size", 512.0));
+        settings.numThreads = juce::jmax (0, (int) getOption ("--threads", 0.0));
+
+        const auto midiFile = args.getExistingFileForOption ("--parallel-render");
+        const auto outputFile = args.containsOption ("--output") ? args.getFileForOption ("--output") : midiFile.withFileExtension ("wav");
+
+        juce::MidiFile midi;
+        juce::FileInputStream input (midiFile);
+
+        if (! input.openedOk() || ! midi.readFrom (input))
+        {
+            juce::Logger::writeToLog ("Could not read " + midiFile.getFullPathName());
+            setApplicationReturnValue (1);
+            quit();
+            return;
+        }
+
+        // Every track merged into one sequence, timed in samples
+        midi.convertTimestampTicksToSeconds();
+        juce::MidiMessageSequence sequence;
+
+        for (int track = 0; track < midi.getNumTracks(); ++track)
+        {
+            sequence.addSequence (*midi.getTrack (track), 0.0);
+        }
+
+        for (auto* event : sequence)
+        {
+            event->message.setTimeStamp (std::round (event->message.getTimeStamp() * settings.sampleRate));
+        }
+
+        sequence.updateMatchedPairs();
+
+        // Three seconds after the last event for the releases and effects to ring out
+        const int numSamples = (int) sequence.getEndTime() + (int) (3.0 * settings.sampleRate);
+
+        juce::AudioBuffer<float> output;
+        const auto report = ParallelRender::render (sequence, numSamples, output, settings);
+
+        juce::Logger::writeToLog ("Parallel render: " + juce::String (numSamples / settings.sampleRate, 1) + " s in "
+                                  + juce::String (report.seconds, 3) + " s, " + juce::String (report.numSegments) + " segments, "
+                                  + juce::String (report.numVerified) + " verified, " + juce::String (report.numRerendered) + " rendered again"
+                                  + (report.checkpointed ? "" : " (patch cannot be checkpointed, rendered on one core)"));
+
+        bool passed = true;
+
+        if (args.containsOption ("--verify"))
+        {
+            juce::AudioBuffer<float> reference;
+            const auto sequential = ParallelRender::renderSequential (sequence, numSamples, reference, settings);
+
+            for (int channel = 0; channel < output.getNumChannels(); ++channel)
+            {
+                passed = passed && std::memcmp (output.getReadPointer (channel), reference.getReadPointer (channel), sizeof (float) * (size_t) numSamples) == 0;
+            }
+
+            juce::Logger::writeToLog ("Single core: " + juce::String (sequential.seconds, 3) + " s, speedup "
+                                      + juce::String (sequential.seconds / juce::jmax (report.seconds, 1.0e-9), 2) + "x, output "
+                                      + (passed ? "identical" : "DIFFERS"));
+        }
+
+        outputFile.deleteFile();
+        std::unique_ptr<juce::OutputStream> stream (outputFile.createOutputStream());
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+
+        if (stream != nullptr)
+        {
+            writer.reset (juce::WavAudioFormat().createWriterFor (stream.get(), settings.sampleRate, (unsigned int) output.getNumChannels(), 24, {}, 0));
+        }
+
+        if (writer != nullptr)
+        {
+            stream.release(); // now owned by the writer
+            writer->writeFromAudioSampleBuffer (output, 0, output.getNumSamples());
+            juce::Logger::writeToLog ("Wrote " + outputFile.getFullPathName());
+        }
+        else
+        {
+            juce::Logger::writeToLog ("Could not write " + outputFile.getFullPathName());
+            passed = false;
+        }
+
+        setApplicationReturnValue (passed ? 0 : 1);
+        quit();
+    }
+
+    juce::ApplicationProperties appProperties;
+    std::unique_ptr<juce::StandaloneFilterWindow> mainWindow;
+};
+
+juce::JUCEApplicationBase* juce_CreateApplication()
+{
+    return new SubsynthStandaloneApp();
+}
+
+#endif
@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the voice's
+    state variable filter, with low pass, band pass and high pass outputs.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "StateVariableFilter.h"
+
+// Prepares the filter for playback.
+//
+// @param spec: The prep info of the owning voice.
+void StateVariableFilter::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    jassert (spec.numChannels <= (juce::uint32) maxChannels);
+    numChannels = juce::jmin ((int) spec.numChannels, maxChannels);
+    reset();
+}
+
+// Clears the integrator state of every channel, and jumps to the
+// coefficients in state.
+void StateVariableFilter::reset() noexcept
+{
+    filterState = {};
+    filterState.current = { state->g, state->R2, state->h };
+}
+
+// Moves from the coefficients in use to those now in state linearly over
+// the next numSamples samples, across blocks if need be, rather than at the
+// start of the next block. Each coefficient is ramped on its own, h too,
+// which stays close to its exact value for the small steps of a control tick
+// and is exact at both ends.
+//
+// @param numSamples: The length of the ramp.
+void StateVariableFilter::rampToState (int numSamples) noexcept
+{
+    const auto& current = filterState.current;
+
+    if (numSamples <= 0)
+    {
+        filterState.rampRemaining = 0;
+        filterState.step = {};
+        return;
+    }
+
+    const float scale = 1.0f / (float) numSamples;
+    filterState.step = { (state->g - current.g) * scale, (state->R2 - current.R2) * scale, (state->h - current.h) * scale };
+    filterState.rampRemaining = numSamples;
+}
+
+// Filters every channel of a block in place, with the coefficients in state
+// or, while a ramp is in progress, moving towards them.
+//
+// @param context: The block to filter.
+template <StateVariableFilter::Parameters::Type type>
+void StateVariableFilter::process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept
+{
+    auto& block = context.getOutputBlock();
+    const int numSamples = (int) block.getNumSamples();
+    const int channels = juce::jmin (numChannels, (int) block.getNumChannels());
+    const int rampLength = juce::jmin (filterState.rampRemaining, numSamples);
+
+    if (filterState.rampRemaining == 0)
+    {
+        filterState.current = { state->g, state->R2, state->h };
+    }
+
+    for (int channel = 0; channel < channels; ++channel)
+    {
+        auto& s1 = filterState.s1[channel];
+        auto& s2 = filterState.s2[channel];
+
+        processChannel<type> (block.getChannelPointer ((size_t) channel), numSamples, rampLength, s1, s2);
+
+        juce::dsp::util::snapToZero (s1);
+        juce::dsp::util::snapToZero (s2);
+    }
+
+    if (rampLength > 0)
+    {
+        auto& current = filterState.current;
+        const auto& step = filterState.step;
+        filterState.rampRemaining -= rampLength;
+
+        if (filterState.rampRemaining == 0)
+        {
+            current = { state->g, state->R2, state->h };
+            filterState.step = {};
+        }
+        else
+        {
+            current = { current.g + step.g * (float) rampLength, current.R2 + step.R2 * (float) rampLength, current.h + step.h * (float) rampLength };
+        }
+    }
+}
+
+// Runs one channel through the filter, with the output type fixed at
+// compile time so the loops have no branches: the first steps the
+// coefficients every sample, and the second holds them at their target.
+//
+// @param samples: The channel's samples, filtered in place.
+// @param numSamples: The number of samples.
+// @param rampLength: How many of them the coefficients ramp over.
+// @param s1: The channel's first integrator.
+// @param s2: The channel's second integrator.
+template <StateVariableFilter::Parameters::Type type>
+void StateVariableFilter::processChannel (float* samples, int numSamples, int rampLength, float& s1, float& s2) const noexcept
+{
+    const auto& step = filterState.step;
+    float g = filterState.current.g;
+    float R2 = filterState.current.R2;
+    float h = filterState.current.h;
+
+    float z1 = s1;
+    float z2 = s2;
+
+    auto filter = [&] (float x) {
+        const float highPass = (x - z1 * R2 - z1 * g - z2) * h;
+        const float bandPass = highPass * g + z1;
+        z1 = highPass * g + bandPass;
+        const float lowPass = bandPass * g + z2;
+        z2 = bandPass * g + lowPass;
+
+        return type == Parameters::Type::lowPass ? lowPass : type == Parameters::Type::bandPass ? bandPass : highPass;
+    };
+
+    int i = 0;
+
+    for (; i < rampLength; ++i)
+    {
+        g += step.g;
+        R2 += step.R2;
+        h += step.h;
+        samples[i] = filter (samples[i]);
+    }
+
+    if (rampLength > 0 && rampLength == filterState.rampRemaining)
+    {
+        g = state->g;
+        R2 = state->R2;
+        h = state->h;
+    }
+
+    for (; i < numSamples; ++i)
+    {
+        samples[i] = filter (samples[i]);
+    }
+
+    s1 = z1;
+    s2 = z2;
+}
+
+// The filter types CustomVoice instantiates its render paths with
+template void StateVariableFilter::process<StateVariableFilter::Parameters::Type::lowPass> (const juce::dsp::ProcessContextReplacing<float>&) noexcept;
+template void StateVariableFilter::process<StateVariableFilter::Parameters::Type::bandPass> (const juce::dsp::ProcessContextReplacing<float>&) noexcept;
+template void StateVariableFilter::process<StateVariableFilter::Parameters::Type::highPass> (const juce::dsp::ProcessContextReplacing<float>&) noexcept;
@@ -0,0 +1,94 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the voice's state
+    variable filter, with low pass, band pass and high pass outputs.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// The topology preserving transform state variable filter of
+// juce::dsp::StateVariableFilter, sharing its Parameters, for up to
+// maxChannels channels. Unlike the JUCE filter, its integrator state can be
+// read and set, so a voice can capture and restore where the filter is, and
+// it can move to new coefficients gradually, for modulation at control rate.
+class StateVariableFilter
+{
+public:
+    using Parameters = juce::dsp::StateVariableFilter::Parameters<float>;
+
+    static constexpr int maxChannels = 4;
+
+    struct Coefficients
+    {
+        float g = 0.0f;
+        float R2 = 0.0f;
+        float h = 0.0f;
+    };
+
+    // The integrators, and the coefficients in use with their ramp towards
+    // state's while one is in progress
+    struct State
+    {
+        float s1[maxChannels] {};
+        float s2[maxChannels] {};
+        Coefficients current;
+        Coefficients step;
+        int rampRemaining = 0;
+    };
+
+    void prepare (const juce::dsp::ProcessSpec&);
+    void reset() noexcept;
+    void rampToState (int) noexcept;
+
+    // Filters as the given type whatever state->type is. The caller chooses
+    // the type at compile time, so each type's loop is compiled on its own.
+    template <Parameters::Type type>
+    void process (const juce::dsp::ProcessContextReplacing<float>&) noexcept;
+
+    const State& getState() const noexcept { return filterState; }
+    void setState (const State& newState) noexcept { filterState = newState; }
+
+    // The integrators and the coefficients, which modulation may have moved
+    // away from the patch's. A finished ramp's coefficients are state's, so
+    // they are left out.
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        visit (filterState.s1, filterState.s2, state->type, state->g, state->R2, state->h, filterState.rampRemaining);
+
+        if (filterState.rampRemaining > 0)
+        {
+            visit (filterState.current, filterState.step);
+        }
+    }
+
+    // The filter type and coefficients, set from the voice
+    Parameters::Ptr state { new Parameters() };
+
+private:
+    template <Parameters::Type type>
+    void processChannel (float*, int, int, float&, float&) const noexcept;
+
+    int numChannels = 0;
+    State filterState;
+};
@@ -0,0 +1,303 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for a soak test that
+    drives the processor with randomised MIDI storms and parameter changes
+    and measures the distribution of block render times.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "StressTest.h"
+#include "LowLatencyMode.h"
+#include "RealtimeChecker.h"
+
+#include <chrono>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// Writes a random burst of MIDI into each block, keeping track of which
+// notes are held so releases and retriggers hit sounding notes.
+class MidiStorm
+{
+public:
+    explicit MidiStorm (juce::int64 seed)
+        : random (seed)
+    {
+    }
+
+    // @param midi: The block's MIDI, which must be empty.
+    // @param blockSize: The number of samples in the block.
+    // @return The number of note ons written.
+    int fillBlock (juce::MidiBuffer& midi, int blockSize)
+    {
+        int numNoteOns = 0;
+
+        auto noteOn = [&] (int note, int offset) {
+            midi.addEvent (juce::MidiMessage::noteOn (1, note, juce::jmax (0.05f, random.nextFloat())), offset);
+            held[note] = true;
+            ++numNoteOns;
+        };
+
+        auto noteOff = [&] (int note, int offset) {
+            midi.addEvent (juce::MidiMessage::noteOff (1, note), offset);
+            held[note] = false;
+        };
+
+        auto randomOffset = [&] { return random.nextInt (blockSize); };
+        auto randomNote = [&] { return lowestNote + random.nextInt (highestNote - lowestNote + 1); };
+
+        // Dense chord, all at one sample
+        if (random.nextFloat() < 0.05f)
+        {
+            const int offset = randomOffset();
+            const int numNotes = 6 + random.nextInt (7);
+
+            for (int i = 0; i < numNotes; ++i)
+            {
+                noteOn (randomNote(), offset);
+            }
+        }
+
+        // Rapid retriggers of one note within the block
+        if (random.nextFloat() < 0.1f)
+        {
+            const int note = randomNote();
+
+            for (int offset = randomOffset(); offset < blockSize; offset += 1 + random.nextInt (8))
+            {
+                noteOff (note, offset);
+                noteOn (note, offset);
+            }
+        }
+
+        // Single notes and releases
+        if (random.nextFloat() < 0.3f)
+        {
+            noteOn (randomNote(), randomOffset());
+        }
+
+        if (random.nextFloat() < 0.2f)
+        {
+            const int offset = randomOffset();
+
+            for (int note = lowestNote; note <= highestNote; ++note)
+            {
+                if (held[note] && random.nextFloat() < 0.3f)
+                {
+                    noteOff (note, offset);
+                }
+            }
+        }
+
+        // Sustain pedal, and now and then everything off
+        if (random.nextFloat() < 0.01f)
+        {
+            midi.addEvent (juce::MidiMessage::controllerEvent (1, 64, random.nextBool() ? 127 : 0), randomOffset());
+        }
+
+        if (random.nextFloat() < 0.002f)
+        {
+            midi.addEvent (juce::MidiMessage::allNotesOff (1), randomOffset());
+            std::fill (std::begin (held), std::end (held), false);
+        }
+
+        return numNoteOns;
+    }
+
+    juce::Random random;
+
+private:
+    static constexpr int lowestNote = 24;
+    static constexpr int highestNote = 96;
+
+    bool held[128] {};
+};
+
+// Changes one of the settings a user would reach for while playing, on the
+// thread the editor would change it from.
+//
+// @param processor: The processor being tested.
+// @param random: The storm's random number generator.
+void changeRandomParameter (SubsynthAudioProcessor& processor, juce::Random& random)
+{
+    switch (random.nextInt (5))
+    {
+        case 0:
+            processor.changeFilter (1 + random.nextInt (CustomVoice::ladderFilter),
+                                    20.0 * std::pow (1000.0, random.nextDouble()),
+                                    0.5 + 9.5 * random.nextDouble());
+            break;
+
+        case 1:
+            processor.changeADSREnv ({ 0.1f * random.nextFloat(), 0.5f * random.nextFloat(), random.nextFloat(), 0.5f * random.nextFloat() });
+            break;
+
+        case 2:
+            processor.changeWaveform (1 + random.nextInt (CustomVoice::granularWave));
+            break;
+
+        case 3:
+            processor.changeGranular ({ random.nextFloat(), 48.0f * random.nextFloat() - 24.0f, 1000.0f * random.nextFloat(),
+                                        0.005f + 0.5f * random.nextFloat(), random.nextFloat(),
+                                        random.nextBool() ? GranularOscillator::Source::wavetable : GranularOscillator::Source::sample });
+            break;
+
+        default:
+            processor.changeFM (0.25f + 7.75f * random.nextFloat(), 10.0f * random.nextFloat(),
+                                random.nextBool() ? FMOscillator::Mode::phase : FMOscillator::Mode::frequency);
+            break;
+    }
+}
+} // namespace
+
+// Runs the soak test. Blocks until every block has been rendered, which
+// takes as long as the processor needs, not the session's length. Call on
+// the message thread: the settings are changed from it while the blocks
+// render on their own thread, as the editor would change them.
+//
+// @param processor: The processor to test. It is prepared, played, and
+// released again; its settings are left wherever the storm put them.
+// @param settings: The session's sample rate, block size, length, budget and seed.
+// @return The distribution of block render times.
+StressTest::Report StressTest::run (SubsynthAudioProcessor& processor, const Settings& settings)
+{
+    class StressThread : public juce::Thread
+    {
+    public:
+        StressThread (SubsynthAudioProcessor& p, const Settings& s, int n)
+            : juce::Thread ("Subsynth stress test"), processor (p), settings (s), numBlocks (n)
+        {
+            blockMs.reserve ((size_t) numBlocks);
+        }
+
+        void run() override
+        {
+            LowLatencyMode::promoteCurrentThread (LowLatencyMode::defaultPriority);
+            LowLatencyMode::prefaultStack();
+
+            const int blockSize = settings.blockSize;
+            juce::AudioBuffer<float> buffer (processor.getTotalNumOutputChannels(), blockSize);
+            juce::MidiBuffer midi;
+            midi.ensureSize (4096);
+            LowLatencyMode::prefaultBuffer (buffer);
+
+            MidiStorm storm (settings.seed);
+
+            for (int block = 0; block < numBlocks && ! threadShouldExit(); ++block)
+            {
+                numNoteOns += storm.fillBlock (midi, blockSize);
+
+                const auto start = Clock::now();
+                processor.processBlock (buffer, midi);
+                blockMs.push_back (std::chrono::duration<double, std::milli> (Clock::now() - start).count());
+
+                midi.clear();
+                ++numBlocksRendered;
+            }
+        }
+
+        std::vector<double> blockMs;
+        int numNoteOns = 0;
+        std::atomic<int> numBlocksRendered { 0 };
+
+    private:
+        SubsynthAudioProcessor& processor;
+        const Settings& settings;
+        const int numBlocks;
+    };
+
+    const int blockSize = juce::jmax (1, settings.blockSize);
+    const int numBlocks = juce::jmax (1, (int) (settings.seconds * settings.sampleRate / blockSize));
+
+    Report report;
+    report.budgetMs = settings.budgetMs > 0.0 ? settings.budgetMs : 1000.0 * blockSize / settings.sampleRate;
+
+    processor.setAdaptiveQuality (settings.adaptiveQuality);
+    processor.setRateAndBufferSizeDetails (settings.sampleRate, blockSize);
+    processor.prepareToPlay (settings.sampleRate, blockSize);
+    RealtimeChecker::resetViolations();
+
+    {
+        StressThread thread (processor, settings, numBlocks);
+        thread.startThread();
+
+        // About five changes a second of audio, however fast it renders. The
+        // changes follow the seed, but which block each lands in does not.
+        juce::Random random (settings.seed + 1);
+        const double changesPerBlock = 5.0 * blockSize / settings.sampleRate;
+        int numBlocksSeen = 0;
+
+        while (thread.isThreadRunning())
+        {
+            for (const int numBlocksRendered = thread.numBlocksRendered.load(); numBlocksSeen < numBlocksRendered; ++numBlocksSeen)
+            {
+                if (random.nextDouble() < changesPerBlock)
+                {
+                    changeRandomParameter (processor, random);
+                    ++report.numParameterChanges;
+                }
+            }
+
+            juce::Thread::sleep (1);
+        }
+
+        thread.waitForThreadToExit (-1);
+
+        report.numRealtimeViolations = RealtimeChecker::getNumViolations();
+        report.numBlocks = (int) thread.blockMs.size();
+        report.numNoteOns = thread.numNoteOns;
+
+        const auto& blockMs = thread.blockMs;
+
+        for (int block = 0; block < report.numBlocks; ++block)
+        {
+            if (blockMs[(size_t) block] > report.maxMs)
+            {
+                report.maxMs = blockMs[(size_t) block];
+                report.worstBlock = block;
+            }
+
+            if (blockMs[(size_t) block] > report.budgetMs)
+            {
+                ++report.numOverBudget;
+            }
+        }
+
+        auto sorted = blockMs;
+
+        if (! sorted.empty())
+        {
+            std::sort (sorted.begin(), sorted.end());
+
+            auto percentile = [&sorted] (double p) {
+                return sorted[(size_t) juce::jmin ((int) sorted.size() - 1, (int) (p * (double) sorted.size()))];
+            };
+
+            report.p50Ms = percentile (0.5);
+            report.p99Ms = percentile (0.99);
+            report.p999Ms = percentile (0.999);
+        }
+    }
+
+    processor.releaseResources();
+
+    return report;
+}
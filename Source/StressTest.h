@@ -0,0 +1,74 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for a soak test that drives
+    the processor with randomised MIDI storms and parameter changes and
+    measures the distribution of block render times.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "PluginProcessor.h"
+#include <JuceHeader.h>
+
+// Renders a long session as fast as possible on a real-time priority thread
+// and times every block. The MIDI is a seeded random storm of dense chords,
+// rapid retriggers, releases, sustain pedal and all-notes-off, holding more
+// notes than there are voices so notes are stolen throughout. While the
+// blocks render, the filter, envelope, waveform, FM and granular settings are
+// changed at random from the message thread, as a user turning knobs would.
+//
+// What matters is the worst block, not the average, so the report gives the
+// tail of the distribution and counts the blocks over budget.
+class StressTest
+{
+public:
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 128;
+        double seconds = 300.0; // of audio, not of wall-clock time
+        double budgetMs = 0.0; // 0 for the block's own duration
+        juce::int64 seed = 1;
+        bool adaptiveQuality = false;
+    };
+
+    struct Report
+    {
+        int numBlocks = 0;
+        int numNoteOns = 0;
+        int numParameterChanges = 0;
+        double budgetMs = 0.0;
+
+        // Block render times
+        double p50Ms = 0.0;
+        double p99Ms = 0.0;
+        double p999Ms = 0.0;
+        double maxMs = 0.0;
+        int worstBlock = 0;
+        int numOverBudget = 0;
+
+        int numRealtimeViolations = 0;
+
+        bool passed() const noexcept { return numOverBudget == 0 && numRealtimeViolations == 0; }
+    };
+
+    static Report run (SubsynthAudioProcessor&, const Settings&);
+};
@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for the
+    sub-oscillator, a square wave one or two octaves below the main
+    oscillator, derived from the main oscillator's output.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "SubOscillator.h"
+
+// Restarts the divider, e.g. at the start of a note.
+void SubOscillator::reset() noexcept
+{
+    previous = 0.0f;
+    counter = 0;
+}
+
+// Adds the sub-oscillator to every channel of a block.
+//
+// @param block: The main oscillator's output, which channel 0 is read from.
+// @param level: The sub-oscillator's amplitude.
+// @param octaves: 1 or 2 octaves below the main oscillator.
+void SubOscillator::addTo (const juce::dsp::AudioBlock<float>& block, float level, int octaves) noexcept
+{
+    constexpr int chunkSize = 64;
+    float sub[chunkSize];
+
+    const int mask = octaves >= 2 ? 3 : 1;
+    const int half = (mask + 1) / 2;
+    const int numSamples = (int) block.getNumSamples();
+    const float* mainOscillator = block.getChannelPointer (0);
+
+    for (int start = 0; start < numSamples; start += chunkSize)
+    {
+        const int length = juce::jmin (chunkSize, numSamples - start);
+
+        for (int i = 0; i < length; ++i)
+        {
+            const float x = mainOscillator[start + i];
+
+            if (previous < 0.0f && x >= 0.0f)
+            {
+                counter = (counter + 1) & mask;
+            }
+
+            previous = x;
+            sub[i] = counter < half ? level : -level;
+        }
+
+        for (size_t channel = 0; channel < block.getNumChannels(); ++channel)
+        {
+            juce::FloatVectorOperations::add (block.getChannelPointer (channel) + start, sub, length);
+        }
+    }
+}
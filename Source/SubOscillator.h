@@ -0,0 +1,65 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for the sub-oscillator, a
+    square wave one or two octaves below the main oscillator, derived from
+    the main oscillator's output.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// Frequency divider, like the flip-flop sub-oscillator of an analog synth:
+// every rising zero crossing of the main oscillator advances a counter, and
+// the counter's top bit is the output. It stays phase locked to the main
+// oscillator through glides and modulation, with no frequency of its own.
+//
+// The sine, square, saw and triangle oscillators cross zero upwards once per
+// cycle. A custom waveform that crosses more often divides that rate instead.
+class SubOscillator
+{
+public:
+    void reset() noexcept;
+    void addTo (const juce::dsp::AudioBlock<float>&, float, int) noexcept;
+
+    struct State
+    {
+        float previous = 0.0f;
+        int counter = 0;
+    };
+
+    State getState() const noexcept { return { previous, counter }; }
+    void setState (const State& state) noexcept
+    {
+        previous = state.previous;
+        counter = state.counter;
+    }
+
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        visit (previous, counter);
+    }
+
+private:
+    float previous = 0.0f;
+    int counter = 0;
+};
@@ -0,0 +1,320 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for user-defined
+    wavetables. Band-limited tables are built on a background thread from a
+    drawn cycle or a list of harmonic amplitudes and swapped into the running
+    voices.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "Wavetable.h"
+
+// Builds a wavetable from the amplitudes of a series of sine harmonics.
+//
+// @param amplitudes: The amplitude of harmonic 1 (the fundamental), 2, 3 and
+// so on. Negative amplitudes invert the harmonic.
+// @return The wavetable, normalised to a peak of 1.
+std::unique_ptr<Wavetable> Wavetable::fromHarmonicAmplitudes (const std::vector<float>& amplitudes)
+{
+    std::vector<std::complex<float>> harmonics (juce::jmin ((int) amplitudes.size(), maxHarmonics));
+
+    for (size_t h = 0; h < harmonics.size(); ++h)
+    {
+        // a * sin (x) is a * cos (x - pi / 2)
+        harmonics[h] = { 0.0f, -amplitudes[h] };
+    }
+
+    return fromSpectrum (harmonics);
+}
+
+// Builds a wavetable from one hand-drawn cycle. The cycle is analysed into
+// harmonics first, so the result is band limited like any other table.
+//
+// @param cycle: Evenly spaced points across one period, at least two.
+// @return The wavetable, normalised to a peak of 1, with any DC offset removed.
+std::unique_ptr<Wavetable> Wavetable::fromCycle (const std::vector<float>& cycle)
+{
+    const int numPoints = (int) cycle.size();
+    std::vector<float> work (2 * tableSize, 0.0f);
+
+    for (int i = 0; i < tableSize && numPoints > 0; ++i)
+    {
+        const float position = (float) i * (float) numPoints / (float) tableSize;
+        const int index = (int) position;
+        const float fraction = position - (float) index;
+
+        work[(size_t) i] = juce::jmap (fraction, cycle[(size_t) index], cycle[(size_t) ((index + 1) % numPoints)]);
+    }
+
+    juce::dsp::FFT fft (juce::findHighestSetBit ((juce::uint32) tableSize));
+    fft.performRealOnlyForwardTransform (work.data(), true);
+
+    auto* bins = reinterpret_cast<const std::complex<float>*> (work.data());
+    std::vector<std::complex<float>> harmonics (maxHarmonics);
+
+    for (int h = 1; h <= maxHarmonics; ++h)
+    {
+        harmonics[(size_t) (h - 1)] = bins[h] * (2.0f / (float) tableSize);
+    }
+
+    return fromSpectrum (harmonics);
+}
+
+// Makes a table for publishing that plays the samples of a shared table,
+// keeping the shared table alive for as long as it is used.
+//
+// @param shared: The table, e.g. from SharedResources.
+// @return A table with no samples of its own.
+std::unique_ptr<Wavetable> Wavetable::referTo (std::shared_ptr<const Wavetable> shared)
+{
+    auto table = std::make_unique<Wavetable>();
+    table->samples = std::shared_ptr<const std::vector<float>> (shared, shared->samples.get());
+    return table;
+}
+
+// Builds every level of a wavetable by inverse FFT of the harmonics that
+// level can hold.
+//
+// @param harmonics: The complex amplitude a * e^(i * phase) of each harmonic,
+// starting with the fundamental.
+// @return The wavetable, normalised to a peak of 1.
+std::unique_ptr<Wavetable> Wavetable::fromSpectrum (const std::vector<std::complex<float>>& harmonics)
+{
+    auto samples = std::make_shared<std::vector<float>> ((size_t) (numLevels * (tableSize + 1)), 0.0f);
+
+    juce::dsp::FFT fft (juce::findHighestSetBit ((juce::uint32) tableSize));
+    std::vector<float> work (2 * tableSize);
+
+    for (int level = 0; level < numLevels; ++level)
+    {
+        const int numHarmonics = juce::jmin ((int) harmonics.size(), maxHarmonics >> level);
+
+        std::fill (work.begin(), work.end(), 0.0f);
+
+        for (int h = 1; h <= numHarmonics; ++h)
+        {
+            const auto bin = harmonics[(size_t) (h - 1)] * (0.5f * (float) tableSize);
+            work[(size_t) (2 * h)] = bin.real();
+            work[(size_t) (2 * h + 1)] = bin.imag();
+        }
+
+        fft.performRealOnlyInverseTransform (work.data());
+
+        auto* levelSamples = samples->data() + level * (tableSize + 1);
+        std::copy (work.begin(), work.begin() + tableSize, levelSamples);
+        levelSamples[tableSize] = levelSamples[0];
+    }
+
+    const auto range = juce::FloatVectorOperations::findMinAndMax (samples->data(), tableSize);
+    const float peak = juce::jmax (std::abs (range.getStart()), std::abs (range.getEnd()));
+
+    if (peak > 0.0f)
+    {
+        juce::FloatVectorOperations::multiply (samples->data(), 1.0f / peak, (int) samples->size());
+    }
+
+    auto table = std::make_unique<Wavetable>();
+    table->samples = std::move (samples);
+    return table;
+}
+
+// Picks the widest level whose highest harmonic stays below Nyquist.
+//
+// @param frequency: The fundamental in Hz.
+// @param sampleRate: The sample rate being played at.
+// @return The level, 0 to numLevels - 1.
+int Wavetable::getLevelForFrequency (float frequency, double sampleRate) noexcept
+{
+    const float harmonicsNeeded = (float) maxHarmonics * frequency / (float) (0.5 * sampleRate);
+
+    if (harmonicsNeeded <= 1.0f)
+    {
+        return 0;
+    }
+
+    return juce::jmin (numLevels - 1, (int) std::ceil (std::log2 (harmonicsNeeded)));
+}
+
+//==============================================================================
+
+// Prepares the oscillator for playback.
+//
+// @param spec: The prep info of the owning voice.
+void WavetableOscillator::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    sampleRate = spec.sampleRate;
+    frequency.reset (sampleRate, 0.05);
+    declickDecay = std::exp (-1.0f / (float) (0.002 * sampleRate));
+    declickOffset = 0.0f;
+    lastOutput = 0.0f;
+}
+
+// Connects the oscillator to the wavetable published by the processor.
+//
+// @param wavetable: The published wavetable.
+void WavetableOscillator::setSource (RcuPointer<Wavetable>* wavetable)
+{
+    source = wavetable;
+}
+
+// Sets the frequency, gliding to it like juce::dsp::Oscillator does.
+//
+// @param newFrequency: The fundamental in Hz.
+void WavetableOscillator::setFrequency (float newFrequency) noexcept
+{
+    frequency.setTargetValue (newFrequency);
+}
+
+// Starts the waveform afresh, at the start of its cycle at a frequency with
+// no glide or pitch modulation, and with nothing to declick: the first table it plays after
+// this is taken as it is.
+//
+// @param newFrequency: The fundamental in Hz.
+void WavetableOscillator::reset (float newFrequency) noexcept
+{
+    frequency.setCurrentAndTargetValue (newFrequency);
+    pitchRatio.setCurrentAndTargetValue (1.0f);
+    phase = 0.0f;
+    lastTable = nullptr;
+    lastOutput = 0.0f;
+    declickOffset = 0.0f;
+}
+
+// Fills a block with the waveform, the same on every channel.
+//
+// @param context: The block to be replaced.
+void WavetableOscillator::process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept
+{
+    auto& block = context.getOutputBlock();
+    const auto* table = source != nullptr ? source->get() : nullptr;
+
+    if (table == nullptr)
+    {
+        block.clear();
+        return;
+    }
+
+    const int numSamples = (int) block.getNumSamples();
+    const float inverseSampleRate = (float) (1.0 / sampleRate);
+
+    // One level per block, chosen for the higher end of any glide or pitch
+    // modulation in progress
+    const float highestFrequency = juce::jmax (frequency.getCurrentValue(), frequency.getTargetValue())
+                                   * juce::jmax (pitchRatio.getCurrentValue(), pitchRatio.getTargetValue());
+    const float* samples = table->getLevel (Wavetable::getLevelForFrequency (highestFrequency, sampleRate));
+
+    auto lookup = [samples] (float p) {
+        const float position = p * (float) Wavetable::tableSize;
+        const int index = juce::jmin ((int) position, Wavetable::tableSize - 1);
+        return samples[index] + (position - (float) index) * (samples[index + 1] - samples[index]);
+    };
+
+    if (table != lastTable)
+    {
+        declickOffset = lastTable != nullptr ? lastOutput - lookup (phase) : 0.0f;
+        lastTable = table;
+    }
+
+    auto* output = block.getChannelPointer (0);
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        output[n] = lookup (phase) + declickOffset;
+        declickOffset *= declickDecay;
+
+        phase += frequency.getNextValue() * pitchRatio.getNextValue() * inverseSampleRate;
+        phase -= (float) (int) phase;
+    }
+
+    if (numSamples > 0)
+    {
+        lastOutput = output[numSamples - 1];
+    }
+
+    for (size_t channel = 1; channel < block.getNumChannels(); ++channel)
+    {
+        juce::FloatVectorOperations::copy (block.getChannelPointer (channel), output, numSamples);
+    }
+}
+
+//==============================================================================
+
+WavetableBuilder::WavetableBuilder (RcuPointer<Wavetable>& target)
+    : wavetable (target)
+{
+}
+
+// Asks for a table built from harmonic amplitudes. Returns immediately.
+//
+// @param amplitudes: The amplitude of each harmonic, starting with the fundamental.
+void WavetableBuilder::requestHarmonics (const std::vector<float>& amplitudes)
+{
+    const juce::ScopedLock sl (requestLock);
+    requestValues = amplitudes;
+    requestIsCycle = false;
+    hasRequest = true;
+}
+
+// Asks for a table built from a drawn cycle. Returns immediately.
+//
+// @param cycle: Evenly spaced points across one period.
+void WavetableBuilder::requestCycle (const std::vector<float>& cycle)
+{
+    const juce::ScopedLock sl (requestLock);
+    requestValues = cycle;
+    requestIsCycle = true;
+    hasRequest = true;
+}
+
+// Builds and publishes the latest request, if any, and frees the tables the
+// voices have finished with. A table another instance has already built
+// from the same values is reused rather than built again.
+//
+// @return The number of milliseconds to wait before the next call.
+int WavetableBuilder::useTimeSlice()
+{
+    wavetable.reclaim();
+
+    std::vector<float> values;
+    bool isCycle;
+
+    {
+        const juce::ScopedLock sl (requestLock);
+
+        if (! hasRequest)
+        {
+            return 20;
+        }
+
+        values.swap (requestValues);
+        isCycle = requestIsCycle;
+        hasRequest = false;
+    }
+
+    const auto key = juce::String (isCycle ? "wavetable cycle " : "wavetable harmonics ")
+                     + juce::String::toHexString (values.data(), (int) (values.size() * sizeof (float)), 0);
+
+    const auto table = sharedResources->getOrCreate<Wavetable> (key, [&values, isCycle] {
+        return std::shared_ptr<const Wavetable> (isCycle ? Wavetable::fromCycle (values) : Wavetable::fromHarmonicAmplitudes (values));
+    });
+
+    wavetable.publish (Wavetable::referTo (table));
+    return 0;
+}
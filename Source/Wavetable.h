@@ -0,0 +1,132 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for user-defined wavetables.
+    Band-limited tables are built on a background thread from a drawn cycle
+    or a list of harmonic amplitudes and swapped into the running voices.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "RampedValue.h"
+#include "RcuPointer.h"
+#include "SharedResources.h"
+#include <JuceHeader.h>
+#include <complex>
+
+// One cycle of a waveform at several bandwidths. Level l holds harmonics up
+// to maxHarmonics >> l, so every level is alias free for fundamentals up to
+// twice those of the level before it. Immutable once built.
+class Wavetable
+{
+public:
+    static constexpr int tableSize = 2048;
+    static constexpr int maxHarmonics = tableSize / 4;
+    static constexpr int numLevels = 10;
+
+    static std::unique_ptr<Wavetable> fromHarmonicAmplitudes (const std::vector<float>&);
+    static std::unique_ptr<Wavetable> fromCycle (const std::vector<float>&);
+    static std::unique_ptr<Wavetable> referTo (std::shared_ptr<const Wavetable>);
+
+    static int getLevelForFrequency (float, double) noexcept;
+
+    // The tableSize samples of a level, followed by a copy of the first
+    const float* getLevel (int level) const noexcept { return samples->data() + level * (tableSize + 1); }
+
+private:
+    static std::unique_ptr<Wavetable> fromSpectrum (const std::vector<std::complex<float>>&);
+
+    std::shared_ptr<const std::vector<float>> samples;
+};
+
+// Plays the published wavetable with linear interpolation, picking the
+// level that keeps the current note free of aliasing.
+class WavetableOscillator
+{
+public:
+    void prepare (const juce::dsp::ProcessSpec&);
+    void setSource (RcuPointer<Wavetable>*);
+    void setFrequency (float) noexcept;
+    void setPitchRatio (float ratio, int numSamples) noexcept { pitchRatio.rampTo (ratio, numSamples); }
+    void reset (float) noexcept;
+    void process (const juce::dsp::ProcessContextReplacing<float>&) noexcept;
+
+    // The table is saved as whether there was one, and restores as the
+    // table now published, since a checkpoint may come from another
+    // processor with its own copy of the same table
+    template <typename Visitor>
+    void visitState (Visitor& visit)
+    {
+        bool hadTable = lastTable != nullptr;
+        visit (hadTable, phase, lastOutput, declickOffset, declickDecay);
+        frequency.visitState (visit);
+        pitchRatio.visitState (visit);
+
+        if (Visitor::isReading)
+        {
+            lastTable = hadTable && source != nullptr ? source->get() : nullptr;
+        }
+    }
+
+private:
+    RcuPointer<Wavetable>* source = nullptr;
+
+    // Only compared against, never read through: it may have been freed
+    const Wavetable* lastTable = nullptr;
+
+    double sampleRate = 44100.0;
+    float phase = 0.0f; // 0 to 1
+    RampedValue frequency;
+
+    // Pitch modulation, ramped separately from the glide between notes
+    RampedValue pitchRatio { 1.0f };
+
+    // When the table changes mid-note, the jump between the last sample of
+    // the old table and the first of the new one is faded out over a few
+    // milliseconds rather than heard as a click
+    float lastOutput = 0.0f;
+    float declickOffset = 0.0f;
+    float declickDecay = 0.0f;
+};
+
+// Background client that builds the most recently requested wavetable and
+// publishes it to the voices. Requests made while a build is running are
+// coalesced, so only the latest edit is built.
+class WavetableBuilder : public juce::TimeSliceClient
+{
+public:
+    explicit WavetableBuilder (RcuPointer<Wavetable>&);
+
+    void requestHarmonics (const std::vector<float>&);
+    void requestCycle (const std::vector<float>&);
+
+    int useTimeSlice() override;
+
+private:
+    RcuPointer<Wavetable>& wavetable;
+
+    // Tables built from the same values are shared with other instances
+    juce::SharedResourcePointer<SharedResources> sharedResources;
+
+    juce::CriticalSection requestLock;
+    std::vector<float> requestValues;
+    bool requestIsCycle = false;
+    bool hasRequest = false;
+};
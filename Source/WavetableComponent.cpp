@@ -0,0 +1,209 @@
+/*
+  ==============================================================================
+
+    This file contains the implementation information for a JUCE
+    component for defining the custom waveform, by drawing one cycle
+    or by typing the amplitudes of its harmonics.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "WavetableComponent.h"
+
+using juce::roundToInt;
+
+WavetableComponent::WavetableComponent()
+{
+    // Start from the sine the processor plays until the waveform is edited
+    for (int i = 0; i < numPoints; ++i)
+    {
+        cycle.push_back (std::sin (juce::MathConstants<float>::twoPi * (float) i / (float) numPoints));
+    }
+
+    harmonicsLabel.setText ("Harmonics", juce::dontSendNotification);
+    harmonicsLabel.setJustificationType (juce::Justification::centredLeft);
+
+    harmonicsInput.setTextToShowWhenEmpty ("e.g. 1 0.5 0.33 0.25, then Enter", juce::Colours::grey);
+    harmonicsInput.onReturnKey = [this] { harmonicsEntered(); };
+
+    addAndMakeVisible (&harmonicsLabel);
+    addAndMakeVisible (&harmonicsInput);
+}
+
+// Draws the pad and the current cycle.
+//
+// @param g: The graphics context that must be used to do the drawing operations.
+void WavetableComponent::paint (juce::Graphics& g)
+{
+    const auto pad = getPadBounds();
+
+    g.setColour (juce::Colours::black);
+    g.fillRect (pad);
+    g.setColour (juce::Colours::darkcyan);
+    g.drawRect (pad);
+    g.drawHorizontalLine (roundToInt (pad.getCentreY()), pad.getX(), pad.getRight());
+
+    juce::Path path;
+
+    for (int i = 0; i < numPoints; ++i)
+    {
+        const juce::Point<float> point (pad.getX() + pad.getWidth() * (float) i / (float) (numPoints - 1),
+                                        pad.getCentreY() - 0.5f * pad.getHeight() * cycle[(size_t) i]);
+
+        if (i == 0)
+        {
+            path.startNewSubPath (point);
+        }
+        else
+        {
+            path.lineTo (point);
+        }
+    }
+
+    g.setColour (juce::Colours::lightgoldenrodyellow);
+    g.strokePath (path, juce::PathStrokeType (1.5f));
+}
+
+// Sets the dimensions of the harmonics box and label. Typically called
+// when the component's width or height changes.
+void WavetableComponent::resized()
+{
+    float width = (float) getWidth();
+    float height = (float) getHeight();
+
+    harmonicsLabel.setFont (0.35f * height);
+    harmonicsLabel.setBounds (roundToInt (0.5200f * width), roundToInt (0.0000f * height), roundToInt (0.4800f * width), roundToInt (0.4000f * height));
+    harmonicsInput.setBounds (roundToInt (0.5200f * width), roundToInt (0.4500f * height), roundToInt (0.4800f * width), roundToInt (0.4000f * height));
+}
+
+// Starts drawing when the pad is clicked.
+//
+// @param event: The mouse event triggering the change
+void WavetableComponent::mouseDown (const juce::MouseEvent& event)
+{
+    if (getPadBounds().contains (event.position))
+    {
+        lastPoint = event.position;
+        drawTo (event.position);
+    }
+}
+
+// Continues drawing as the mouse is dragged across the pad.
+//
+// @param event: The mouse event triggering the change
+void WavetableComponent::mouseDrag (const juce::MouseEvent& event)
+{
+    if (getPadBounds().contains (event.mouseDownPosition))
+    {
+        drawTo (event.position);
+    }
+}
+
+// Returns the drawing area, the left half of the component.
+juce::Rectangle<float> WavetableComponent::getPadBounds() const
+{
+    return getLocalBounds().toFloat().withWidth (0.5f * (float) getWidth());
+}
+
+// Sets every point between the previous mouse position and this one, so a
+// fast drag leaves no gaps, then reports the new cycle.
+//
+// @param point: The mouse position in this component's coordinates.
+void WavetableComponent::drawTo (juce::Point<float> point)
+{
+    const auto pad = getPadBounds();
+
+    auto toIndex = [&pad] (float x) {
+        return juce::jlimit (0, numPoints - 1, roundToInt ((x - pad.getX()) / pad.getWidth() * (float) (numPoints - 1)));
+    };
+
+    auto toValue = [&pad] (float y) {
+        return juce::jlimit (-1.0f, 1.0f, 2.0f * (pad.getCentreY() - y) / pad.getHeight());
+    };
+
+    const int from = toIndex (lastPoint.x);
+    const int to = toIndex (point.x);
+    const float fromValue = toValue (lastPoint.y);
+    const float toValueAtPoint = toValue (point.y);
+
+    for (int i = juce::jmin (from, to); i <= juce::jmax (from, to); ++i)
+    {
+        const float proportion = from == to ? 1.0f : (float) (i - from) / (float) (to - from);
+        cycle[(size_t) i] = juce::jmap (proportion, fromValue, toValueAtPoint);
+    }
+
+    lastPoint = point;
+    repaint();
+
+    if (onCycleDrawn != nullptr)
+    {
+        onCycleDrawn (cycle);
+    }
+}
+
+// Parses the harmonics box as a list of amplitudes separated by spaces or
+// commas and reports them.
+void WavetableComponent::harmonicsEntered()
+{
+    auto tokens = juce::StringArray::fromTokens (harmonicsInput.getText(), " ,", "");
+    tokens.removeEmptyStrings();
+
+    std::vector<float> amplitudes;
+
+    for (auto& token : tokens)
+    {
+        amplitudes.push_back (token.getFloatValue());
+    }
+
+    if (amplitudes.empty())
+    {
+        return;
+    }
+
+    // Show the sum of the harmonics on the pad, at the same peak level the
+    // processor normalises its tables to
+    float peak = 0.0f;
+
+    for (int i = 0; i < numPoints; ++i)
+    {
+        float value = 0.0f;
+
+        for (size_t h = 0; h < amplitudes.size(); ++h)
+        {
+            value += amplitudes[h] * std::sin (juce::MathConstants<float>::twoPi * (float) ((h + 1) * (size_t) i) / (float) numPoints);
+        }
+
+        cycle[(size_t) i] = value;
+        peak = juce::jmax (peak, std::abs (value));
+    }
+
+    if (peak > 0.0f)
+    {
+        for (auto& value : cycle)
+        {
+            value /= peak;
+        }
+    }
+
+    repaint();
+
+    if (onHarmonicsEntered != nullptr)
+    {
+        onHarmonicsEntered (amplitudes);
+    }
+}
@@ -0,0 +1,59 @@
+/*
+  ==============================================================================
+
+    This file contains the header information for a JUCE
+    component for defining the custom waveform, by drawing one cycle
+    or by typing the amplitudes of its harmonics.
+
+    Copyright (C) 2021  Andrew Wilson, Robin Su, Aaron Hudson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+class WavetableComponent : public juce::Component
+{
+public:
+    // Number of points across the drawn cycle
+    static constexpr int numPoints = 128;
+
+    WavetableComponent();
+    ~WavetableComponent() = default;
+
+    void paint (juce::Graphics&) override;
+    void resized() override;
+    void mouseDown (const juce::MouseEvent&) override;
+    void mouseDrag (const juce::MouseEvent&) override;
+
+    // Called with the whole cycle (-1 to 1) every time it is drawn on
+    std::function<void (const std::vector<float>&)> onCycleDrawn;
+
+    // Called with the amplitudes typed into the harmonics box
+    std::function<void (const std::vector<float>&)> onHarmonicsEntered;
+
+private:
+    juce::Rectangle<float> getPadBounds() const;
+    void drawTo (juce::Point<float>);
+    void harmonicsEntered();
+
+    std::vector<float> cycle;
+    juce::Point<float> lastPoint;
+
+    juce::Label harmonicsLabel;
+    juce::TextEditor harmonicsInput;
+};